@@ -38,6 +38,15 @@
 #if defined(CONFIG_USB_DEVICE) || defined(CONFIG_USB_GADGET_S3C2410)
 extern int s3c2410_udc_irq(void);
 #endif
+/* the same condition as S3C2440_NAND_RB_IRQ in s3c2410_nand.c */
+#if defined(CONFIG_S3C2440) && defined(CONFIG_S3C2410_NAND_IRQ) && \
+	defined(CONFIG_USE_IRQ) && !defined(CONFIG_NAND_SPL)
+#define S3C2440_NAND_RB_IRQ
+#endif
+
+#ifdef S3C2440_NAND_RB_IRQ
+extern void s3c2410_nand_irq(void);
+#endif
 
 void do_irq (struct pt_regs *pt_regs)
 {
@@ -52,6 +61,15 @@ void do_irq (struct pt_regs *pt_regs)
 	}
 #endif /* USB_DEVICE */
 
+#ifdef S3C2440_NAND_RB_IRQ
+	/* NAND R/B went high: wakes s3c2410_dev_ready() */
+	if (intpnd & BIT_NFCON) {
+		s3c2410_nand_irq();
+		irq->SRCPND = BIT_NFCON;
+		irq->INTPND = BIT_NFCON;
+	}
+#endif
+
 }
 
 
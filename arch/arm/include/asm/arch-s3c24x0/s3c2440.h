@@ -185,6 +185,7 @@ static inline struct s3c2410_sdi *s3c2410_get_base_sdi(void)
 #define BIT_SDI			(0x1<<21)
 #define BIT_SPI0		(0x1<<22)
 #define BIT_UART1		(0x1<<23)
+#define BIT_NFCON		(0x1<<24)
 #define BIT_USBD		(0x1<<25)
 #define BIT_USBH		(0x1<<26)
 #define BIT_IIC			(0x1<<27)
@@ -86,6 +86,18 @@ extern int secbulk_init(void);
 extern int fastboot_init(void);
 #endif
 
+#if defined(CONFIG_USB_G_ZERO)
+extern int zero_init(void);
+#endif
+
+#ifdef CONFIG_NAND_STATS
+extern void nand_stats_init(void);
+#endif
+
+#ifdef CONFIG_NAND_READAHEAD
+extern void nand_readahead_start(void);
+#endif
+
 #ifndef CONFIG_IDENT_STRING
 #define CONFIG_IDENT_STRING ""
 #endif
@@ -351,7 +363,12 @@ void start_armboot (void)
 
 #if defined(CONFIG_CMD_NAND)
 	puts ("NAND:  ");
-	nand_init();		/* go init the NAND */
+	{
+		ulong start = get_timer(0);
+
+		nand_init();		/* go init the NAND */
+		debug ("NAND init took %lu ms\n", get_timer(start));
+	}
 #endif
 
 #if defined(CONFIG_CMD_ONENAND)
@@ -376,6 +393,16 @@ void start_armboot (void)
 	/* initialize environment */
 	env_relocate ();
 
+#ifdef CONFIG_NAND_STATS
+	/* needs mtdparts */
+	nand_stats_init();
+#endif
+
+#ifdef CONFIG_NAND_READAHEAD
+	/* needs bootcmd and bootdelay */
+	nand_readahead_start();
+#endif
+
 #ifdef CONFIG_VFD
 	/* must do this after the framebuffer is allocated */
 	drv_vfd_init();
@@ -475,6 +502,10 @@ extern void davinci_eth_set_mac_addr (const u_int8_t *addr);
 	fastboot_init();
 #endif
 
+#if defined(CONFIG_USB_G_ZERO)
+	zero_init();
+#endif
+
 	/* main_loop() can return to retry autoboot, if so just run it again. */
 	for (;;) {
 		main_loop ();
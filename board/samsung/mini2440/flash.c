@@ -23,90 +23,371 @@
  */
 
 #include <common.h>
+#include <asm/io.h>
+#include <asm/arch/s3c24x0_cpu.h>
 
 ulong myflush (void);
 
 
-#define FLASH_BANK_SIZE	PHYS_FLASH_SIZE
-#define MAIN_SECT_SIZE  0x10000	/* 64 KB */
-
 flash_info_t flash_info[CONFIG_SYS_MAX_FLASH_BANKS];
 
+/* what the chip can do beyond plain word programming */
+static struct flash_chip {
+	vu_short *addr1;	/* unlock cycle addresses */
+	vu_short *addr2;
+	ulong	flags;
+	ushort	erase_cmd;	/* for one sector of the map */
+	ushort	buffer_size;	/* write buffer in halfwords, 0 if none */
+	ulong	word_tout;	/* worst case times, in timer ticks */
+	ulong	buffer_tout;
+	ulong	erase_tout;	/* per sector */
+} flash_chip[CONFIG_SYS_MAX_FLASH_BANKS];
+
+#define FLASH_BYPASS		(1 << 0)	/* unlock bypass program */
+#define FLASH_BATCH_ERASE	(1 << 1)	/* sector erase timer, DQ3 */
+#define FLASH_DQ5		(1 << 2)	/* DQ5 reports a failure */
+
 
 #define CMD_READ_ARRAY		0x000000F0
 #define CMD_UNLOCK1		0x000000AA
 #define CMD_UNLOCK2		0x00000055
+#define CMD_AUTOSELECT		0x00000090
 #define CMD_ERASE_SETUP		0x00000080
 #define CMD_ERASE_CONFIRM	0x00000030
+#define CMD_ERASE_SST_4K	0x00000050	/* SST39VF160x and later */
 #define CMD_PROGRAM		0x000000A0
 #define CMD_UNLOCK_BYPASS	0x00000020
+#define CMD_BYPASS_RESET1	0x00000090
+#define CMD_BYPASS_RESET2	0x00000000
+#define CMD_WRITE_TO_BUFFER	0x00000025
+#define CMD_PROGRAM_BUFFER	0x00000029
+#define CMD_CFI_QUERY		0x00000098
+
+/* command addresses, in halfwords from the chip base */
+#define CFI_ADDR		0x00000055
+#define AMD_ADDR1		0x00000555
+#define AMD_ADDR2		0x000002AA
+#define SST_ADDR1		0x00005555
+#define SST_ADDR2		0x00002AAA
+
+#define BIT_DATA_POLL		0x00000080	/* DQ7 */
+#define BIT_TOGGLE		0x00000040	/* DQ6 */
+#define BIT_PROGRAM_ERROR	0x00000020	/* DQ5 */
+#define BIT_ERASE_TIMER		0x00000008	/* DQ3 */
+#define BIT_BUFFER_ABORT	0x00000002	/* DQ1 */
+
+/* polls before the timer is started, about one typical word program */
+#define FLASH_POLL_FAST		64
+
+/* flash_poll() flags */
+#define FLASH_POLL_BUFFER	(1 << 0)	/* DQ1 means abort */
+#define FLASH_POLL_DOTS		(1 << 1)	/* a dot per second */
+#define FLASH_POLL_DQ5		(1 << 2)	/* DQ5 means failure */
+
+/* CFI query, in halfwords from the chip base */
+#define CFI_QRY			0x10
+#define CFI_CMDSET		0x13	/* primary command set */
+#define CFI_EXT			0x15	/* and its extended table */
+#define CFI_WORD_TYP		0x1f	/* 2^n us */
+#define CFI_BUFFER_TYP		0x20	/* 2^n us, 0 if no buffer */
+#define CFI_ERASE_TYP		0x21	/* 2^n ms */
+#define CFI_WORD_MAX		0x23	/* 2^n times typical */
+#define CFI_BUFFER_MAX		0x24
+#define CFI_ERASE_MAX		0x25
+#define CFI_SIZE		0x27	/* 2^n bytes */
+#define CFI_BUFFER_SIZE		0x2a	/* 2^n bytes */
+#define CFI_REGIONS		0x2c
+#define CFI_REGION		0x2d	/* 4 each: blocks - 1, size / 256 */
+#define CFI_EXT_BOOT		0x0f	/* in the AMD table, 3 if top boot */
+
+#define CFI_CMDSET_AMD		0x0002
+#define CFI_CMDSET_SST		0x0701
+
+/* more than any chip we know of has */
+#define CFI_MAX_REGIONS		8
+
+/*-----------------------------------------------------------------------
+ */
+
+/* a one or two byte CFI field */
+static ushort flash_cfi_read (vu_short * cfi, int off, int len)
+{
+	ushort val = cfi[off] & 0xff;
+
+	if (len > 1)
+		val |= (cfi[off + 1] & 0xff) << 8;
+	return val;
+}
+
+/* worst case from the CFI typical time and factor, in timer ticks */
+static ulong flash_cfi_tout (vu_short * cfi, int typ, int max, int us)
+{
+	ulong t = cfi[typ] & 0xff;
+	ulong m = cfi[max] & 0xff;
+
+	if (!t || !m)
+		return 0;
+
+	t = (1 << t) << m;
+	if (us)
+		t = (t + 999) / 1000;
+
+	/* plus one for a tick that was already under way */
+	return t * CONFIG_SYS_HZ / 1000 + 1;
+}
+
+static int flash_cfi_qry (vu_short * cfi)
+{
+	return (cfi[CFI_QRY] & 0xff) == 'Q' &&
+		(cfi[CFI_QRY + 1] & 0xff) == 'R' &&
+		(cfi[CFI_QRY + 2] & 0xff) == 'Y';
+}
+
+/* AMD parts take the query command alone, SST ones after an unlock */
+static int flash_cfi_enter (vu_short * cfi)
+{
+	cfi[CFI_ADDR] = CMD_CFI_QUERY;
+	if (flash_cfi_qry (cfi))
+		return 0;
+
+	cfi[0] = CMD_READ_ARRAY;
+	cfi[SST_ADDR1] = CMD_UNLOCK1;
+	cfi[SST_ADDR2] = CMD_UNLOCK2;
+	cfi[SST_ADDR1] = CMD_CFI_QUERY;
+	if (flash_cfi_qry (cfi))
+		return 0;
+
+	cfi[0] = CMD_READ_ARRAY;
+	return -1;
+}
+
+/*
+ * Fills in info and chip from what the chip at base reports in CFI
+ * query mode: size, sector layout, command set, write buffer and
+ * timeouts.  Returns 0 if it answered with a command set we drive.
+ */
+static int flash_cfi_probe (ulong base, flash_info_t * info,
+			    struct flash_chip *chip)
+{
+	vu_short *cfi = (vu_short *) base;
+	ulong blocks[CFI_MAX_REGIONS], bsize[CFI_MAX_REGIONS];
+	ulong addr, end, t;
+	ushort man, dev;
+	int cmdset, ext, regions, top = 0;
+	int i, j, r, sect;
+	int cflag, iflag;
+
+	/* the query replaces the array, vectors included */
+	cflag = icache_status ();
+	icache_disable ();
+	iflag = disable_interrupts ();
+
+	if (flash_cfi_enter (cfi)) {
+		cmdset = 0;
+		goto out;
+	}
+
+	cmdset = flash_cfi_read (cfi, CFI_CMDSET, 2);
+	ext = flash_cfi_read (cfi, CFI_EXT, 2);
+	if (cmdset != CFI_CMDSET_AMD && cmdset != CFI_CMDSET_SST) {
+		/* read array for AMD and Intel style parts alike */
+		cfi[0] = CMD_READ_ARRAY;
+		cfi[0] = 0xFF;
+		goto out;
+	}
+
+	chip->flags = 0;
+	chip->buffer_size = 0;
+	if ((t = flash_cfi_tout (cfi, CFI_WORD_TYP, CFI_WORD_MAX, 1)))
+		chip->word_tout = t;
+	if ((t = flash_cfi_tout (cfi, CFI_BUFFER_TYP, CFI_BUFFER_MAX, 1)))
+		chip->buffer_tout = t;
+	if ((t = flash_cfi_tout (cfi, CFI_ERASE_TYP, CFI_ERASE_MAX, 0)))
+		chip->erase_tout = t;
+
+	info->size = 1 << (cfi[CFI_SIZE] & 0xff);
+
+	regions = cfi[CFI_REGIONS] & 0xff;
+	if (regions > CFI_MAX_REGIONS)
+		regions = CFI_MAX_REGIONS;
+	for (r = 0; r < regions; r++) {
+		blocks[r] = flash_cfi_read (cfi, CFI_REGION + 4 * r, 2) + 1;
+		bsize[r] = flash_cfi_read (cfi, CFI_REGION + 4 * r + 2, 2);
+		bsize[r] = bsize[r] ? bsize[r] * 256 : 128;
+	}
+
+	if (cmdset == CFI_CMDSET_AMD) {
+		chip->addr1 = &cfi[AMD_ADDR1];
+		chip->addr2 = &cfi[AMD_ADDR2];
+		chip->flags = FLASH_BYPASS | FLASH_BATCH_ERASE | FLASH_DQ5;
+		if (cfi[CFI_BUFFER_TYP] & 0xff)
+			chip->buffer_size =
+				(1 << flash_cfi_read (cfi, CFI_BUFFER_SIZE, 2)) / 2;
+
+		/* top boot parts list the small sectors first all the same */
+		if (ext && (cfi[ext] & 0xff) == 'P' &&
+		    (cfi[ext + CFI_EXT_BOOT] & 0xff) == 3)
+			top = 1;
+	} else {
+		/* SST: plain word program and one sector per erase */
+		chip->addr1 = &cfi[SST_ADDR1];
+		chip->addr2 = &cfi[SST_ADDR2];
+	}
 
-#define MEM_FLASH_ADDR1		(*(volatile u16 *)(CONFIG_SYS_FLASH_BASE + (0x00000555 << 1)))
-#define MEM_FLASH_ADDR2		(*(volatile u16 *)(CONFIG_SYS_FLASH_BASE + (0x000002AA << 1)))
+	cfi[0] = CMD_READ_ARRAY;
 
-#define BIT_ERASE_DONE		0x00000080
-#define BIT_RDY_MASK		0x00000080
-#define BIT_PROGRAM_ERROR	0x00000020
-#define BIT_TIMEOUT		0x80000000	/* our flag */
+	/* the IDs only go into flash_id, for flinfo */
+	*chip->addr1 = CMD_UNLOCK1;
+	*chip->addr2 = CMD_UNLOCK2;
+	*chip->addr1 = CMD_AUTOSELECT;
+	man = cfi[0] & 0xff;
+	dev = cfi[1];
+	cfi[0] = CMD_READ_ARRAY;
 
-#define READY 1
-#define ERR   2
-#define TMO   4
+	info->flash_id = (man << 16) | dev;
+
+	/* the newer SST parts swapped the 4K sector and 64K block erase */
+	chip->erase_cmd = CMD_ERASE_CONFIRM;
+	if (cmdset == CFI_CMDSET_SST && (dev & 0xff00) == 0x2300)
+		chip->erase_cmd = CMD_ERASE_SST_4K;
+
+	/*
+	 * Regions in address order, up to the size of the chip: SST lists
+	 * its 4K sectors and its 64K blocks as two regions of the same
+	 * whole chip.
+	 */
+	addr = base;
+	end = base + info->size;
+	sect = 0;
+	for (i = 0; i < regions; i++) {
+		r = top ? regions - 1 - i : i;
+		for (j = 0; j < blocks[r] && addr < end; j++) {
+			if (sect == CONFIG_SYS_MAX_FLASH_SECT)
+				break;
+			info->start[sect++] = addr;
+			addr += bsize[r];
+		}
+	}
+	info->sector_count = sect;
+	if (addr < end) {
+		printf ("## only 0x%lx of 0x%lx bytes fit in %d sectors\n",
+			addr - base, info->size, CONFIG_SYS_MAX_FLASH_SECT);
+		info->size = addr - base;
+	}
+
+      out:
+	if (iflag)
+		enable_interrupts ();
+
+	if (cflag)
+		icache_enable ();
+
+	if (!cmdset)
+		return -1;
+	if (cmdset != CFI_CMDSET_AMD && cmdset != CFI_CMDSET_SST) {
+		printf ("## FLASH command set %04x not supported\n", cmdset);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Waits for the program or erase at addr to end.  DQ6 toggles on every
+ * read while the chip is busy, so two equal reads mean it's done and
+ * the second one is array data, whose DQ7 must then match data.  On
+ * AMD parts DQ5 (or DQ1 for a buffer load) while still toggling means
+ * the chip gave up; SST parts don't define DQ5.  The timer is only
+ * started once a few polls haven't seen the end, so a word program
+ * normally costs no timer reads at all.
+ */
+static int flash_poll (vu_short * addr, ushort data, ulong tout, int flags)
+{
+	ushort prev, cur, err = 0;
+	ulong n, t, shown = 0;
+
+	if (flags & FLASH_POLL_DQ5)
+		err |= BIT_PROGRAM_ERROR;
+	if (flags & FLASH_POLL_BUFFER)
+		err |= BIT_BUFFER_ABORT;
+
+	prev = *addr;
+	for (n = 0;; n++) {
+		cur = *addr;
+
+		if ((cur ^ prev) & BIT_TOGGLE && cur & err) {
+			/* it may have ended between the two reads */
+			prev = *addr;
+			cur = *addr;
+			if ((cur ^ prev) & BIT_TOGGLE)
+				return ERR_PROG_ERROR;
+		}
+
+		if (!((cur ^ prev) & BIT_TOGGLE)) {
+			if ((cur & BIT_DATA_POLL) != (data & BIT_DATA_POLL))
+				return ERR_PROG_ERROR;
+			return ERR_OK;
+		}
+		prev = cur;
+
+		if (n < FLASH_POLL_FAST)
+			continue;
+		if (n == FLASH_POLL_FAST) {
+			/* arm simple, non interrupt dependent timer */
+			reset_timer_masked ();
+			continue;
+		}
+
+		t = get_timer_masked ();
+		if (t > tout)
+			return ERR_TIMOUT;
+		if ((flags & FLASH_POLL_DOTS) && t / CONFIG_SYS_HZ > shown) {
+			putc ('.');
+			shown++;
+		}
+	}
+}
 
 /*-----------------------------------------------------------------------
  */
 
 ulong flash_init (void)
 {
-	int i, j;
+	struct s3c24x0_memctl * const memctl = s3c24x0_get_base_memctl ();
+	int i;
 	ulong size = 0;
 
 	for (i = 0; i < CONFIG_SYS_MAX_FLASH_BANKS; i++) {
 		ulong flashbase = 0;
 
-		flash_info[i].flash_id =
-#if defined(CONFIG_AMD_LV400)
-			(AMD_MANUFACT & FLASH_VENDMASK) |
-			(AMD_ID_LV400B & FLASH_TYPEMASK);
-#elif defined(CONFIG_AMD_LV800)
-			(AMD_MANUFACT & FLASH_VENDMASK) |
-			(AMD_ID_LV800B & FLASH_TYPEMASK);
-#else
-#error "Unknown flash configured"
-#endif
-			flash_info[i].size = FLASH_BANK_SIZE;
-		flash_info[i].sector_count = CONFIG_SYS_MAX_FLASH_SECT;
+		flash_info[i].flash_id = FLASH_UNKNOWN;
+		flash_info[i].size = 0;
+		flash_info[i].sector_count = 0;
 		memset (flash_info[i].protect, 0, CONFIG_SYS_MAX_FLASH_SECT);
 		if (i == 0)
 			flashbase = PHYS_FLASH_1;
 		else
 			panic ("configured too many flash banks!\n");
-		for (j = 0; j < flash_info[i].sector_count; j++) {
-			if (j <= 3) {
-				/* 1st one is 16 KB */
-				if (j == 0) {
-					flash_info[i].start[j] =
-						flashbase + 0;
-				}
-
-				/* 2nd and 3rd are both 8 KB */
-				if ((j == 1) || (j == 2)) {
-					flash_info[i].start[j] =
-						flashbase + 0x4000 + (j -
-								      1) *
-						0x2000;
-				}
-
-				/* 4th 32 KB */
-				if (j == 3) {
-					flash_info[i].start[j] =
-						flashbase + 0x8000;
-				}
-			} else {
-				flash_info[i].start[j] =
-					flashbase + (j - 3) * MAIN_SECT_SIZE;
-			}
+
+		/*
+		 * OM[1:0] read back in DW0: booted from NAND, nGCS0 is
+		 * the Steppingstone and there is no NOR to probe.
+		 */
+		if (!(readl (&memctl->BWSCON) & 0x6))
+			continue;
+
+		flash_chip[i].word_tout = CONFIG_SYS_FLASH_WRITE_TOUT;
+		flash_chip[i].buffer_tout = CONFIG_SYS_FLASH_WRITE_TOUT;
+		flash_chip[i].erase_tout = CONFIG_SYS_FLASH_ERASE_TOUT;
+
+		if (flash_cfi_probe (flashbase, &flash_info[i],
+				     &flash_chip[i])) {
+			flash_info[i].flash_id = FLASH_UNKNOWN;
+			flash_info[i].size = 0;
+			flash_info[i].sector_count = 0;
+			continue;
 		}
+
 		size += flash_info[i].size;
 	}
 
@@ -126,32 +407,36 @@ ulong flash_init (void)
  */
 void flash_print_info (flash_info_t * info)
 {
+	struct flash_chip *chip = &flash_chip[info - flash_info];
 	int i;
 
+	if (info->flash_id == FLASH_UNKNOWN) {
+		printf ("missing or unknown FLASH type\n");
+		return;
+	}
+
 	switch (info->flash_id & FLASH_VENDMASK) {
 	case (AMD_MANUFACT & FLASH_VENDMASK):
 		printf ("AMD: ");
 		break;
+	case (SST_MANUFACT & FLASH_VENDMASK):
+		printf ("SST: ");
+		break;
 	default:
 		printf ("Unknown Vendor ");
 		break;
 	}
 
-	switch (info->flash_id & FLASH_TYPEMASK) {
-	case (AMD_ID_LV400B & FLASH_TYPEMASK):
-		printf ("1x Amd29LV400BB (4Mbit)\n");
-		break;
-	case (AMD_ID_LV800B & FLASH_TYPEMASK):
-		printf ("1x Amd29LV800BB (8Mbit)\n");
-		break;
-	default:
-		printf ("Unknown Chip Type\n");
-		goto Done;
-		break;
-	}
+	printf ("1x CFI flash, device %04lX\n",
+		info->flash_id & FLASH_TYPEMASK);
+
+	printf ("  Size: %ld KB in %d Sectors\n",
+		info->size >> 10, info->sector_count);
 
-	printf ("  Size: %ld MB in %d Sectors\n",
-		info->size >> 20, info->sector_count);
+	printf ("  Program: %s%s, %s erase\n",
+		chip->flags & FLASH_BYPASS ? "unlock bypass" : "word",
+		chip->buffer_size ? ", write buffer" : "",
+		chip->flags & FLASH_BATCH_ERASE ? "batched" : "sector");
 
 	printf ("  Sector Start Addresses:");
 	for (i = 0; i < info->sector_count; i++) {
@@ -162,8 +447,6 @@ void flash_print_info (flash_info_t * info)
 			info->protect[i] ? " (RO)" : "     ");
 	}
 	printf ("\n");
-
-      Done:;
 }
 
 /*-----------------------------------------------------------------------
@@ -171,10 +454,9 @@ void flash_print_info (flash_info_t * info)
 
 int flash_erase (flash_info_t * info, int s_first, int s_last)
 {
-	ushort result;
-	int iflag, cflag, prot, sect;
+	struct flash_chip *chip = &flash_chip[info - flash_info];
+	int iflag, cflag, prot, sect, first;
 	int rc = ERR_OK;
-	int chip;
 
 	/* first look for protection bits */
 
@@ -185,11 +467,6 @@ int flash_erase (flash_info_t * info, int s_first, int s_last)
 		return ERR_INVAL;
 	}
 
-	if ((info->flash_id & FLASH_VENDMASK) !=
-	    (AMD_MANUFACT & FLASH_VENDMASK)) {
-		return ERR_UNKNOWN_FLASH_VENDOR;
-	}
-
 	prot = 0;
 	for (sect = s_first; sect <= s_last; ++sect) {
 		if (info->protect[sect]) {
@@ -210,64 +487,57 @@ int flash_erase (flash_info_t * info, int s_first, int s_last)
 	icache_disable ();
 	iflag = disable_interrupts ();
 
-	/* Start erase on unprotected sectors */
-	for (sect = s_first; sect <= s_last && !ctrlc (); sect++) {
-		printf ("Erasing sector %2d ... ", sect);
-
-		/* arm simple, non interrupt dependent timer */
-		reset_timer_masked ();
-
-		if (info->protect[sect] == 0) {	/* not protected */
-			vu_short *addr = (vu_short *) (info->start[sect]);
-
-			MEM_FLASH_ADDR1 = CMD_UNLOCK1;
-			MEM_FLASH_ADDR2 = CMD_UNLOCK2;
-			MEM_FLASH_ADDR1 = CMD_ERASE_SETUP;
-
-			MEM_FLASH_ADDR1 = CMD_UNLOCK1;
-			MEM_FLASH_ADDR2 = CMD_UNLOCK2;
-			*addr = CMD_ERASE_CONFIRM;
-
-			/* wait until flash is ready */
-			chip = 0;
-
-			do {
-				result = *addr;
-
-				/* check timeout */
-				if (get_timer_masked () >
-				    CONFIG_SYS_FLASH_ERASE_TOUT) {
-					MEM_FLASH_ADDR1 = CMD_READ_ARRAY;
-					chip = TMO;
-					break;
-				}
-
-				if (!chip
-				    && (result & 0xFFFF) & BIT_ERASE_DONE)
-					chip = READY;
-
-				if (!chip
-				    && (result & 0xFFFF) & BIT_PROGRAM_ERROR)
-					chip = ERR;
+	/*
+	 * Start erase on unprotected sectors.  After the first sector
+	 * erase command an AMD style chip takes more sector addresses
+	 * until its erase timer runs out (DQ3 set), then erases them all
+	 * in one go, so each batch is waited for once rather than sector
+	 * by sector.  SST parts start erasing right away.
+	 */
+	sect = s_first;
+	while (sect <= s_last && !ctrlc ()) {
+		vu_short *addr = (vu_short *) (info->start[sect]);
+
+		first = sect;
+
+		*chip->addr1 = CMD_UNLOCK1;
+		*chip->addr2 = CMD_UNLOCK2;
+		*chip->addr1 = CMD_ERASE_SETUP;
+
+		*chip->addr1 = CMD_UNLOCK1;
+		*chip->addr2 = CMD_UNLOCK2;
+		*addr = chip->erase_cmd;
+
+		/*
+		 * DQ3 set after a command means it may have come too late,
+		 * so that sector starts the next batch instead.
+		 */
+		while ((chip->flags & FLASH_BATCH_ERASE) &&
+		       sect < s_last && !(*addr & BIT_ERASE_TIMER)) {
+			*(vu_short *) (info->start[sect + 1]) =
+				chip->erase_cmd;
+			if (*addr & BIT_ERASE_TIMER)
+				break;
+			sect++;
+		}
 
-			} while (!chip);
+		if (first == sect)
+			printf ("Erasing sector %2d ... ", first);
+		else
+			printf ("Erasing sectors %2d-%2d ... ", first, sect);
 
-			MEM_FLASH_ADDR1 = CMD_READ_ARRAY;
+		rc = flash_poll (addr, 0xFFFF,
+				 chip->erase_tout * (sect - first + 1),
+				 FLASH_POLL_DOTS | (chip->flags & FLASH_DQ5 ?
+						    FLASH_POLL_DQ5 : 0));
 
-			if (chip == ERR) {
-				rc = ERR_PROG_ERROR;
-				goto outahere;
-			}
-			if (chip == TMO) {
-				rc = ERR_TIMOUT;
-				goto outahere;
-			}
+		*chip->addr1 = CMD_READ_ARRAY;
 
-			printf ("ok.\n");
-		} else {	/* it was protected */
+		if (rc != ERR_OK)
+			goto outahere;
 
-			printf ("protected!\n");
-		}
+		printf ("ok.\n");
+		sect++;
 	}
 
 	if (ctrlc ())
@@ -290,70 +560,132 @@ int flash_erase (flash_info_t * info, int s_first, int s_last)
  * Copy memory to flash
  */
 
-static int write_hword (flash_info_t * info, ulong dest, ushort data)
+/* sector that addr is in */
+static ulong flash_sector_base (flash_info_t * info, ulong addr)
 {
+	int i;
+
+	for (i = info->sector_count - 1; i > 0; i--)
+		if (addr >= info->start[i])
+			break;
+	return info->start[i];
+}
+
+/*
+ * Write-to-buffer programming: up to buffer_size words within one
+ * buffer page, loaded at the sector address and confirmed with one
+ * command, so the chip programs them in about the time of one word.
+ */
+static int flash_write_buffer (flash_info_t * info, struct flash_chip *chip,
+			       ulong dest, const uchar * src, ulong words)
+{
+	vu_short *sa = (vu_short *) flash_sector_base (info, dest);
 	vu_short *addr = (vu_short *) dest;
-	ushort result;
+	ushort data = 0;
+	ulong i;
+	int rc;
+
+	*chip->addr1 = CMD_UNLOCK1;
+	*chip->addr2 = CMD_UNLOCK2;
+	*sa = CMD_WRITE_TO_BUFFER;
+	*sa = words - 1;
+	for (i = 0; i < words; i++, src += 2) {
+		data = src[0] | (src[1] << 8);
+		addr[i] = data;
+	}
+	*sa = CMD_PROGRAM_BUFFER;
+
+	/* only AMD parts have a write buffer */
+	rc = flash_poll (&addr[words - 1], data, chip->buffer_tout,
+			 FLASH_POLL_BUFFER | FLASH_POLL_DQ5);
+	if (rc != ERR_OK) {
+		/* leave write-buffer-abort state */
+		*chip->addr1 = CMD_UNLOCK1;
+		*chip->addr2 = CMD_UNLOCK2;
+		*chip->addr1 = CMD_READ_ARRAY;
+	}
+	return rc;
+}
+
+/*
+ * Program words halfwords from src (any alignment, little endian) to
+ * dest, with interrupts and the icache off for the whole run: our
+ * exception vectors are at address 0 in the flash, and we don't want a
+ * (ticker) exception to happen while the flash chip is in programming
+ * mode.  Single words go through unlock bypass, so each one takes two
+ * bus cycles instead of four.
+ */
+static int flash_program (flash_info_t * info, ulong dest, const uchar * src,
+			  ulong words)
+{
+	struct flash_chip *chip = &flash_chip[info - flash_info];
+	vu_short *addr = (vu_short *) dest;
+	ulong i, n, page;
+	ushort data;
 	int rc = ERR_OK;
-	int cflag, iflag;
-	int chip;
+	int cflag, iflag, bypass = 0;
 
 	/*
 	 * Check if Flash is (sufficiently) erased
 	 */
-	result = *addr;
-	if ((result & data) != data)
-		return ERR_NOT_ERASED;
-
+	for (i = 0; i < words; i++) {
+		data = src[2 * i] | (src[2 * i + 1] << 8);
+		if ((addr[i] & data) != data)
+			return ERR_NOT_ERASED;
+	}
 
-	/*
-	 * Disable interrupts which might cause a timeout
-	 * here. Remember that our exception vectors are
-	 * at address 0 in the flash, and we don't want a
-	 * (ticker) exception to happen while the flash
-	 * chip is in programming mode.
-	 */
 	cflag = icache_status ();
 	icache_disable ();
 	iflag = disable_interrupts ();
 
-	MEM_FLASH_ADDR1 = CMD_UNLOCK1;
-	MEM_FLASH_ADDR2 = CMD_UNLOCK2;
-	MEM_FLASH_ADDR1 = CMD_UNLOCK_BYPASS;
-	*addr = CMD_PROGRAM;
-	*addr = data;
-
-	/* arm simple, non interrupt dependent timer */
-	reset_timer_masked ();
-
-	/* wait until flash is ready */
-	chip = 0;
-	do {
-		result = *addr;
-
-		/* check timeout */
-		if (get_timer_masked () > CONFIG_SYS_FLASH_ERASE_TOUT) {
-			chip = ERR | TMO;
-			break;
-		}
-		if (!chip && ((result & 0x80) == (data & 0x80)))
-			chip = READY;
-
-		if (!chip && ((result & 0xFFFF) & BIT_PROGRAM_ERROR)) {
-			result = *addr;
-
-			if ((result & 0x80) == (data & 0x80))
-				chip = READY;
-			else
-				chip = ERR;
+	while (words && rc == ERR_OK) {
+		if (chip->buffer_size > 1) {
+			/* up to the end of the buffer page */
+			page = chip->buffer_size * 2;
+			n = (page - (dest & (page - 1))) / 2;
+			if (n > words)
+				n = words;
+			rc = flash_write_buffer (info, chip, dest, src, n);
+		} else {
+			if (!bypass && (chip->flags & FLASH_BYPASS)) {
+				*chip->addr1 = CMD_UNLOCK1;
+				*chip->addr2 = CMD_UNLOCK2;
+				*chip->addr1 = CMD_UNLOCK_BYPASS;
+				bypass = 1;
+			}
+			n = 1;
+			data = src[0] | (src[1] << 8);
+			addr = (vu_short *) dest;
+			if (bypass) {
+				*addr = CMD_PROGRAM;
+			} else {
+				/* SST parts want A0h at 5555h too */
+				*chip->addr1 = CMD_UNLOCK1;
+				*chip->addr2 = CMD_UNLOCK2;
+				*chip->addr1 = CMD_PROGRAM;
+			}
+			*addr = data;
+			rc = flash_poll (addr, data, chip->word_tout,
+					 chip->flags & FLASH_DQ5 ?
+					 FLASH_POLL_DQ5 : 0);
 		}
 
-	} while (!chip);
+		/* back to array data once done, in or out of bypass */
+		for (i = 0, addr = (vu_short *) dest;
+		     rc == ERR_OK && i < n; i++, addr++)
+			if (*addr != (src[2 * i] | (src[2 * i + 1] << 8)))
+				rc = ERR_PROG_ERROR;
 
-	*addr = CMD_READ_ARRAY;
+		dest += n * 2;
+		src += n * 2;
+		words -= n;
+	}
 
-	if (chip == ERR || *addr != data)
-		rc = ERR_PROG_ERROR;
+	if (bypass) {
+		*chip->addr1 = CMD_BYPASS_RESET1;
+		*chip->addr1 = CMD_BYPASS_RESET2;
+	}
+	*chip->addr1 = CMD_READ_ARRAY;
 
 	if (iflag)
 		enable_interrupts ();
@@ -370,47 +702,39 @@ static int write_hword (flash_info_t * info, ulong dest, ushort data)
 
 int write_buff (flash_info_t * info, uchar * src, ulong addr, ulong cnt)
 {
-	ulong cp, wp;
-	int l;
-	int i, rc;
-	ushort data;
+	ulong wp;
+	int rc;
+	uchar buf[2];
+
+	if (cnt == 0)
+		return ERR_OK;
 
 	wp = (addr & ~1);	/* get lower word aligned address */
 
 	/*
 	 * handle unaligned start bytes
 	 */
-	if ((l = addr - wp) != 0) {
-		data = 0;
-		for (i = 0, cp = wp; i < l; ++i, ++cp) {
-			data = (data >> 8) | (*(uchar *) cp << 8);
-		}
-		for (; i < 2 && cnt > 0; ++i) {
-			data = (data >> 8) | (*src++ << 8);
-			--cnt;
-			++cp;
-		}
-		for (; cnt == 0 && i < 2; ++i, ++cp) {
-			data = (data >> 8) | (*(uchar *) cp << 8);
-		}
+	if (addr != wp) {
+		buf[0] = *(uchar *) wp;
+		buf[1] = *src++;
+		--cnt;
 
-		if ((rc = write_hword (info, wp, data)) != 0) {
+		if ((rc = flash_program (info, wp, buf, 1)) != 0) {
 			return (rc);
 		}
 		wp += 2;
 	}
 
 	/*
-	 * handle word aligned part
+	 * handle word aligned part, in one go
 	 */
-	while (cnt >= 2) {
-		data = *((vu_short *) src);
-		if ((rc = write_hword (info, wp, data)) != 0) {
+	if (cnt >= 2) {
+		if ((rc = flash_program (info, wp, src, cnt / 2)) != 0) {
 			return (rc);
 		}
-		src += 2;
-		wp += 2;
-		cnt -= 2;
+		src += cnt & ~1;
+		wp += cnt & ~1;
+		cnt &= 1;
 	}
 
 	if (cnt == 0) {
@@ -420,14 +744,8 @@ int write_buff (flash_info_t * info, uchar * src, ulong addr, ulong cnt)
 	/*
 	 * handle unaligned tail bytes
 	 */
-	data = 0;
-	for (i = 0, cp = wp; i < 2 && cnt > 0; ++i, ++cp) {
-		data = (data >> 8) | (*src++ << 8);
-		--cnt;
-	}
-	for (; i < 2; ++i, ++cp) {
-		data = (data >> 8) | (*(uchar *) cp << 8);
-	}
+	buf[0] = *src;
+	buf[1] = *(uchar *) (wp + 1);
 
-	return write_hword (info, wp, data);
+	return flash_program (info, wp, buf, 1);
 }
@@ -64,6 +64,21 @@ extern int s3c2410_udc_probe(struct s3c2410_plat_udc_data *pdata);
 extern int usb_eth_initialize(bd_t *bi);
 #endif
 
+#ifdef CONFIG_S3C2440_NAND_BOOT
+/* timer 4 ticks of the stage 1 copy, at PCLK / 256 / 16 */
+extern unsigned long nand_boot_ticks;
+extern int nand_boot_ret;
+
+/* microseconds the stage 1 copy took, or 0 if it didn't run */
+static unsigned long nand_boot_time(void)
+{
+	if (nand_boot_ticks == ~0UL)
+		return 0;
+
+	return nand_boot_ticks * (256 * 16) / (get_PCLK() / 1000000);
+}
+#endif
+
 static inline void delay (unsigned long loops)
 {
 	__asm__ volatile ("1:\n"
@@ -174,6 +189,27 @@ int dram_init (void)
 	return 0;
 }
 
+#ifdef CONFIG_DISPLAY_BOARDINFO
+int checkboard(void)
+{
+#ifdef CONFIG_S3C2440_NAND_BOOT
+	unsigned long us = nand_boot_time();
+#endif
+
+	puts("Board: MINI2440\n");
+#ifdef CONFIG_S3C2440_NAND_BOOT
+	if (us)
+		printf("       loaded from NAND in %lu.%03lu ms\n",
+				us / 1000, us % 1000);
+	if (us && nand_boot_ret == -2)
+		puts("Warning: the U-Boot image in NAND fails its checksum, "
+		     "flash it again\n");
+#endif
+
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_CMD_NET
 int board_eth_init(bd_t *bis)
 {
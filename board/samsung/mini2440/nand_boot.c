@@ -0,0 +1,311 @@
+/*
+ * Boot the kernel from NAND, reading only as much as its image header
+ * says, and reading it ahead during the autoboot countdown.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+#include <common.h>
+#include <command.h>
+#include <image.h>
+#include <nand.h>
+
+#ifdef CONFIG_NAND_STATS
+extern int nand_stats_sync(void);
+#endif
+
+#ifndef CONFIG_NAND_BOOT_OFFSET
+#define CONFIG_NAND_BOOT_OFFSET	0x80000
+#endif
+#ifndef CONFIG_NAND_BOOT_SIZE
+#define CONFIG_NAND_BOOT_SIZE	0x300000
+#endif
+
+/* Android boot image header, as written by "fastboot flash boot" */
+#define ANDR_BOOT_MAGIC		"ANDROID!"
+#define ANDR_BOOT_MAGIC_SIZE	8
+
+struct andr_boot_hdr {
+	u8	magic[ANDR_BOOT_MAGIC_SIZE];
+	u32	kernel_size;
+	u32	kernel_addr;
+	u32	ramdisk_size;
+	u32	ramdisk_addr;
+	u32	second_size;
+	u32	second_addr;
+	u32	tags_addr;
+	u32	page_size;
+};
+
+/*
+ * Length of the image whose first bytes are at hdr, or 0 if it isn't
+ * a uImage or an Android boot image.  *kernel is set to the offset of
+ * what bootm should be given.
+ */
+static size_t nand_boot_image_size(const void *hdr, ulong *kernel)
+{
+	const struct andr_boot_hdr *andr = hdr;
+	size_t page, len;
+
+	*kernel = 0;
+
+	if (image_check_magic((const image_header_t *)hdr))
+		return image_get_image_size((const image_header_t *)hdr);
+
+	if (!memcmp(andr->magic, ANDR_BOOT_MAGIC, ANDR_BOOT_MAGIC_SIZE)) {
+		page = andr->page_size;
+		if (!page || (page & (page - 1)))
+			return 0;
+		len = page;
+		len += (andr->kernel_size + page - 1) & ~(page - 1);
+		len += (andr->ramdisk_size + page - 1) & ~(page - 1);
+		len += (andr->second_size + page - 1) & ~(page - 1);
+		/* the kernel is a uImage right after the header page */
+		*kernel = page;
+		return len;
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_NAND_READAHEAD
+/*
+ * The autoboot countdown, abortboot() in common/main.c, calls
+ * nand_readahead_poll() each time round its 10 ms console poll, next
+ * to the udelay(10000).  It is called from there only: hooked into
+ * udelay() it would also run inside any caller that waits 10 ms, in
+ * the middle of a NAND operation for example.  Each poll reads a few
+ * pages of the boot partition into the load address, so most of the
+ * kernel is in RAM by the time bootcmd runs "nandboot", which then
+ * reads only the rest.  Once the first chunk is in, the image header
+ * cuts the read down to the image.
+ *
+ * Read-ahead only starts when bootcmd is "nandboot", so nothing else
+ * gets to use the load address first.  It stops for good as soon as a
+ * key is pending, and its data is only trusted until shortly after the
+ * countdown ends: a user who stopped autoboot may have loaded something
+ * else there since.
+ */
+
+/* pages per poll, a few ms of the 10 ms poll period */
+#define NAND_READAHEAD_PAGES	8
+
+static struct nand_readahead {
+	ulong		addr;		/* load address */
+	loff_t		start;		/* partition offset */
+	loff_t		off;		/* next offset, bad blocks skipped */
+	size_t		max;		/* partition size */
+	size_t		size;		/* image size, once known */
+	size_t		done;		/* bytes in RAM */
+	ulong		deadline;	/* get_timer() value */
+	int		active;		/* still reading */
+	int		valid;		/* done bytes are usable */
+	int		busy;
+} ra;
+
+/* read the next chunk, never across a block boundary */
+static int nand_readahead_step(nand_info_t *nand)
+{
+	size_t len;
+	int ret;
+
+	if (!(ra.off & (nand->erasesize - 1))) {
+		while (nand_block_isbad(nand, ra.off)) {
+			ra.off += nand->erasesize;
+			if (ra.off >= nand->size)
+				return -EIO;
+		}
+	}
+
+	len = NAND_READAHEAD_PAGES * nand->writesize;
+	if (len > ra.size - ra.done)
+		len = ra.size - ra.done;
+	if (len > nand->erasesize - (ra.off & (nand->erasesize - 1)))
+		len = nand->erasesize - (ra.off & (nand->erasesize - 1));
+
+	ret = nand_read(nand, ra.off, &len, (u_char *)ra.addr + ra.done);
+	if (ret && ret != -EUCLEAN)
+		return ret;
+
+	if (!ra.done) {
+		ulong kernel;
+		size_t size = nand_boot_image_size((void *)ra.addr, &kernel);
+
+		if (size && size < ra.size)
+			ra.size = size;
+		if (len > ra.size)
+			len = ra.size;
+	}
+
+	ra.off += len;
+	ra.done += len;
+	if (ra.done == ra.size)
+		ra.active = 0;
+
+	return 0;
+}
+
+void nand_readahead_start(void)
+{
+	char *s;
+	int bootdelay;
+
+	s = getenv("bootcmd");
+	if (!s || strncmp(s, "nandboot", 8) || !nand_info[0].name)
+		return;
+
+	s = getenv("bootdelay");
+	bootdelay = s ? (int)simple_strtol(s, NULL, 10) : CONFIG_BOOTDELAY;
+	if (bootdelay <= 0)
+		return;
+
+	ra.addr = CONFIG_SYS_LOAD_ADDR;
+	ra.start = ra.off = CONFIG_NAND_BOOT_OFFSET;
+	ra.max = ra.size = CONFIG_NAND_BOOT_SIZE;
+	ra.done = 0;
+	/* the rest of init and a second of slack */
+	ra.deadline = get_timer(0) + (bootdelay + 2) * CONFIG_SYS_HZ;
+	ra.active = ra.valid = 1;
+}
+
+void nand_readahead_poll(void)
+{
+	if (!ra.active || ra.busy)
+		return;
+
+	if (tstc() || get_timer(0) > ra.deadline) {
+		ra.active = 0;
+		ra.valid = 0;
+		return;
+	}
+
+	ra.busy = 1;
+	if (nand_readahead_step(&nand_info[0])) {
+		ra.active = 0;
+		ra.valid = 0;
+	}
+	ra.busy = 0;
+}
+
+/*
+ * Reads what the read-ahead left of this request and returns how many
+ * bytes it had already loaded, or 0 if it has nothing usable for it.
+ */
+static size_t nand_readahead_finish(nand_info_t *nand, ulong addr,
+		loff_t off, size_t size)
+{
+	size_t ahead = ra.done;
+
+	if (!ra.valid || get_timer(0) > ra.deadline ||
+	    ra.addr != addr || ra.start != off || ra.max != size) {
+		ra.active = ra.valid = 0;
+		return 0;
+	}
+
+	ra.active = ra.done < ra.size;	/* may be 0 bytes */
+	while (ra.active) {
+		if (nand_readahead_step(nand)) {
+			ra.active = ra.valid = 0;
+			return 0;	/* start over from the beginning */
+		}
+	}
+	ra.valid = 0;
+
+	return ahead;
+}
+#endif	/* CONFIG_NAND_READAHEAD */
+
+int do_nandboot(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	nand_info_t *nand = &nand_info[0];
+	ulong addr = CONFIG_SYS_LOAD_ADDR;
+	loff_t off = CONFIG_NAND_BOOT_OFFSET;
+	size_t size = CONFIG_NAND_BOOT_SIZE;
+	size_t ahead = 0, len;
+	ulong start, ms, kernel;
+	char buf[12];
+	char *bootm_argv[] = { "bootm", buf, NULL };
+	int ret;
+
+	if (argc > 1)
+		addr = simple_strtoul(argv[1], NULL, 16);
+	if (argc > 2)
+		off = simple_strtoul(argv[2], NULL, 16);
+	if (argc > 3)
+		size = simple_strtoul(argv[3], NULL, 16);
+
+	if (!nand->name) {
+		puts("no NAND device\n");
+		return 1;
+	}
+
+	start = get_timer(0);
+
+#ifdef CONFIG_NAND_READAHEAD
+	ahead = nand_readahead_finish(nand, addr, off, size);
+#endif
+	if (!ahead) {
+		/* the header first, then exactly the image it describes */
+		len = nand->writesize;
+		ret = nand_read_skip_bad(nand, off, &len, (u_char *)addr);
+		if (ret && ret != -EUCLEAN) {
+			printf("NAND boot: read error %d\n", ret);
+			return 1;
+		}
+
+		len = nand_boot_image_size((void *)addr, &kernel);
+		if (!len || len > size) {
+			printf("NAND boot: no image header, reading 0x%x\n",
+					size);
+			len = size;
+		}
+
+		/* from the start again, so bad blocks are skipped alike */
+		ret = nand_read_skip_bad(nand, off, &len, (u_char *)addr);
+		if (ret && ret != -EUCLEAN) {
+			printf("NAND boot: read error %d\n", ret);
+			return 1;
+		}
+	} else {
+		len = nand_boot_image_size((void *)addr, &kernel) ? : size;
+		if (len > size)
+			len = size;
+	}
+
+	ms = get_timer(start);
+	printf("NAND boot: %u bytes from 0x%llx in %lu ms",
+			len, (unsigned long long)off, ms);
+	if (ahead)
+		printf(", %u read ahead", ahead < len ? ahead : len);
+	putc('\n');
+
+#ifdef CONFIG_NAND_STATS
+	/* before the kernel owns the NAND */
+	nand_stats_sync();
+#endif
+
+	load_addr = addr + kernel;
+	sprintf(buf, "%lx", load_addr);
+	return do_bootm(cmdtp, 0, 2, bootm_argv);
+}
+
+U_BOOT_CMD(nandboot, 4, 0, do_nandboot,
+	"load a kernel from NAND and bootm it",
+	"[addr [off [size]]]\n"
+	"    - read the uImage or Android boot image at NAND offset off\n"
+	"      to addr, skipping bad blocks, and boot it.  Only the length\n"
+	"      given in its header is read, at most size bytes.  Whatever\n"
+	"      the autoboot read-ahead already loaded is not read again.");
@@ -25,8 +25,11 @@
 #include <common.h>
 #include <asm/arch/s3c24x0_cpu.h>
 
+/* tools/nandsim supplies its own, to run this file on the host */
+#ifndef __REGb
 #define __REGb(x)	(*(volatile unsigned char *)(x))
 #define __REGi(x)	(*(volatile unsigned int *)(x))
+#endif
 #define NF_BASE		0x4e000000
 
 #if defined(CONFIG_S3C2440)
@@ -35,12 +38,52 @@
 #define NFCMD		__REGb(NF_BASE + 0x8)
 #define NFADDR		__REGb(NF_BASE + 0xc)
 #define NFDATA		__REGb(NF_BASE + 0x10)
+#define NFDATA32	__REGi(NF_BASE + 0x10)
 #define NFSTAT		__REGb(NF_BASE + 0x20)
 
 #define NAND_CHIP_ENA	(NFCONT &= ~(1<<1))
-#define NAND_CHIP_DIS	(NFCONT |= ~(1<<1))
+#define NAND_CHIP_DIS	(NFCONT |= (1<<1))
 #define NAND_CLEAR_RB	(NFSTAT |= (1<<2))
-#define NAND_DETECT_RB	{ while (!(NFSTAT & (1<<2))); }
+
+#define NAND_CMD_READ0		0x00
+#define NAND_CMD_READOOB	0x50
+#define NAND_CMD_READID		0x90
+#define NAND_CMD_READSTART	0x30
+
+/* polls of NFSTAT, some ms at 405 MHz against a 25-50 us tR */
+#define NAND_RB_TIMEOUT		0x100000
+
+/* bad block marker: first spare byte on large pages, sixth on small */
+#define NAND_LARGE_BADBLOCK_POS	0
+#define NAND_SMALL_BADBLOCK_POS	5
+
+/* all that 3 row address cycles reach, should every block read bad */
+#define NAND_MAX_PAGES		(1 << 24)
+
+/* in start.S */
+extern char _start[];
+extern unsigned int _nand_image_len;
+
+/*
+ * Stage 1 runs from the 4K Steppingstone, where get_HCLK() and the
+ * division routines aren't loaded yet, so the board's default timings
+ * are converted to cycles at build time, for the 136 MHz HCLK limit of
+ * the S3C2440.  That errs on the slow side at any actual clock.
+ */
+#define NAND_LL_HCLK_MHZ	136
+#define NAND_LL_CYCLES(ns)	(((ns) * NAND_LL_HCLK_MHZ + 999) / 1000)
+#define NAND_LL_MIN1(c)		((c) ? (c) : 1)
+
+#define NAND_LL_TACLS	NAND_LL_CYCLES(CONFIG_SYS_NAND_TACLS)
+#define NAND_LL_TWRPH0	NAND_LL_MIN1(NAND_LL_CYCLES(CONFIG_SYS_NAND_TWRPH0))
+#define NAND_LL_TWRPH1	NAND_LL_MIN1(NAND_LL_CYCLES(CONFIG_SYS_NAND_TWRPH1))
+
+#if NAND_LL_TACLS > 3 || NAND_LL_TWRPH0 > 8 || NAND_LL_TWRPH1 > 8
+#error "NAND timings too slow for NFCONF"
+#endif
+
+#define NAND_LL_NFCONF	((NAND_LL_TACLS << 12) | ((NAND_LL_TWRPH0 - 1) << 8) \
+			 | ((NAND_LL_TWRPH1 - 1) << 4))
 
 #define BUSY 4
 inline void wait_idle(void)
@@ -56,57 +99,205 @@ void nand_ll_init(void)
 	int i;
 
 	NFCONT = (1<<0);
-	NFCONF = ((1<<12) | (0<<8) | (3<<4) | (1<<0));
+	NFCONF = NAND_LL_NFCONF;
 
 	for (i = 0; i < 10; i++);
 	NFCMD = 0xFF;	//reset command
 	wait_idle();
 }
 
-static void s3c2440_write_addr_page_2k(unsigned addr, unsigned mask, unsigned page_size)
+/*
+ * The copy is timed with PWM timer 4, which timer_init() takes over
+ * later: PCLK / 256 / 16 counts about 4 s before the 16-bit counter
+ * wraps.  The result goes to .data at its link address once the copy
+ * is complete, since the copy itself overwrites that memory.  It stays
+ * ~0 when U-Boot didn't come from NAND.  nand_boot_time() in mini2440.c
+ * converts it, because the division would call into libgcc, outside
+ * the Steppingstone.
+ */
+unsigned long nand_boot_ticks = ~0UL;
+
+/* what nand_read_ll() returned, stored the same way */
+int nand_boot_ret = 1;
+
+static void boot_timer_start(void)
+{
+	struct s3c24x0_timers * const timers = s3c24x0_get_base_timers();
+
+	timers->TCFG0 = (timers->TCFG0 & ~0xff00) | (0xff << 8);
+	timers->TCFG1 = (timers->TCFG1 & ~0xf0000) | (3 << 16);	/* 1/16 */
+	timers->TCNTB4 = 0xffff;
+	/* manual update, then start one-shot */
+	timers->TCON = (timers->TCON & ~0x0700000) | 0x0200000;
+	timers->TCON = (timers->TCON & ~0x0700000) | 0x0100000;
+}
+
+static unsigned long boot_timer_stop(void)
+{
+	struct s3c24x0_timers * const timers = s3c24x0_get_base_timers();
+	unsigned long ticks = 0xffff - (timers->TCNTO4 & 0xffff);
+
+	/* leave timer 4 as reset for timer_init(), which assumes 1/2 */
+	timers->TCON &= ~0x0700000;
+	timers->TCFG1 &= ~0xf0000;
+
+	return ticks;
+}
+
+static int nand_wait_rb(void)
+{
+	int i;
+
+	for (i = 0; i < NAND_RB_TIMEOUT; i++)
+		if (NFSTAT & (1<<2))
+			return 0;
+
+	return -1;
+}
+
+/* 2 column cycles on large pages, 1 on small ones, then 3 row cycles */
+static void nand_write_addr(unsigned col, unsigned page, unsigned page_size)
+{
+	NFADDR = col & 0xff;
+	if (page_size > 512)
+		NFADDR = (col >> 8) & 0x0f;
+	NFADDR = page & 0xff;
+	NFADDR = (page >> 8) & 0xff;
+	NFADDR = (page >> 16) & 0xff;
+}
+
+/* large page chips encode the block size in the 4th ID byte */
+static unsigned nand_block_pages(unsigned page_size, unsigned page_shift)
+{
+	unsigned char id4;
+	int i;
+
+	if (page_size <= 512)
+		return page_size == 512 ? 32 : 16;
+
+	NFCMD = NAND_CMD_READID;
+	NFADDR = 0;
+	for (i = 0; i < 10; i++);
+	for (i = 0; i < 4; i++)
+		id4 = NFDATA;
+
+	return ((64 * 1024) << ((id4 >> 4) & 3)) >> page_shift;
+}
+
+/* 1 if the block starting at page is marked bad, -1 on timeout */
+static int nand_block_bad(unsigned page, unsigned page_size)
 {
-	int col, page;
+	NAND_CLEAR_RB;
+	if (page_size > 512) {
+		NFCMD = NAND_CMD_READ0;
+		nand_write_addr(page_size + NAND_LARGE_BADBLOCK_POS, page,
+				page_size);
+		NFCMD = NAND_CMD_READSTART;
+	} else {
+		NFCMD = NAND_CMD_READOOB;
+		nand_write_addr(NAND_SMALL_BADBLOCK_POS, page, page_size);
+	}
+
+	if (nand_wait_rb())
+		return -1;
 
-	col = addr & mask;
-	page = addr / page_size;
+	return NFDATA != 0xff;
+}
 
-	NFADDR = col & 0xff;		/* Column Address A0~A7 */
-	NFADDR = (col >> 8) & 0x0f;	/* Column Address A8~A11 */
-	NFADDR = page & 0xff;		/* Row Address A12~A19 */
-	NFADDR = (page >> 8) & 0xff;	/* Row Address A20~A27 */
-	NFADDR = (page >> 16) & 0x01;	/* Row Address A28 */
+/*
+ * NFDATA also takes word reads, each one four bus cycles lowest byte
+ * first, so a page is moved with page_size / 4 loads, unrolled by four.
+ * Every page size is a multiple of 16 and buf is word aligned.  The
+ * words are summed into *sum on their way through the registers, which
+ * costs nothing next to the bus cycles.
+ */
+static int nand_read_page(unsigned int *buf, unsigned page,
+		unsigned page_size, unsigned int *sum)
+{
+	unsigned int w0, w1, w2, w3, s = 0;
+	int i;
+
+	NAND_CLEAR_RB;
+	NFCMD = NAND_CMD_READ0;
+	nand_write_addr(0, page, page_size);
+	if (page_size > 512)
+		NFCMD = NAND_CMD_READSTART;
+
+	if (nand_wait_rb())
+		return -1;
+
+	for (i = page_size / 16; i > 0; i--, buf += 4) {
+		w0 = NFDATA32;
+		w1 = NFDATA32;
+		w2 = NFDATA32;
+		w3 = NFDATA32;
+		buf[0] = w0;
+		buf[1] = w1;
+		buf[2] = w2;
+		buf[3] = w3;
+		s += w0 + w1 + w2 + w3;
+	}
+	*sum = s;
+
+	return 0;
 }
 
-static void s3c2440_write_addr_page_512(unsigned int addr)
+static unsigned int nand_sum_words(const unsigned int *buf, unsigned len)
 {
-	/* Write Address */
-	NFADDR = addr & 0xff;
-	NFADDR = (addr >> 9) & 0xff;
-	NFADDR = (addr >> 17) & 0xff;
-	NFADDR = (addr >> 25) & 0xff;
+	unsigned int s = 0;
+
+	for (; len >= 4; len -= 4)
+		s += *buf++;
+
+	return s;
 }
 
-/* low level nand read function */
+/*
+ * low level nand read function
+ *
+ * Copies size bytes from start_addr on, skipping blocks whose first
+ * page carries a bad block marker, the same way "nand write" lays an
+ * image out.  Runs from the Steppingstone before .bss exists, so it
+ * must not touch any variable until the copy is done.
+ *
+ * The copy must be a U-Boot image.  Its length, patched into the
+ * _nand_image_len word of start.S by tools/ubsum, is picked up from
+ * the first page, and the words up to that length must sum to zero.
+ * The offset of that word is taken from the running image, so a
+ * recovery copy has to come from the same configuration.
+ *
+ * Returns 0 if the sum matched, 1 for an image that was never summed,
+ * -1 on a read error and -2 on a bad sum.
+ */
 int nand_read_ll(unsigned char *buf, unsigned long start_addr, int size)
 {
-	int i, j;
+	unsigned char *image = buf;
+	unsigned int sum = 0, page_sum;
+	unsigned long len = 0, done = 0;
+	int i, ret = -1;
 	struct s3c24x0_gpio * const gpio = s3c24x0_get_base_gpio();
 
 	unsigned char ncon = (gpio->GSTATUS0 & 0x4) >> 2;
 	unsigned char gpg13 = (gpio->GPGDAT & 0x2000) >> 13;
-	unsigned page_size;
+	unsigned page_size, page_shift, block_pages, page;
 	unsigned nand_block_mask;
 
+	/*
+	 * NCON selects the address cycles, GPG13 the page size.  Pages are
+	 * counted with page_shift: a division would call __udivsi3, which
+	 * is in libgcc, outside the Steppingstone.
+	 */
 	if (ncon == 1)
 		if (gpg13 == 1)
-			page_size = 2048;
+			page_shift = 11;
 		else
-			page_size = 1024;
+			page_shift = 10;
 	else
 		if (gpg13 == 1)
-			page_size = 512;
+			page_shift = 9;
 		else
-			page_size = 256;
+			page_shift = 8;
+	page_size = 1 << page_shift;
 
 	nand_block_mask = page_size - 1;
 
@@ -114,39 +305,62 @@ int nand_read_ll(unsigned char *buf, unsigned long start_addr, int size)
 		return -1;	/* invalid alignment */
 	}
 
-	NFCONF = (3 << 8);
+	boot_timer_start();
+
 	/* chip Enable */
-	NFCONT &= ~(1<<1);
+	NAND_CHIP_ENA;
 	for (i = 0; i < 10; i++);
 
-	for (i = start_addr; i < (start_addr + size);) {
-		/* READ0 */
-		NFSTAT |= (1<<2);
-		NFCMD = 0;
-
-		if (page_size == 2048) {
-			s3c2440_write_addr_page_2k(i, nand_block_mask, page_size);
-			NFCMD = 0x30;
-		} else if (page_size == 1024) {
-			/* TODO */
-		} else if (page_size == 512) {
-			s3c2440_write_addr_page_512(i);
-		} else if (page_size == 256) {
-			/* TODO */
-		}
+	block_pages = nand_block_pages(page_size, page_shift);
+
+	for (page = start_addr >> page_shift; size > 0; page++) {
+		if (page >= NAND_MAX_PAGES)
+			goto out;
 
-		//wait_idle();
-		NAND_DETECT_RB;
+		if ((page & (block_pages - 1)) == 0) {
+			int bad = nand_block_bad(page, page_size);
 
-		for(j = 0; j < page_size; j++, i++) {
-			*buf = (NFDATA & 0xff);
-			buf++;
+			if (bad < 0)
+				goto out;
+			if (bad) {
+				page += block_pages - 1;
+				continue;
+			}
 		}
+
+		if (nand_read_page((unsigned int *)buf, page, page_size,
+				   &page_sum))
+			goto out;
+
+		if (done == 0)
+			len = *(unsigned int *)(image +
+				((char *)&_nand_image_len - _start));
+
+		/* only the page holding the end of the image is summed again */
+		if (done + page_size <= len)
+			sum += page_sum;
+		else if (done < len)
+			sum += nand_sum_words((unsigned int *)buf, len - done);
+
+		buf += page_size;
+		size -= page_size;
+		done += page_size;
 	}
 
+	if (len == 0)
+		ret = 1;
+	else if (len > done || sum != 0)
+		ret = -2;
+	else
+		ret = 0;
+
+out:
 	/* chip Disable */
-	NFCONT |= (1 << 1);	/* chip disable */
+	NAND_CHIP_DIS;
 
-	return 0;
+	nand_boot_ticks = boot_timer_stop();
+	nand_boot_ret = ret;
+
+	return ret;
 }
 #endif	/* CONFIG_S3C2440 */
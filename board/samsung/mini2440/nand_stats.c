@@ -0,0 +1,633 @@
+/*
+ * Per-block NAND erase counts and corrected reads, kept in their own
+ * partition, and scrubbing of blocks that keep needing ECC correction.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc.h>
+#include <nand.h>
+#include <jffs2/load_kernel.h>
+
+/*
+ * The driver (drivers/mtd/nand/s3c2410_nand.c) reports every block
+ * erase and every page read that needed ECC correction, whoever
+ * issued it.  Counts are kept in RAM and written out by
+ * nand_stats_sync(), which fastboot calls after erasing or flashing
+ * and nandboot before it boots.  That is also when blocks that reached
+ * CONFIG_NAND_SCRUB_THRESHOLD corrected reads since their last erase
+ * are scrubbed: read with correction, erased and written back.  The
+ * 1-bit ECC can't fix a second flipped bit in the same 512 bytes, so
+ * the default threshold is the first correction.
+ *
+ * Only blocks of the partitions named in CONFIG_NAND_SCRUB_PARTS are
+ * scrubbed: the rewrite keeps the data but not the spare area, which
+ * only raw images such as kernels can do without.  Other blocks are
+ * only flagged in "nandstats".  A scrub first copies the block to the
+ * scrub block and records that in a saved copy of the counts, so that
+ * nand_stats_init() can finish the rewrite after a power cut.
+ *
+ * The counts go to one of two slots, alternately, so a power cut while
+ * saving loses only the latest changes.  The slots and the scrub block
+ * are the first three blocks of the "nandstats" partition if mtdparts
+ * has one.  Otherwise they are the three blocks below the bad block
+ * table, taken from the end of the last partition like the table
+ * itself.  If they would overlap anything else, the counts are neither
+ * loaded nor saved and nothing is scrubbed: the blocks would belong to
+ * something else.
+ */
+
+#ifndef CONFIG_NAND_SCRUB_THRESHOLD
+#define CONFIG_NAND_SCRUB_THRESHOLD	1
+#endif
+#ifndef CONFIG_NAND_SCRUB_PARTS		/* nothing is scrubbed */
+#define CONFIG_NAND_SCRUB_PARTS		""
+#endif
+
+#define NAND_STATS_MAGIC	0x4154534e	/* "NSTA" */
+#define NAND_STATS_SLOTS	2
+#define NAND_STATS_BLOCKS	(NAND_STATS_SLOTS + 1)	/* and the scrub block */
+#define NAND_STATS_BBT_BLOCKS	4		/* nand_bbt's maxblocks */
+#define NAND_STATS_NO_SCRUB	0xffffffff
+#define NAND_STATS_PART		"nandstats"
+
+#define NAND_STATS_SCRUB	(1 << 0)	/* reached the threshold */
+
+struct nand_stats_hdr {
+	u32	magic;
+	u32	seq;		/* the slot with the higher one is current */
+	u32	blocks;
+	u32	scrub;		/* block copied to the scrub block, or ~0 */
+	u32	scrub_crc;	/* crc32 of that copy */
+	u32	crc;		/* crc32 of the entries */
+};
+
+/* one per block, four bytes */
+struct nand_stats_entry {
+	u16	erases;		/* saturates */
+	u8	corrected;	/* corrected reads since the last erase */
+	u8	flags;
+};
+
+static struct {
+	nand_info_t		*nand;
+	struct nand_stats_entry	*e;
+	u32			blocks;
+	int			pages;		/* per block */
+	u32			slot;		/* block of slot 0 */
+	u32			seq;
+	u32			scrub;		/* as in the header */
+	u32			scrub_crc;
+	int			dirty;
+	int			busy;		/* in nand_stats_sync() */
+} ns;
+
+static u32 nand_stats_slot_block(int slot)
+{
+	return ns.slot + slot;
+}
+
+static u32 nand_stats_scrub_block(void)
+{
+	return ns.slot + NAND_STATS_SLOTS;
+}
+
+/* nand0 as mtdparts has it, NULL if it has no partitions */
+static struct mtd_device *nand_stats_dev(void)
+{
+	struct mtd_device *dev;
+	struct part_info *part;
+	u8 pnum;
+
+	if (mtdparts_init() || find_dev_and_part("nand0,0", &dev, &pnum, &part))
+		return NULL;
+	return dev;
+}
+
+/* the partition of dev named by the len characters at name, or NULL */
+static struct part_info *nand_stats_part(struct mtd_device *dev,
+		const char *name, size_t len)
+{
+	struct list_head *entry;
+	struct part_info *p;
+
+	list_for_each(entry, &dev->parts) {
+		p = list_entry(entry, struct part_info, link);
+		if (!strncmp(p->name, name, len) && !p->name[len])
+			return p;
+	}
+	return NULL;
+}
+
+/*
+ * Sets ns.slot from the "nandstats" partition, or else below the bad
+ * block table, as long as only the last partition, the one running to
+ * the end of the chip, overlaps the blocks there.  -1 if neither works.
+ */
+static int nand_stats_find_slots(void)
+{
+	struct mtd_device *dev = nand_stats_dev();
+	struct part_info *part = NULL, *p;
+	struct list_head *entry;
+	u32 erasesize = ns.nand->erasesize;
+	u32 first, start, end;
+
+	if (dev)
+		part = nand_stats_part(dev, NAND_STATS_PART,
+				       strlen(NAND_STATS_PART));
+
+	if (part) {
+		if (part->offset & (erasesize - 1)) {
+			puts("nandstats: partition misaligned\n");
+			return -1;
+		}
+		first = part->offset / erasesize;
+	} else {
+		first = ns.blocks - NAND_STATS_BBT_BLOCKS - NAND_STATS_BLOCKS;
+	}
+	start = first * erasesize;
+	end = start + NAND_STATS_BLOCKS * erasesize;
+	if ((part && end > part->offset + part->size) ||
+	    first + NAND_STATS_BLOCKS > ns.blocks - NAND_STATS_BBT_BLOCKS) {
+		puts("nandstats: partition too small or misplaced\n");
+		return -1;
+	}
+
+	/* with no "nandstats", only the last partition may hold them */
+	if (dev) {
+		list_for_each(entry, &dev->parts) {
+			p = list_entry(entry, struct part_info, link);
+			if (p == part || p->offset >= end ||
+			    p->offset + p->size <= start)
+				continue;
+			if (part || p->offset + p->size <
+				    ns.blocks * erasesize) {
+				printf("nandstats: blocks %u-%u overlap '%s'\n",
+				       first, first + NAND_STATS_BLOCKS - 1,
+				       p->name);
+				return -1;
+			}
+		}
+	}
+
+	ns.slot = first;
+	return 0;
+}
+
+static loff_t nand_stats_block_off(u32 block)
+{
+	return (loff_t)block * ns.nand->erasesize;
+}
+
+/* header and entries, in whole pages */
+static size_t nand_stats_len(void)
+{
+	size_t len = sizeof(struct nand_stats_hdr) +
+		ns.blocks * sizeof(struct nand_stats_entry);
+
+	return (len + ns.nand->writesize - 1) & ~(ns.nand->writesize - 1);
+}
+
+/* called by the driver on each block erase */
+void nand_stats_erase(struct mtd_info *mtd, int page)
+{
+	struct nand_stats_entry *e;
+	u32 block = page / ns.pages;
+
+	if (!ns.e || mtd != ns.nand || block >= ns.blocks)
+		return;
+
+	e = &ns.e[block];
+	if (e->erases != 0xffff)
+		e->erases++;
+	e->corrected = 0;
+	e->flags &= ~NAND_STATS_SCRUB;
+	ns.dirty = 1;
+}
+
+/* called by the driver for each page read that ECC had to correct */
+void nand_stats_corrected(struct mtd_info *mtd, int page)
+{
+	struct nand_stats_entry *e;
+	u32 block = page / ns.pages;
+
+	if (!ns.e || mtd != ns.nand || block >= ns.blocks)
+		return;
+
+	e = &ns.e[block];
+	if (e->corrected != 0xff)
+		e->corrected++;
+	if (e->corrected >= CONFIG_NAND_SCRUB_THRESHOLD)
+		e->flags |= NAND_STATS_SCRUB;
+	ns.dirty = 1;
+}
+
+static int nand_stats_load(int slot, u_char *buf, size_t len)
+{
+	struct nand_stats_hdr *hdr = (struct nand_stats_hdr *)buf;
+	loff_t off = nand_stats_block_off(nand_stats_slot_block(slot));
+	int ret;
+
+	if (nand_block_isbad(ns.nand, off))
+		return -1;
+
+	ret = nand_read(ns.nand, off, &len, buf);
+	if (ret && ret != -EUCLEAN)
+		return -1;
+
+	if (hdr->magic != NAND_STATS_MAGIC || hdr->blocks != ns.blocks ||
+	    hdr->crc != crc32(0, buf + sizeof(*hdr),
+			      ns.blocks * sizeof(struct nand_stats_entry)))
+		return -1;
+
+	return 0;
+}
+
+static int nand_stats_page_erased(const u_char *buf, size_t len)
+{
+	const u32 *p = (const u32 *)buf;
+
+	for (len /= 4; len; len--)
+		if (*p++ != 0xffffffff)
+			return 0;
+	return 1;
+}
+
+/* erases the block at off and writes buf to it, erased pages stay so */
+static int nand_stats_write_block(loff_t off, u_char *buf)
+{
+	size_t page = ns.nand->writesize;
+	size_t len;
+	int ret;
+	u32 i;
+
+	ret = nand_erase(ns.nand, off, ns.nand->erasesize);
+	for (i = 0; !ret && i < ns.nand->erasesize; i += page) {
+		if (nand_stats_page_erased(buf + i, page))
+			continue;
+		len = page;
+		ret = nand_write(ns.nand, off + i, &len, buf + i);
+	}
+	return ret;
+}
+
+/* reads a whole block with correction, -1 if that fails */
+static int nand_stats_read_block(loff_t off, u_char *buf)
+{
+	size_t len = ns.nand->erasesize;
+	int ret;
+
+	ret = nand_read(ns.nand, off, &len, buf);
+	return ret && ret != -EUCLEAN ? -1 : 0;
+}
+
+/*
+ * Finishes a scrub cut short: the block named in the saved counts is
+ * written again from the scrub block unless it already matches it.
+ */
+static void nand_stats_resume(void)
+{
+	u32 block = ns.scrub;
+	loff_t off = nand_stats_block_off(block);
+	u_char *buf;
+
+	ns.scrub = NAND_STATS_NO_SCRUB;
+	ns.dirty = 1;
+	if (block >= ns.blocks)
+		return;
+
+	buf = malloc(ns.nand->erasesize);
+	if (!buf)
+		return;
+
+	if (!nand_stats_read_block(off, buf) &&
+	    crc32(0, buf, ns.nand->erasesize) == ns.scrub_crc)
+		goto out;
+
+	if (nand_stats_read_block(nand_stats_block_off(
+			nand_stats_scrub_block()), buf) ||
+	    crc32(0, buf, ns.nand->erasesize) != ns.scrub_crc) {
+		printf("nandstats: scrub copy of block %u lost\n", block);
+		goto out;
+	}
+
+	if (nand_stats_write_block(off, buf)) {
+		printf("nandstats: block %u failed scrub, marked bad\n", block);
+		ns.nand->block_markbad(ns.nand, off);
+	} else {
+		printf("nandstats: block %u restored from the scrub copy\n",
+		       block);
+	}
+out:
+	free(buf);
+}
+
+void nand_stats_init(void)
+{
+	nand_info_t *nand = &nand_info[0];
+	struct nand_chip *chip = nand->priv;
+	struct nand_stats_hdr *hdr;
+	size_t len;
+	u_char *buf;
+	int slot;
+
+	if (!nand->name)
+		return;
+
+	ns.nand = nand;
+	ns.blocks = nand->size >> chip->phys_erase_shift;
+	ns.pages = nand->erasesize / nand->writesize;
+
+	len = nand_stats_len();
+	buf = malloc(len);
+	ns.e = malloc(ns.blocks * sizeof(struct nand_stats_entry));
+	if (!buf || !ns.e) {
+		free(buf);
+		free(ns.e);
+		ns.e = NULL;
+		puts("nandstats: out of memory\n");
+		return;
+	}
+	memset(ns.e, 0, ns.blocks * sizeof(struct nand_stats_entry));
+	ns.scrub = NAND_STATS_NO_SCRUB;
+
+	/* without slots, counting starts from zero and stays in RAM */
+	if (nand_stats_find_slots())
+		slot = NAND_STATS_SLOTS;
+	else
+		slot = 0;
+
+	hdr = (struct nand_stats_hdr *)buf;
+	for (; slot < NAND_STATS_SLOTS; slot++) {
+		if (nand_stats_load(slot, buf, len))
+			continue;
+		if (ns.seq && (int)(hdr->seq - ns.seq) <= 0)
+			continue;
+		ns.seq = hdr->seq;
+		ns.scrub = hdr->scrub;
+		ns.scrub_crc = hdr->scrub_crc;
+		memcpy(ns.e, buf + sizeof(*hdr),
+		       ns.blocks * sizeof(struct nand_stats_entry));
+	}
+
+	free(buf);
+	ns.dirty = 0;
+
+	if (ns.scrub != NAND_STATS_NO_SCRUB)
+		nand_stats_resume();
+}
+
+/* into the slot not holding the current copy, or the other if it's bad */
+static int nand_stats_save(void)
+{
+	struct nand_stats_hdr *hdr;
+	size_t len = nand_stats_len();
+	loff_t off = 0;
+	u_char *buf;
+	int i, ret = -1;
+
+	/* mtdparts may have changed since */
+	if (nand_stats_find_slots())
+		return -EINVAL;
+
+	buf = malloc(len);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 1; i <= NAND_STATS_SLOTS; i++) {
+		off = nand_stats_block_off(nand_stats_slot_block(
+				(ns.seq + i) % NAND_STATS_SLOTS));
+		if (nand_block_isbad(ns.nand, off))
+			continue;
+		/* counts this erase too, so it is in the copy written */
+		ret = nand_erase(ns.nand, off, ns.nand->erasesize);
+		if (!ret)
+			break;
+	}
+	if (ret) {
+		free(buf);
+		return -EIO;
+	}
+
+	memset(buf, 0xff, len);
+	hdr = (struct nand_stats_hdr *)buf;
+	hdr->magic = NAND_STATS_MAGIC;
+	hdr->seq = ns.seq + 1;
+	hdr->blocks = ns.blocks;
+	hdr->scrub = ns.scrub;
+	hdr->scrub_crc = ns.scrub_crc;
+	memcpy(buf + sizeof(*hdr), ns.e,
+	       ns.blocks * sizeof(struct nand_stats_entry));
+	hdr->crc = crc32(0, buf + sizeof(*hdr),
+			 ns.blocks * sizeof(struct nand_stats_entry));
+
+	ret = nand_write(ns.nand, off, &len, buf);
+	free(buf);
+	if (ret)
+		return ret;
+
+	ns.seq++;
+	ns.dirty = 0;
+	return 0;
+}
+
+/*
+ * Reads the block with correction, copies it to the scrub block and
+ * saves the counts with a note of that, then erases the block and
+ * writes the data back.  A block that fails to erase or program is
+ * marked bad, and whatever lived in it has to be flashed again.
+ */
+static int nand_stats_scrub(u32 block)
+{
+	loff_t off = nand_stats_block_off(block);
+	loff_t copy = nand_stats_block_off(nand_stats_scrub_block());
+	u_char *buf;
+	int ret;
+
+	buf = malloc(ns.nand->erasesize);
+	if (!buf)
+		return -ENOMEM;
+
+	ret = nand_stats_read_block(off, buf);
+	if (ret) {
+		printf("nandstats: block %u uncorrectable, not scrubbed\n",
+		       block);
+		goto out;
+	}
+
+	if (nand_block_isbad(ns.nand, copy) ||
+	    nand_stats_write_block(copy, buf)) {
+		puts("nandstats: scrub block unusable, nothing scrubbed\n");
+		ret = -EIO;
+		goto out;
+	}
+	ns.scrub = block;
+	ns.scrub_crc = crc32(0, buf, ns.nand->erasesize);
+	ret = nand_stats_save();
+	if (ret) {
+		ns.scrub = NAND_STATS_NO_SCRUB;
+		goto out;
+	}
+
+	ret = nand_stats_write_block(off, buf);
+	ns.scrub = NAND_STATS_NO_SCRUB;
+	ns.dirty = 1;
+	if (ret) {
+		printf("nandstats: block %u failed scrub, marked bad\n", block);
+		ns.nand->block_markbad(ns.nand, off);
+		goto out;
+	}
+
+	printf("nandstats: block %u scrubbed\n", block);
+out:
+	free(buf);
+	return ret;
+}
+
+/* in one of the partitions named in CONFIG_NAND_SCRUB_PARTS */
+static int nand_stats_scrubbable(u32 block)
+{
+	struct mtd_device *dev = nand_stats_dev();
+	struct part_info *part;
+	const char *s = CONFIG_NAND_SCRUB_PARTS, *end;
+	u32 off = block * ns.nand->erasesize;
+
+	if (!dev ||
+	    (block >= ns.slot && block < ns.slot + NAND_STATS_BLOCKS))
+		return 0;
+
+	for (; *s; s = *end ? end + 1 : end) {
+		end = strchr(s, ',');
+		if (!end)
+			end = s + strlen(s);
+		part = nand_stats_part(dev, s, end - s);
+		if (part && off >= part->offset &&
+		    off < part->offset + part->size)
+			return 1;
+	}
+	return 0;
+}
+
+/* scrubs what is due and saves the counts if they changed */
+int nand_stats_sync(void)
+{
+	int ret = 0;
+	u32 block;
+
+	if (!ns.e || ns.busy)
+		return 0;
+	ns.busy = 1;
+
+	/* the scrub block has to be where the counts say it is */
+	if (nand_stats_find_slots())
+		block = ns.blocks;
+	else
+		block = 0;
+	for (; block < ns.blocks; block++) {
+		if (!(ns.e[block].flags & NAND_STATS_SCRUB) ||
+		    !nand_stats_scrubbable(block))
+			continue;
+		if (nand_stats_scrub(block)) {
+			/* don't try again on every sync */
+			ns.e[block].flags &= ~NAND_STATS_SCRUB;
+			ns.dirty = 1;
+		}
+	}
+
+	if (ns.dirty)
+		ret = nand_stats_save();
+	if (ret)
+		printf("nandstats: can't save counts (%d)\n", ret);
+
+	ns.busy = 0;
+	return ret;
+}
+
+static void nand_stats_print(void)
+{
+	struct nand_stats_entry *e;
+	u32 block, used = 0, max = 0, max_block = 0, scrub = 0;
+	ulong total = 0;
+
+	puts("block   erases  corrected\n");
+	for (block = 0; block < ns.blocks; block++) {
+		e = &ns.e[block];
+		total += e->erases;
+		if (e->erases > max) {
+			max = e->erases;
+			max_block = block;
+		}
+		if (e->flags & NAND_STATS_SCRUB)
+			scrub++;
+		if (!e->erases && !e->corrected && !e->flags)
+			continue;
+		used++;
+		printf("%5u  %7u  %9u%s\n", block, e->erases, e->corrected,
+		       !(e->flags & NAND_STATS_SCRUB) ? "" :
+		       nand_stats_scrubbable(block) ? "  scrub due" :
+		       "  over threshold");
+	}
+
+	printf("%u of %u blocks erased or corrected, %lu erases, "
+	       "at most %u (block %u)\n", used, ns.blocks, total, max,
+	       max_block);
+	printf("%u blocks over the threshold of %u, saved copy %u%s\n",
+	       scrub, CONFIG_NAND_SCRUB_THRESHOLD, ns.seq,
+	       ns.dirty ? ", changed since" : "");
+}
+
+int do_nandstats(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	if (!ns.e) {
+		puts("nandstats: no NAND device\n");
+		return 1;
+	}
+
+	if (argc < 2) {
+		nand_stats_print();
+		return 0;
+	}
+
+	if (!strcmp(argv[1], "save")) {
+		ns.dirty = 1;
+		return nand_stats_sync() ? 1 : 0;
+	}
+
+	if (!strcmp(argv[1], "scrub"))
+		return nand_stats_sync() ? 1 : 0;
+
+	if (!strcmp(argv[1], "clear")) {
+		memset(ns.e, 0, ns.blocks * sizeof(struct nand_stats_entry));
+		ns.dirty = 1;
+		return 0;
+	}
+
+	return cmd_usage(cmdtp);
+}
+
+U_BOOT_CMD(nandstats, 2, 0, do_nandstats,
+	"NAND erase counts and corrected reads",
+	"\n"
+	"    - per-block erase counts and corrected reads since the\n"
+	"      last erase\n"
+	"nandstats save\n"
+	"    - scrub what is due and write the counts to NAND now\n"
+	"nandstats scrub\n"
+	"    - scrub what is due, save if anything changed\n"
+	"nandstats clear\n"
+	"    - forget all counts (saved on the next sync)");
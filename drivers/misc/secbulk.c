@@ -31,6 +31,7 @@
 #include <asm/io.h>
 
 #include <usbdevice.h>
+#include <usb/secbulk.h>
 
 #include "secbulk.h"
 
@@ -306,17 +307,6 @@ static void secbulk_init_endpoints(void)
 	}
 }
 
-static u_int16_t secbulk_checksum(const unsigned char *data, u_int32_t len)
-{
-	u_int16_t checksum = 0;
-	int i;
-
-	for (i = 0; i < len; i++)
-		checksum += data[i];
-
-	return checksum;
-}
-
 static int secbulk_read(void)
 {
 	struct usb_endpoint_instance *endpoint =
@@ -324,9 +314,11 @@ static int secbulk_read(void)
 
 	static u32	downloaded_count = 0;
 	static int	first_pkt = 1;
+	static u16	sum;		/* of the image so far */
 	u8		*tmp_addr;
 	u16		checksum1;	/* read from usb packet */
 	u16		checksum2;	/* calculated from memory */
+	u32		image;
 
 	if (endpoint->rcv_urb && endpoint->rcv_urb->actual_length) {
 		unsigned int nb = 0;
@@ -345,6 +337,7 @@ static int secbulk_read(void)
 				(*((u8 *)(src + 7)) << 24);
 			src = endpoint->rcv_urb->buffer + 8;
 			endpoint->rcv_urb->actual_length -= 8;
+			sum = 0;
 
 			info("load addr: %#x, total count: %d(%x)\n",
 					download_addr, count, count);
@@ -354,6 +347,15 @@ static int secbulk_read(void)
 		tmp_addr = (u8 *)download_addr + downloaded_count;
 		nb = endpoint->rcv_urb->actual_length;
 
+		/*
+		 * sum the packet while it is still in the cache; the last
+		 * two bytes of the stream are the checksum itself
+		 */
+		image = count - 10;
+		if (downloaded_count < image)
+			sum = secbulk_sum(src,
+					min(nb, image - downloaded_count), sum);
+
 		memcpy(tmp_addr, src, nb);
 		downloaded_count += nb;
 		endpoint->rcv_urb->actual_length = 0;
@@ -361,13 +363,7 @@ static int secbulk_read(void)
 		if (downloaded_count == count - 8) {
 			tmp_addr = (u8 *)(download_addr + downloaded_count);
 			checksum1 = *(tmp_addr-2) + (*(tmp_addr-1) << 8);
-
-			/*
-			 * calculate checksum, last two bytes which
-			 * is checksum data is excluded
-			 */
-			checksum2 = secbulk_checksum((u8 *)download_addr,
-						downloaded_count - 2);
+			checksum2 = sum;
 			if (checksum1 == checksum2)
 				info("done, checksum: %04x\n", checksum1);
 			else
@@ -18,10 +18,15 @@
  * MA 02111-1307 USA
  */
 #include <common.h>
+#include <command.h>
+#include <malloc.h>
 
 #include <nand.h>
 #include <asm/arch/s3c24x0_cpu.h>
 #include <asm/io.h>
+#if defined(CONFIG_S3C2440)
+#include <s3c2440_nand_buf.h>
+#endif
 
 #if defined(CONFIG_S3C2410)
 #define S3C2410_NFCONF_EN          (1<<15)
@@ -39,6 +44,12 @@
 #elif defined(CONFIG_S3C2440)
 
 #define S3C2410_NFCONT_nFCE	   (1<<1)
+#define S3C2410_NFCONT_INITECC	   (1<<4)
+#define S3C2410_NFCONT_MECCLOCK	   (1<<5)
+#define S3C2410_NFCONT_SECCLOCK	   (1<<6)
+#define S3C2410_NFCONT_RnB_INT	   (1<<9)
+#define S3C2410_NFSTAT_RnB	   (1<<0)
+#define S3C2410_NFSTAT_RnB_TRANS   (1<<2)
 #define S3C2410_NFCONF_TACLS(x)    ((x)<<12)
 #define S3C2410_NFCONF_TWRPH0(x)   ((x)<<8)
 #define S3C2410_NFCONF_TWRPH1(x)   ((x)<<4)
@@ -51,10 +62,65 @@
 ulong IO_ADDR_W = NF_BASE; 
 
 #ifdef CONFIG_NAND_SPL
-
 /* in the early stage of NAND flash booting, printf() is not available */
 #define printf(fmt, args...)
+#endif
+
+#if defined(CONFIG_S3C2440) && defined(CONFIG_S3C2410_NAND_IRQ) && \
+	defined(CONFIG_USE_IRQ) && !defined(CONFIG_NAND_SPL)
+#define S3C2440_NAND_RB_IRQ
+#endif
+
+#if defined(CONFIG_S3C2440) && defined(CONFIG_S3C2410_NAND_CACHE) && \
+	!defined(CONFIG_NAND_SPL)
+#define S3C2440_NAND_CACHE
+#endif
+
+#if defined(CONFIG_NAND_STATS) && !defined(CONFIG_NAND_SPL)
+#define S3C2410_NAND_STATS
+#endif
+
+#if defined(CONFIG_S3C2440)
+static void s3c2410_nand_read_buf(struct mtd_info *mtd, u_char *buf, int len)
+{
+	struct nand_chip *this = mtd->priv;
 
+	s3c2440_nand_read_buf(this->IO_ADDR_R, buf, len);
+}
+
+static void s3c2410_nand_write_buf(struct mtd_info *mtd, const u_char *buf,
+				   int len)
+{
+	struct nand_chip *this = mtd->priv;
+
+	s3c2440_nand_write_buf(this->IO_ADDR_W, buf, len);
+}
+
+#if defined(CONFIG_MTD_NAND_VERIFY_WRITE) && !defined(CONFIG_NAND_SPL)
+static int s3c2410_nand_verify_buf(struct mtd_info *mtd, const u_char *buf,
+				   int len)
+{
+	struct nand_chip *this = mtd->priv;
+	void *io = this->IO_ADDR_R;
+	const u_int32_t *p;
+
+	for (; len > 0 && ((ulong)buf & 3); len--)
+		if (*buf++ != readb(io))
+			return -EFAULT;
+
+	for (p = (const u_int32_t *)buf; len >= 4; len -= 4)
+		if (*p++ != readl(io))
+			return -EFAULT;
+
+	for (buf = (const u_char *)p; len > 0; len--)
+		if (*buf++ != readb(io))
+			return -EFAULT;
+
+	return 0;
+}
+#endif
+
+#elif defined(CONFIG_NAND_SPL)
 static void nand_read_buf(struct mtd_info *mtd, u_char *buf, int len)
 {
 	int i;
@@ -65,6 +131,154 @@ static void nand_read_buf(struct mtd_info *mtd, u_char *buf, int len)
 }
 #endif
 
+#ifdef S3C2440_NAND_RB_IRQ
+/* set while waiting for the R/B edge of the last command */
+static volatile int s3c2440_nand_rb_busy;
+
+/*
+ * Sleeps per command before giving up on the edge and polling: with
+ * the 10 ms timer tick as a backstop that is about 100 ms, well past
+ * the longest block erase.
+ */
+#define S3C2440_NAND_RB_SLEEPS	10
+static int s3c2440_nand_rb_sleeps;
+
+/* called from do_irq() on INT_NFCON, the R/B rising edge */
+void s3c2410_nand_irq(void)
+{
+	struct s3c2410_nand *nand = s3c2410_get_base_nand();
+
+	writel(readl(&nand->NFSTAT) | S3C2410_NFSTAT_RnB_TRANS, &nand->NFSTAT);
+	s3c2440_nand_rb_busy = 0;
+}
+
+/*
+ * Commands after which the chip pulls R/B low until it is done.  The
+ * transition flag is cleared before the command goes out, so its edge
+ * can't be confused with an earlier one.  Small page reads start after
+ * the last address cycle instead and are left to polling.
+ */
+static void s3c2440_nand_rb_arm(struct s3c2410_nand *nand, int cmd)
+{
+	switch (cmd) {
+	case NAND_CMD_PAGEPROG:
+	case NAND_CMD_CACHEDPROG:
+	case NAND_CMD_ERASE2:
+	case NAND_CMD_READSTART:
+	case NAND_CMD_RESET:
+		writel(readl(&nand->NFSTAT) | S3C2410_NFSTAT_RnB_TRANS,
+		       &nand->NFSTAT);
+		s3c2440_nand_rb_busy = 1;
+		s3c2440_nand_rb_sleeps = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * ARM920T wait for interrupt: the core stops until nIRQ is asserted,
+ * even with IRQs masked in the CPSR.  Timer 4, which get_timer()
+ * runs at 100 Hz, is unmasked for the sleep, so it ends within 10 ms
+ * even if R/B never rises.  do_irq() doesn't know timer 4, so its
+ * pending bits are cleared here before interrupts come back on.
+ */
+static void s3c2440_nand_idle(void)
+{
+	struct s3c24x0_interrupt *irq = s3c24x0_get_base_interrupt();
+
+	writel(BIT_TIMER4, &irq->SRCPND);
+	writel(readl(&irq->INTMSK) & ~BIT_TIMER4, &irq->INTMSK);
+
+	__asm__ __volatile__("mcr p15, 0, %0, c7, c0, 4" : : "r" (0));
+
+	writel(readl(&irq->INTMSK) | BIT_TIMER4, &irq->INTMSK);
+	writel(BIT_TIMER4, &irq->SRCPND);
+	if (readl(&irq->INTPND) & BIT_TIMER4)
+		writel(BIT_TIMER4, &irq->INTPND);
+}
+
+static void s3c2440_nand_rb_irq_init(struct s3c2410_nand *nand)
+{
+	struct s3c24x0_interrupt *irq = s3c24x0_get_base_interrupt();
+
+	writel(readl(&nand->NFSTAT) | S3C2410_NFSTAT_RnB_TRANS, &nand->NFSTAT);
+	/* RnB_TransMode (bit 8) left 0: interrupt on the rising edge */
+	writel(readl(&nand->NFCONT) | S3C2410_NFCONT_RnB_INT, &nand->NFCONT);
+
+	writel(BIT_NFCON, &irq->SRCPND);
+	writel(BIT_NFCON, &irq->INTPND);
+	writel(readl(&irq->INTMSK) & ~BIT_NFCON, &irq->INTMSK);
+}
+#endif	/* S3C2440_NAND_RB_IRQ */
+
+#ifdef S3C2410_NAND_STATS
+/* board/samsung/mini2440/nand_stats.c */
+extern void nand_stats_erase(struct mtd_info *mtd, int page);
+extern void nand_stats_corrected(struct mtd_info *mtd, int page);
+
+/*
+ * The row address of the last read, program or erase, picked up from
+ * the address cycles on their way out, so that erases and corrections
+ * are counted per block whoever issued them.
+ */
+static struct {
+	int	cmd;
+	int	cycle;
+	int	row;
+} s3c2410_nand_addr = { NAND_CMD_NONE, 0, 0 };
+
+static void s3c2410_nand_track(struct mtd_info *mtd, int cmd,
+			       unsigned int ctrl)
+{
+	int cols;
+
+	if (cmd == NAND_CMD_NONE)
+		return;
+
+	if (ctrl & NAND_CLE) {
+		switch (cmd) {
+		case NAND_CMD_READ0:
+		case NAND_CMD_READ1:
+		case NAND_CMD_READOOB:
+		case NAND_CMD_SEQIN:
+		case NAND_CMD_ERASE1:
+			s3c2410_nand_addr.cmd = cmd;
+			s3c2410_nand_addr.cycle = 0;
+			s3c2410_nand_addr.row = 0;
+			break;
+		case NAND_CMD_ERASE2:
+			if (s3c2410_nand_addr.cmd == NAND_CMD_ERASE1)
+				nand_stats_erase(mtd, s3c2410_nand_addr.row);
+			/* fall through */
+		default:
+			/* the row stays, for the ECC check after a read */
+			s3c2410_nand_addr.cmd = NAND_CMD_NONE;
+			break;
+		}
+		return;
+	}
+
+	if (!(ctrl & NAND_ALE) || s3c2410_nand_addr.cmd == NAND_CMD_NONE)
+		return;
+
+	/* erase sends the row only */
+	if (s3c2410_nand_addr.cmd == NAND_CMD_ERASE1)
+		cols = 0;
+	else
+		cols = mtd->writesize > 512 ? 2 : 1;
+	if (s3c2410_nand_addr.cycle >= cols)
+		s3c2410_nand_addr.row |=
+			cmd << (8 * (s3c2410_nand_addr.cycle - cols));
+	s3c2410_nand_addr.cycle++;
+}
+
+#define s3c2410_nand_corrected(mtd) \
+	nand_stats_corrected(mtd, s3c2410_nand_addr.row)
+#else
+#define s3c2410_nand_corrected(mtd)	do { } while (0)
+#endif	/* S3C2410_NAND_STATS */
+
 static void s3c2410_hwcontrol(struct mtd_info *mtd, int cmd, unsigned int ctrl)
 {
 	/* struct nand_chip *chip = mtd->priv; */
@@ -100,6 +314,14 @@ static void s3c2410_hwcontrol(struct mtd_info *mtd, int cmd, unsigned int ctrl)
 #endif
 	}
 
+#ifdef S3C2440_NAND_RB_IRQ
+	if (cmd != NAND_CMD_NONE && (ctrl & NAND_CLE))
+		s3c2440_nand_rb_arm(nand, cmd);
+#endif
+#ifdef S3C2410_NAND_STATS
+	s3c2410_nand_track(mtd, cmd, ctrl);
+#endif
+
 	if (cmd != NAND_CMD_NONE)
 		writeb(cmd, (void *)IO_ADDR_W);
 }
@@ -108,10 +330,37 @@ static int s3c2410_dev_ready(struct mtd_info *mtd)
 {
 	struct s3c2410_nand *nand = s3c2410_get_base_nand();
 	debug(1, "dev_ready\n");
-	return readl(&nand->NFSTAT) & 0x01;
+
+#ifdef S3C2440_NAND_RB_IRQ
+	/*
+	 * While the chip is still busy after a command that raises R/B
+	 * when done, sleep until an interrupt comes in instead of
+	 * spinning here: the R/B edge, a USB gadget interrupt, which
+	 * do_irq() services before we look again, or the timer tick.
+	 * After S3C2440_NAND_RB_SLEEPS wakeups without the edge, a chip
+	 * that never raises R/B is left to plain polling and the caller's
+	 * timeout.  Inside do_irq() (fastboot flashing from a completion
+	 * handler) interrupts are already off and this stays a plain poll.
+	 */
+	if (s3c2440_nand_rb_busy &&
+	    !(readl(&nand->NFSTAT) & S3C2410_NFSTAT_RnB) &&
+	    disable_interrupts()) {
+		/* checked again with interrupts off, or the edge may be gone */
+		if (s3c2440_nand_rb_busy) {
+			if (++s3c2440_nand_rb_sleeps > S3C2440_NAND_RB_SLEEPS)
+				s3c2440_nand_rb_busy = 0;
+			else
+				s3c2440_nand_idle();
+		}
+		enable_interrupts();
+	}
+#endif
+
+	return readl(&nand->NFSTAT) & S3C2410_NFSTAT_RnB;
 }
 
 #ifdef CONFIG_S3C2410_NAND_HWECC
+#if defined(CONFIG_S3C2410)
 void s3c2410_nand_enable_hwecc(struct mtd_info *mtd, int mode)
 {
 	struct s3c2410_nand *nand = s3c2410_get_base_nand();
@@ -131,24 +380,532 @@ static int s3c2410_nand_calculate_ecc(struct mtd_info *mtd, const u_char *dat,
 
 	return 0;
 }
+#elif defined(CONFIG_S3C2440)
+/*
+ * The main area ECC accumulates over every byte moved through NFDATA
+ * since it was last initialised, so it is reset and unlocked for each
+ * ECC step, and locked again once read out so the OOB accesses that
+ * follow the data don't disturb it.  The spare area ECC is not used
+ * and stays locked.
+ */
+void s3c2410_nand_enable_hwecc(struct mtd_info *mtd, int mode)
+{
+	struct s3c2410_nand *nand = s3c2410_get_base_nand();
+	u_int32_t cont;
+
+	debug(1, "s3c2410_nand_enable_hwecc(%p, %d)\n", mtd, mode);
+
+	cont = readl(&nand->NFCONT) & ~S3C2410_NFCONT_MECCLOCK;
+	writel(cont | S3C2410_NFCONT_INITECC, &nand->NFCONT);
+}
+
+/*
+ * NFMECC0 holds the parity of the step in its low three bytes (the
+ * fourth only matters for 2048 byte steps), in the same layout as the
+ * S3C2410's NFECC, so one correct_data serves both.
+ */
+static int s3c2410_nand_calculate_ecc(struct mtd_info *mtd, const u_char *dat,
+				      u_char *ecc_code)
+{
+	struct s3c2410_nand *nand = s3c2410_get_base_nand();
+	u_int32_t ecc;
+
+	writel(readl(&nand->NFCONT) | S3C2410_NFCONT_MECCLOCK, &nand->NFCONT);
+
+	ecc = readl(&nand->NFMECC0);
+	ecc_code[0] = ecc;
+	ecc_code[1] = ecc >> 8;
+	ecc_code[2] = ecc >> 16;
+	debug(1, "s3c2410_nand_calculate_hwecc(%p,): 0x%02x 0x%02x 0x%02x\n",
+	       mtd , ecc_code[0], ecc_code[1], ecc_code[2]);
+
+	return 0;
+}
+#endif
 
+/*
+ * Returns 0 if the data is good, 1 if a single bit error was corrected
+ * (in the data or in the ECC itself) and -1 if it can't be corrected.
+ */
 static int s3c2410_nand_correct_data(struct mtd_info *mtd, u_char *dat,
 				     u_char *read_ecc, u_char *calc_ecc)
 {
-	if (read_ecc[0] == calc_ecc[0] &&
-	    read_ecc[1] == calc_ecc[1] &&
-	    read_ecc[2] == calc_ecc[2])
+	unsigned int diff0, diff1, diff2;
+	unsigned int bit, byte;
+
+	diff0 = read_ecc[0] ^ calc_ecc[0];
+	diff1 = read_ecc[1] ^ calc_ecc[1];
+	diff2 = read_ecc[2] ^ calc_ecc[2];
+
+	if (diff0 == 0 && diff1 == 0 && diff2 == 0)
+		return 0;		/* ECC is ok */
+
+	/* an erased page has no ECC written; don't mistake it for errors */
+	if (read_ecc[0] == 0xff && read_ecc[1] == 0xff && read_ecc[2] == 0xff)
 		return 0;
 
-	printf("s3c2410_nand_correct_data: not implemented\n");
+	/*
+	 * A single bit error flips exactly one bit of each parity pair,
+	 * i.e. the syndrome has the form 01 or 10 in every bit pair; the
+	 * odd bits then spell out the byte and bit address of the error.
+	 */
+	if (((diff0 ^ (diff0 >> 1)) & 0x55) == 0x55 &&
+	    ((diff1 ^ (diff1 >> 1)) & 0x55) == 0x55 &&
+	    ((diff2 ^ (diff2 >> 1)) & 0x55) == 0x55) {
+		bit  = ((diff2 >> 3) & 1) |
+		       ((diff2 >> 4) & 2) |
+		       ((diff2 >> 5) & 4);
+
+		byte = ((diff2 << 7) & 0x100) |
+		       ((diff1 << 0) & 0x80)  |
+		       ((diff1 << 1) & 0x40)  |
+		       ((diff1 << 2) & 0x20)  |
+		       ((diff1 << 3) & 0x10)  |
+		       ((diff0 >> 4) & 0x08)  |
+		       ((diff0 >> 3) & 0x04)  |
+		       ((diff0 >> 2) & 0x02)  |
+		       ((diff0 >> 1) & 0x01);
+
+		debug("nand: correcting bit %u of byte %u\n", bit, byte);
+
+		dat[byte] ^= (1 << bit);
+		s3c2410_nand_corrected(mtd);
+		return 1;
+	}
+
+	/* a single differing ECC bit means the ECC itself took the hit */
+	diff0 |= (diff1 << 8);
+	diff0 |= (diff2 << 16);
+
+	if ((diff0 & (diff0 - 1)) == 0) {
+		s3c2410_nand_corrected(mtd);
+		return 1;
+	}
+
+	printf("nand: uncorrectable ECC error\n");
 	return -1;
 }
 #endif
 
+#if defined(CONFIG_S3C2440)
+/*
+ * Bus timings in ns.  tacls is the CLE/ALE setup before nWE (tCLS,
+ * tALS), twrph0 the nWE/nRE pulse (tWP, tRP) and twrph1 the hold after
+ * it (tCLH, tDH, tREH).  NFCONF takes them in HCLK cycles, 0..3 for
+ * TACLS and 1..8 for the others.
+ */
+struct s3c2440_nand_timing {
+	u_int8_t	maker;
+	u_int8_t	device;
+	u_int8_t	tacls;
+	u_int8_t	twrph0;
+	u_int8_t	twrph1;
+	u_int8_t	flags;		/* S3C2440_NAND_CACHE_PROG */
+};
+
+/*
+ * Cache program is announced by bit 7 of the third ID byte; the flag
+ * forces it for a part that has it but doesn't say so.
+ */
+#define S3C2440_NAND_CACHE_PROG	(1 << 0)
+
+static const struct s3c2440_nand_timing s3c2440_nand_timings[] = {
+	{ 0xec, 0x76, 0, 25, 15 },	/* K9F1208, 64 MiB small page */
+	{ 0xec, 0xf1, 0, 15, 10 },	/* K9F1G08, 128 MiB */
+	{ 0xec, 0xda, 0, 12, 10 },	/* K9F2G08, 256 MiB */
+	{ 0xec, 0xdc, 0, 12, 10 },	/* K9F4G08, 512 MiB */
+	{ 0xec, 0xd3, 0, 12, 10 },	/* K9K8G08, 1 GiB */
+};
+
+/* what is written to NFCONF, in cycles */
+static struct {
+	u_int8_t	tacls;
+	u_int8_t	twrph0;
+	u_int8_t	twrph1;
+} s3c2440_nand_cycles;
+
+static u_int8_t s3c2440_nand_features;
+
+static void s3c2440_nand_set_cycles(int tacls, int twrph0, int twrph1)
+{
+	struct s3c2410_nand *nand = s3c2410_get_base_nand();
+	u_int32_t cfg;
+
+	s3c2440_nand_cycles.tacls = tacls;
+	s3c2440_nand_cycles.twrph0 = twrph0;
+	s3c2440_nand_cycles.twrph1 = twrph1;
+
+	cfg = readl(&nand->NFCONF) & ~0x3770;
+	cfg |= S3C2410_NFCONF_TACLS(tacls);
+	cfg |= S3C2410_NFCONF_TWRPH0(twrph0 - 1);
+	cfg |= S3C2410_NFCONF_TWRPH1(twrph1 - 1);
+	writel(cfg, &nand->NFCONF);
+}
+
+/*
+ * ns to HCLK cycles, rounded up and clamped to what NFCONF can hold.
+ * The clock is taken in kHz, rounded up, so the result never falls
+ * short of the datasheet; ns * kHz stays well within 32 bits.
+ */
+static int s3c2440_nand_ns_to_cycles(unsigned int ns, int min, int max)
+{
+	unsigned long khz = (get_HCLK() + 999) / 1000;
+	int cycles = (ns * khz + 999999) / 1000000;
+
+	if (cycles < min)
+		return min;
+	if (cycles > max) {
+		printf("nand: %u ns needs %d HCLK cycles, NFCONF has %d\n",
+		       ns, cycles, max);
+		return max;
+	}
+	return cycles;
+}
+
+static void s3c2440_nand_set_timing(const struct s3c2440_nand_timing *t)
+{
+	s3c2440_nand_set_cycles(s3c2440_nand_ns_to_cycles(t->tacls, 0, 3),
+				s3c2440_nand_ns_to_cycles(t->twrph0, 1, 8),
+				s3c2440_nand_ns_to_cycles(t->twrph1, 1, 8));
+}
+
+/*
+ * Picks the timings of the chip from its maker and device ID bytes,
+ * which are read at the slowest setting, or the board's defaults for
+ * chips not in the table.
+ */
+static void s3c2440_nand_init_timing(void)
+{
+	static const struct s3c2440_nand_timing board_default = {
+		0, 0, CONFIG_SYS_NAND_TACLS, CONFIG_SYS_NAND_TWRPH0,
+		CONFIG_SYS_NAND_TWRPH1
+	};
+	struct s3c2410_nand *nand = s3c2410_get_base_nand();
+	const struct s3c2440_nand_timing *t = &board_default;
+	u_int8_t maker, device, cell;
+	int i;
+
+	s3c2440_nand_set_cycles(3, 8, 8);
+
+	writel(readl(&nand->NFCONT) & ~S3C2410_NFCONT_nFCE, &nand->NFCONT);
+	writeb(NAND_CMD_RESET, &nand->NFCMD);
+	for (i = 0; i < 0x10000 && !(readl(&nand->NFSTAT) & 0x01); i++)
+		;
+	writeb(NAND_CMD_READID, &nand->NFCMD);
+	writeb(0, &nand->NFADDR);
+	for (i = 0; i < 100; i++)	/* tWHR */
+		;
+	maker = readb(&nand->NFDATA);
+	device = readb(&nand->NFDATA);
+	cell = readb(&nand->NFDATA);
+	writel(readl(&nand->NFCONT) | S3C2410_NFCONT_nFCE, &nand->NFCONT);
+
+	for (i = 0; i < ARRAY_SIZE(s3c2440_nand_timings); i++) {
+		if (s3c2440_nand_timings[i].maker == maker &&
+		    s3c2440_nand_timings[i].device == device) {
+			t = &s3c2440_nand_timings[i];
+			break;
+		}
+	}
+
+	s3c2440_nand_set_timing(t);
+
+	s3c2440_nand_features = t->flags;
+	if (cell & 0x80)
+		s3c2440_nand_features |= S3C2440_NAND_CACHE_PROG;
+
+	debug(1, "nand id %02x %02x: tacls %d twrph0 %d twrph1 %d cycles\n",
+	      maker, device, s3c2440_nand_cycles.tacls,
+	      s3c2440_nand_cycles.twrph0, s3c2440_nand_cycles.twrph1);
+}
+
+#ifdef S3C2440_NAND_CACHE
+/*
+ * On 2K page chips, bulk writes keep the array busy with one page
+ * while the next moves over the bus.  nand_base does the paging;
+ * write_page follows its "cached" hint with 15h instead of 10h.  It
+ * is hooked in from scan_bbt, the first call after nand_scan() has
+ * sized the chip.
+ */
+
+/* pages of one block, the longest run nand_base programs cached */
+#define S3C2440_NAND_VERIFY_PAGES	64
+
+static struct {
+	int		cached;		/* last program was 15h */
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
+	int		pending;	/* programmed, not verified yet */
+	int		page[S3C2440_NAND_VERIFY_PAGES];
+	const uint8_t	*buf[S3C2440_NAND_VERIFY_PAGES];
+#endif
+} s3c2440_nand_cache;
+
+/*
+ * Reads the status until the array itself is idle, not just the cache
+ * register, which is all R/B tells after 15h.
+ */
+static int s3c2440_nand_wait_array(struct mtd_info *mtd)
+{
+	struct nand_chip *chip = mtd->priv;
+	ulong start = get_timer(0);
+	int status;
+
+	chip->cmdfunc(mtd, NAND_CMD_STATUS, -1, -1);
+	do {
+		status = chip->read_byte(mtd);
+	} while (!(status & NAND_STATUS_TRUE_READY) &&
+		 get_timer(start) < CONFIG_SYS_HZ / 50);
+
+	return status;
+}
+
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
+/*
+ * Reading a page back would have to wait for the array, so pages
+ * programmed with 15h are verified together once the run ends.  Pages
+ * staged in chip->buffers are verified at once, before nand_base
+ * reuses the buffer.
+ */
+static int s3c2440_nand_verify(struct mtd_info *mtd, const uint8_t *buf,
+			       int page, int cached)
+{
+	struct nand_chip *chip = mtd->priv;
+	int i, n;
+
+	s3c2440_nand_cache.page[s3c2440_nand_cache.pending] = page;
+	s3c2440_nand_cache.buf[s3c2440_nand_cache.pending++] = buf;
+
+	if (cached && buf != chip->buffers->databuf &&
+	    s3c2440_nand_cache.pending < S3C2440_NAND_VERIFY_PAGES)
+		return 0;
+
+	if (cached) {
+		s3c2440_nand_wait_array(mtd);
+		s3c2440_nand_cache.cached = 0;
+	}
+
+	n = s3c2440_nand_cache.pending;
+	s3c2440_nand_cache.pending = 0;
+	for (i = 0; i < n; i++) {
+		chip->cmdfunc(mtd, NAND_CMD_READ0, 0,
+			      s3c2440_nand_cache.page[i]);
+		if (chip->verify_buf(mtd, s3c2440_nand_cache.buf[i],
+				     mtd->writesize))
+			return -EIO;
+	}
+
+	return 0;
+}
+#endif
+
+/* nand_base's nand_write_page(), with cache program when asked to */
+static int s3c2440_nand_write_page(struct mtd_info *mtd,
+		struct nand_chip *chip, const uint8_t *buf, int page,
+		int cached, int raw)
+{
+	int prev = s3c2440_nand_cache.cached;
+	int status;
+
+	chip->cmdfunc(mtd, NAND_CMD_SEQIN, 0x00, page);
+
+	if (raw)
+		chip->ecc.write_page_raw(mtd, chip, buf);
+	else
+		chip->ecc.write_page(mtd, chip, buf);
+
+	chip->cmdfunc(mtd, cached ? NAND_CMD_CACHEDPROG : NAND_CMD_PAGEPROG,
+		      -1, -1);
+	status = chip->waitfunc(mtd, chip);
+	s3c2440_nand_cache.cached = cached;
+
+	/* after 15h I/O 0 isn't known yet, I/O 1 is the page before */
+	if ((!cached && (status & NAND_STATUS_FAIL)) ||
+	    (prev && (status & NAND_STATUS_FAIL_N1))) {
+		if (cached)
+			s3c2440_nand_wait_array(mtd);
+		s3c2440_nand_cache.cached = 0;
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
+		s3c2440_nand_cache.pending = 0;
+#endif
+		return -EIO;
+	}
+
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
+	return s3c2440_nand_verify(mtd, buf, page, cached);
+#else
+	return 0;
+#endif
+}
+
+static int s3c2440_nand_scan_bbt(struct mtd_info *mtd)
+{
+	struct nand_chip *chip = mtd->priv;
+
+	if (mtd->writesize >= 2048 &&
+	    (s3c2440_nand_features & S3C2440_NAND_CACHE_PROG)) {
+		chip->options |= NAND_CACHEPRG;
+		chip->write_page = s3c2440_nand_write_page;
+	}
+
+	return nand_default_bbt(mtd);
+}
+#endif	/* S3C2440_NAND_CACHE */
+
+#if defined(CONFIG_CMD_NAND) && !defined(CONFIG_NAND_SPL)
+#define NAND_CAL_PAGES		4	/* pages compared per pass */
+#define NAND_CAL_PASSES		16
+
+/* raw page reads, data and spare, so ECC can't hide a marginal bus */
+static int s3c2440_nand_cal_read(struct mtd_info *mtd, int page,
+				 u_char *buf, int len)
+{
+	struct nand_chip *chip = mtd->priv;
+	int i;
+
+	chip->select_chip(mtd, 0);
+	for (i = 0; i < NAND_CAL_PAGES; i++, buf += len) {
+		chip->cmdfunc(mtd, NAND_CMD_READ0, 0, page + i);
+		chip->read_buf(mtd, buf, len);
+	}
+	chip->select_chip(mtd, -1);
+
+	return 0;
+}
+
+static int s3c2440_nand_cal_verify(struct mtd_info *mtd, int page,
+				   const u_char *ref, u_char *buf, int len)
+{
+	int pass;
+
+	for (pass = 0; pass < NAND_CAL_PASSES; pass++) {
+		s3c2440_nand_cal_read(mtd, page, buf, len);
+		if (memcmp(ref, buf, len * NAND_CAL_PAGES))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Starts at the slowest setting and takes cycles off twrph0, twrph1
+ * and tacls in turn for as long as the pages still read back the same,
+ * then adds one cycle back to the strobe as margin.  Only reads are
+ * verified, nothing is written.
+ */
+static int s3c2440_nand_calibrate(struct mtd_info *mtd, int page)
+{
+	int len = mtd->writesize + mtd->oobsize;
+	u_char *ref, *buf;
+	u_int8_t c[3] = { 8, 8, 3 };		/* twrph0, twrph1, tacls */
+	const u_int8_t cmin[3] = { 1, 1, 0 };
+	int i, ret = -1;
+
+	ref = malloc(2 * len * NAND_CAL_PAGES);
+	if (!ref)
+		return -ENOMEM;
+	buf = ref + len * NAND_CAL_PAGES;
+
+	s3c2440_nand_set_cycles(c[2], c[0], c[1]);
+	s3c2440_nand_cal_read(mtd, page, ref, len);
+	if (s3c2440_nand_cal_verify(mtd, page, ref, buf, len)) {
+		puts("reads differ at the slowest timing, giving up\n");
+		goto out;
+	}
+
+	for (i = 0; i < 3; i++) {
+		while (c[i] > cmin[i]) {
+			c[i]--;
+			s3c2440_nand_set_cycles(c[2], c[0], c[1]);
+			if (s3c2440_nand_cal_verify(mtd, page, ref, buf, len)) {
+				c[i]++;
+				break;
+			}
+		}
+	}
+	if (c[0] < 8)
+		c[0]++;
+	ret = 0;
+
+out:
+	s3c2440_nand_set_cycles(c[2], c[0], c[1]);
+	free(ref);
+	return ret;
+}
+
+static void s3c2440_nand_print_timing(void)
+{
+	unsigned long mhz = get_HCLK() / 1000000;
+
+	printf("HCLK %lu MHz: tacls %d, twrph0 %d, twrph1 %d cycles "
+	       "(%lu, %lu, %lu ns)\n", mhz, s3c2440_nand_cycles.tacls,
+	       s3c2440_nand_cycles.twrph0, s3c2440_nand_cycles.twrph1,
+	       s3c2440_nand_cycles.tacls * 1000 / mhz,
+	       s3c2440_nand_cycles.twrph0 * 1000 / mhz,
+	       s3c2440_nand_cycles.twrph1 * 1000 / mhz);
+}
+
+int do_nandtiming(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	struct mtd_info *mtd = &nand_info[0];
+	int page = 0;
+
+	if (argc < 2 || !strcmp(argv[1], "show")) {
+		s3c2440_nand_print_timing();
+		return 0;
+	}
+
+	if (!strcmp(argv[1], "set") && argc == 5) {
+		int tacls = simple_strtoul(argv[2], NULL, 10);
+		int twrph0 = simple_strtoul(argv[3], NULL, 10);
+		int twrph1 = simple_strtoul(argv[4], NULL, 10);
+
+		if (tacls > 3 || twrph0 < 1 || twrph0 > 8 ||
+		    twrph1 < 1 || twrph1 > 8) {
+			puts("tacls is 0..3, twrph0 and twrph1 are 1..8\n");
+			return 1;
+		}
+		s3c2440_nand_set_cycles(tacls, twrph0, twrph1);
+		s3c2440_nand_print_timing();
+		return 0;
+	}
+
+	if (!strcmp(argv[1], "calibrate") && argc <= 3) {
+		if (!mtd->name) {
+			puts("no NAND device\n");
+			return 1;
+		}
+		if (argc == 3)
+			page = simple_strtoul(argv[2], NULL, 16) /
+				mtd->writesize;
+		if (s3c2440_nand_calibrate(mtd, page))
+			return 1;
+		s3c2440_nand_print_timing();
+		return 0;
+	}
+
+	cmd_usage(cmdtp);
+	return 1;
+}
+
+U_BOOT_CMD(nandtiming, 5, 0, do_nandtiming,
+	"show, set or calibrate the NAND bus timing",
+	"[show]\n"
+	"    - print the NFCONF timing in HCLK cycles and ns\n"
+	"nandtiming set tacls twrph0 twrph1\n"
+	"    - set the timing in cycles, until the next reset\n"
+	"nandtiming calibrate [off]\n"
+	"    - find the fastest timing at which the pages at NAND offset\n"
+	"      off (default 0) keep reading back the same, plus a cycle\n"
+	"      of margin, and use it until the next reset");
+#endif	/* CONFIG_CMD_NAND && !CONFIG_NAND_SPL */
+#endif	/* CONFIG_S3C2440 */
+
 int board_nand_init(struct nand_chip *nand)
 {
 	u_int32_t cfg;
+#if defined(CONFIG_S3C2410)
 	u_int8_t tacls, twrph0, twrph1;
+#endif
 	struct s3c24x0_clock_power *clk_power = s3c24x0_get_base_clock_power();
 	struct s3c2410_nand *nand_reg = s3c2410_get_base_nand();
 
@@ -169,18 +926,16 @@ int board_nand_init(struct nand_chip *nand)
 	writel(cfg, &nand_reg->NFCONF);
 #elif defined(CONFIG_S3C2440)
 	/* initialize hardware */
-	twrph0 = 4;
-	twrph1 = 2;
-	tacls = 0;
-
-	cfg = 0;
-	cfg |= S3C2410_NFCONF_TACLS(tacls);
-	cfg |= S3C2410_NFCONF_TWRPH0(twrph0 - 1);
-	cfg |= S3C2410_NFCONF_TWRPH1(twrph1 - 1);
-	writel(cfg, &nand_reg->NFCONF);
-
-	cfg = (1<<6)|(1<<4)|(0<<1)|(1<<0);
+	/* enable the controller, spare area ECC is not used */
+	cfg = S3C2410_NFCONT_SECCLOCK | S3C2410_NFCONT_INITECC |
+		S3C2410_NFCONT_nFCE | (1<<0);
 	writel(cfg, &nand_reg->NFCONT);
+
+	/* timings from HCLK and the chip's ID */
+	s3c2440_nand_init_timing();
+#ifdef S3C2440_NAND_RB_IRQ
+	s3c2440_nand_rb_irq_init(nand_reg);
+#endif
 #endif
 
 	/* initialize nand_chip data structure */
@@ -188,10 +943,18 @@ int board_nand_init(struct nand_chip *nand)
 
 	nand->select_chip = NULL;
 
-	/* read_buf and write_buf are default */
 	/* read_byte and write_byte are default */
-#ifdef CONFIG_NAND_SPL
+#if defined(CONFIG_S3C2440)
+	nand->read_buf = s3c2410_nand_read_buf;
+	nand->write_buf = s3c2410_nand_write_buf;
+#if defined(CONFIG_MTD_NAND_VERIFY_WRITE) && !defined(CONFIG_NAND_SPL)
+	nand->verify_buf = s3c2410_nand_verify_buf;
+#endif
+#elif defined(CONFIG_NAND_SPL)
+	/* read_buf and write_buf are default */
 	nand->read_buf = nand_read_buf;
+#else
+	/* read_buf and write_buf are default */
 #endif
 
 	/* hwcontrol always must be implemented */
@@ -215,6 +978,9 @@ int board_nand_init(struct nand_chip *nand)
 #else
 	nand->options = 0;
 #endif
+#ifdef S3C2440_NAND_CACHE
+	nand->scan_bbt = s3c2440_nand_scan_bbt;
+#endif
 
 	debug(1, "end of nand_init\n");
 
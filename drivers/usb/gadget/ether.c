@@ -29,6 +29,12 @@
 #include <net.h>
 #include <malloc.h>
 #include <linux/ctype.h>
+#ifdef	CONFIG_USB_ETH_NCM
+#include <usb/ncm.h>
+#endif
+#ifdef	CONFIG_USB_ETH_CSUM
+#include <usb/eth_csum.h>
+#endif
 
 #include "gadget_chips.h"
 #include "rndis.h"
@@ -80,6 +86,11 @@ unsigned packet_received, packet_sent;
  * simpler, Microsoft pushes their own approach: RNDIS.  The published
  * RNDIS specs are ambiguous and appear to be incomplete, and are also
  * needlessly complex.  They borrow more from CDC ACM than CDC ECM.
+ *
+ * CDC NCM (Network Control Model) keeps the CDC Ethernet control plane
+ * but wraps the data in NCM Transfer Blocks (NTBs), each of which may
+ * carry many Ethernet frames.  With CONFIG_USB_ETH_NCM it replaces CDC
+ * Ethernet as the "main" configuration unless "usbnet_mode" is "ecm".
  */
 #define ETH_ALEN	6		/* Octets in one ethernet addr	 */
 #define ETH_HLEN	14		/* Total octets in header.	 */
@@ -132,6 +143,7 @@ struct eth_dev {
 	unsigned		zlp:1;
 	unsigned		cdc:1;
 	unsigned		rndis:1;
+	unsigned		ncm:1;
 	unsigned		suspended:1;
 	unsigned		network_started:1;
 	u16			cdc_filter;
@@ -140,6 +152,11 @@ struct eth_dev {
 #define	WORK_RX_MEMORY		0
 	int			rndis_config;
 	u8			host_mac[ETH_ALEN];
+#ifdef	CONFIG_USB_ETH_NCM
+	u32			ntb_in_size;	/* host's dwNtbInMaxSize */
+	u16			ntb_seq;	/* wSequence of next IN NTB */
+	unsigned		ntb_rx_len;	/* bytes of the NTB in ncm_rx_buf */
+#endif
 };
 
 /*
@@ -178,6 +195,16 @@ static inline int rndis_active(struct eth_dev *dev)
 #endif
 }
 
+/* NCM replaces CDC Ethernet as the "main" config; it is still "cdc" */
+static inline int ncm_active(struct eth_dev *dev)
+{
+#ifdef	CONFIG_USB_ETH_NCM
+	return dev->ncm && !rndis_active(dev);
+#else
+	return 0;
+#endif
+}
+
 #define	subset_active(dev)	(!is_cdc(dev) && !rndis_active(dev))
 #define	cdc_active(dev)		(is_cdc(dev) && !rndis_active(dev))
 
@@ -314,6 +341,7 @@ static char host_addr[18];
 #define STRING_SUBSET			8
 #define STRING_RNDIS			9
 #define STRING_SERIALNUMBER		10
+#define STRING_NCM			11
 
 /* holds our biggest descriptor (or RNDIS response) */
 #define USB_BUFSIZ	256
@@ -329,7 +357,7 @@ static char host_addr[18];
  * to recharge batteries ...
  */
 
-#define DEV_CONFIG_VALUE	1	/* cdc or subset */
+#define DEV_CONFIG_VALUE	1	/* cdc, ncm or subset */
 #define DEV_RNDIS_CONFIG_VALUE	2	/* rndis; optional */
 
 static struct usb_device_descriptor
@@ -615,6 +643,92 @@ rndis_data_intf = {
 
 #endif
 
+#ifdef	CONFIG_USB_ETH_NCM
+
+/*
+ * NCM looks just like CDC Ethernet on the wire except for the subclass
+ * and protocol codes, the NCM functional descriptor, and NTB framing.
+ * The status endpoint is mandatory, as it is for RNDIS.
+ */
+
+static const struct usb_interface_descriptor
+ncm_control_intf = {
+	.bLength =		sizeof ncm_control_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	.bInterfaceNumber =	0,
+	.bNumEndpoints =	1,
+	.bInterfaceClass =	USB_CLASS_COMM,
+	.bInterfaceSubClass =	USB_CDC_SUBCLASS_NCM,
+	.bInterfaceProtocol =	USB_CDC_PROTO_NONE,
+	.iInterface =		STRING_CONTROL,
+};
+
+static const struct usb_cdc_ncm_desc ncm_desc = {
+	.bLength =		sizeof ncm_desc,
+	.bDescriptorType =	USB_DT_CS_INTERFACE,
+	.bDescriptorSubType =	USB_CDC_NCM_TYPE,
+
+	.bcdNcmVersion =	__constant_cpu_to_le16(0x0100),
+	/* SET_ETHERNET_PACKET_FILTER only; NTB16 without CRC */
+	.bmNetworkCapabilities = USB_CDC_NCM_NCAP_ETH_FILTER,
+};
+
+static const struct usb_interface_descriptor
+ncm_data_nop_intf = {
+	.bLength =		sizeof ncm_data_nop_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	.bInterfaceNumber =	1,
+	.bAlternateSetting =	0,
+	.bNumEndpoints =	0,
+	.bInterfaceClass =	USB_CLASS_CDC_DATA,
+	.bInterfaceSubClass =	0,
+	.bInterfaceProtocol =	USB_CDC_NCM_PROTO_NTB,
+};
+
+static const struct usb_interface_descriptor
+ncm_data_intf = {
+	.bLength =		sizeof ncm_data_intf,
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	.bInterfaceNumber =	1,
+	.bAlternateSetting =	1,
+	.bNumEndpoints =	2,
+	.bInterfaceClass =	USB_CLASS_CDC_DATA,
+	.bInterfaceSubClass =	0,
+	.bInterfaceProtocol =	USB_CDC_NCM_PROTO_NTB,
+	.iInterface =		STRING_DATA,
+};
+
+/*
+ * NTB sizing.  IN NTBs carry one datagram each, since U-Boot's network
+ * stack hands us one frame at a time and waits for it to go out; OUT
+ * NTBs are where the host gets to batch frames, so give it room.
+ */
+#define NCM_NTB_IN_SIZE		2048	/* smallest the spec allows */
+#define NCM_NTB_OUT_SIZE	8192
+#define NCM_NTB_OUT_MAX_DGRAMS	0	/* no limit */
+#define NCM_NDP_DIVISOR		4
+#define NCM_NDP_ALIGN		4
+
+static const struct usb_cdc_ncm_ntb_parameters ntb_parameters = {
+	.wLength =		__constant_cpu_to_le16(sizeof ntb_parameters),
+	.bmNtbFormatsSupported = __constant_cpu_to_le16(
+					USB_CDC_NCM_NTB16_SUPPORTED),
+	.dwNtbInMaxSize =	__constant_cpu_to_le32(NCM_NTB_IN_SIZE),
+	.wNdpInDivisor =	__constant_cpu_to_le16(NCM_NDP_DIVISOR),
+	.wNdpInPayloadRemainder = __constant_cpu_to_le16(0),
+	.wNdpInAlignment =	__constant_cpu_to_le16(NCM_NDP_ALIGN),
+	.dwNtbOutMaxSize =	__constant_cpu_to_le32(NCM_NTB_OUT_SIZE),
+	.wNdpOutDivisor =	__constant_cpu_to_le16(NCM_NDP_DIVISOR),
+	.wNdpOutPayloadRemainder = __constant_cpu_to_le16(0),
+	.wNdpOutAlignment =	__constant_cpu_to_le16(NCM_NDP_ALIGN),
+	.wNtbOutMaxDatagrams =	__constant_cpu_to_le16(NCM_NTB_OUT_MAX_DGRAMS),
+};
+
+#endif	/* NCM */
+
 #ifdef DEV_CONFIG_SUBSET
 
 /*
@@ -713,6 +827,24 @@ static const struct usb_descriptor_header *fs_rndis_function[] = {
 };
 #endif
 
+#ifdef	CONFIG_USB_ETH_NCM
+static const struct usb_descriptor_header *fs_ncm_function[] = {
+	(struct usb_descriptor_header *) &otg_descriptor,
+	(struct usb_descriptor_header *) &ncm_control_intf,
+	(struct usb_descriptor_header *) &header_desc,
+	(struct usb_descriptor_header *) &union_desc,
+	(struct usb_descriptor_header *) &ether_desc,
+	(struct usb_descriptor_header *) &ncm_desc,
+	(struct usb_descriptor_header *) &fs_status_desc,
+	/* data interface, with altsetting */
+	(struct usb_descriptor_header *) &ncm_data_nop_intf,
+	(struct usb_descriptor_header *) &ncm_data_intf,
+	(struct usb_descriptor_header *) &fs_source_desc,
+	(struct usb_descriptor_header *) &fs_sink_desc,
+	NULL,
+};
+#endif
+
 /*
  * usb 2.0 devices need to expose both high speed and full speed
  * descriptors, unless they only run at full speed.
@@ -813,6 +945,24 @@ static const struct usb_descriptor_header *hs_rndis_function[] = {
 };
 #endif
 
+#ifdef	CONFIG_USB_ETH_NCM
+static const struct usb_descriptor_header *hs_ncm_function[] = {
+	(struct usb_descriptor_header *) &otg_descriptor,
+	(struct usb_descriptor_header *) &ncm_control_intf,
+	(struct usb_descriptor_header *) &header_desc,
+	(struct usb_descriptor_header *) &union_desc,
+	(struct usb_descriptor_header *) &ether_desc,
+	(struct usb_descriptor_header *) &ncm_desc,
+	(struct usb_descriptor_header *) &hs_status_desc,
+	/* data interface, with altsetting */
+	(struct usb_descriptor_header *) &ncm_data_nop_intf,
+	(struct usb_descriptor_header *) &ncm_data_intf,
+	(struct usb_descriptor_header *) &hs_source_desc,
+	(struct usb_descriptor_header *) &hs_sink_desc,
+	NULL,
+};
+#endif
+
 
 /* maxpacket and other transfer characteristics vary by speed. */
 static inline struct usb_endpoint_descriptor *
@@ -852,6 +1002,9 @@ static struct usb_string		strings[] = {
 #ifdef	CONFIG_USB_ETH_RNDIS
 	{ STRING_RNDIS,		"RNDIS", },
 	{ STRING_RNDIS_CONTROL,	"RNDIS Communications Control", },
+#endif
+#ifdef	CONFIG_USB_ETH_NCM
+	{ STRING_NCM,		"CDC NCM", },
 #endif
 	{  }		/* end of list */
 };
@@ -864,6 +1017,11 @@ static struct usb_gadget_strings	stringtab = {
 /*============================================================================*/
 static u8 control_req[USB_BUFSIZ];
 static u8 status_req[STATUS_BYTECOUNT] __attribute__ ((aligned(4)));
+#ifdef	CONFIG_USB_ETH_NCM
+static u8 ncm_rx_buf[NCM_NTB_OUT_SIZE] __attribute__ ((aligned(4)));
+static u8 ncm_tx_buf[NCM_NTB_IN_SIZE] __attribute__ ((aligned(4)));
+static unsigned usbnet_ncm = 1;		/* cleared by "usbnet_mode=ecm" */
+#endif
 
 
 /**
@@ -922,6 +1080,12 @@ config_buf(struct usb_gadget *g, u8 *buf, u8 type, unsigned index, int is_otg)
 		config = &rndis_config;
 		function = which_fn(rndis);
 	} else
+#endif
+#ifdef	CONFIG_USB_ETH_NCM
+	if (((struct eth_dev *) get_gadget_data(g))->ncm) {
+		config = &eth_config;
+		function = which_fn(ncm);
+	} else
 #endif
 	{
 		config = &eth_config;
@@ -1122,9 +1286,11 @@ static int eth_set_config(struct eth_dev *dev, unsigned number,
 				speed, number, power, driver_desc,
 				rndis_active(dev)
 					? "RNDIS"
+					: (ncm_active(dev)
+						? "CDC NCM"
 					: (cdc_active(dev)
 						? "CDC Ethernet"
-						: "CDC Ethernet Subset"));
+						: "CDC Ethernet Subset")));
 	}
 	return result;
 }
@@ -1251,6 +1417,38 @@ static void rndis_command_complete(struct usb_ep *ep, struct usb_request *req)
 
 #endif	/* RNDIS */
 
+#ifdef	CONFIG_USB_ETH_NCM
+
+static void ncm_reset_ntb(struct eth_dev *dev)
+{
+	dev->ntb_in_size = NCM_NTB_IN_SIZE;
+	dev->ntb_seq = 0;
+	dev->ntb_rx_len = 0;
+}
+
+static void ncm_input_size_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	struct eth_dev	*dev = ep->driver_data;
+	__le32		size;
+
+	/* received dwNtbInMaxSize (and maybe wNtbInMaxDatagrams) */
+	if (req->status || req->actual < sizeof size) {
+		debug("ntb input size complete --> %d, %d/%d\n",
+			req->status, req->actual, req->length);
+		return;
+	}
+	memcpy(&size, req->buf, sizeof size);
+
+	/* we never build IN NTBs bigger than the spec's minimum */
+	if (le32_to_cpu(size) < NCM_NTB_IN_SIZE) {
+		debug("ntb input size %u too small\n", le32_to_cpu(size));
+		return;
+	}
+	dev->ntb_in_size = le32_to_cpu(size);
+}
+
+#endif	/* NCM */
+
 /*
  * The setup() callback implements all the ep0 functionality that's not
  * handled lower down.  CDC has a number of less-common features:
@@ -1383,6 +1581,10 @@ eth_setup(struct usb_gadget *gadget, const struct usb_ctrlrequest *ctrl)
 				usb_ep_enable(dev->in_ep, dev->in);
 				usb_ep_enable(dev->out_ep, dev->out);
 				dev->cdc_filter = DEFAULT_FILTER;
+#ifdef	CONFIG_USB_ETH_NCM
+				if (ncm_active(dev))
+					ncm_reset_ntb(dev);
+#endif
 				if (dev->status)
 					issue_start_status(dev);
 				eth_start(dev, GFP_ATOMIC);
@@ -1445,6 +1647,77 @@ done_set_intf:
 
 #endif /* DEV_CONFIG_CDC */
 
+#ifdef CONFIG_USB_ETH_NCM
+	/*
+	 * NCM adds its own requests (6.2) to the CDC Ethernet ones, all on
+	 * the control interface.  We only do NTB16 without CRCs, so the
+	 * format and CRC requests just have to agree with those defaults.
+	 */
+	case USB_CDC_GET_NTB_PARAMETERS:
+		if (ctrl->bRequestType != (USB_DIR_IN|USB_TYPE_CLASS
+						|USB_RECIP_INTERFACE)
+				|| !ncm_active(dev)
+				|| wValue
+				|| wIndex != 0)
+			break;
+		value = min(wLength, (u16) sizeof ntb_parameters);
+		memcpy(req->buf, &ntb_parameters, value);
+		break;
+
+	case USB_CDC_GET_NTB_INPUT_SIZE: {
+		__le32	size;
+
+		if (ctrl->bRequestType != (USB_DIR_IN|USB_TYPE_CLASS
+						|USB_RECIP_INTERFACE)
+				|| !ncm_active(dev)
+				|| wLength < 4
+				|| wValue
+				|| wIndex != 0)
+			break;
+		size = cpu_to_le32(dev->ntb_in_size);
+		memcpy(req->buf, &size, sizeof size);
+		value = sizeof size;
+		break;
+	}
+
+	case USB_CDC_SET_NTB_INPUT_SIZE:
+		if (ctrl->bRequestType != (USB_TYPE_CLASS|USB_RECIP_INTERFACE)
+				|| !ncm_active(dev)
+				|| (wLength != 4 && wLength != 8)
+				|| wValue
+				|| wIndex != 0)
+			break;
+		/* read the new size, then apply it */
+		value = wLength;
+		req->complete = ncm_input_size_complete;
+		break;
+
+	case USB_CDC_GET_NTB_FORMAT:
+	case USB_CDC_GET_CRC_MODE:
+		if (ctrl->bRequestType != (USB_DIR_IN|USB_TYPE_CLASS
+						|USB_RECIP_INTERFACE)
+				|| !ncm_active(dev)
+				|| wLength < 2
+				|| wValue
+				|| wIndex != 0)
+			break;
+		/* NTB16_FORMAT and CRC_NOT_APPENDED are both zero */
+		memset(req->buf, 0, 2);
+		value = 2;
+		break;
+
+	case USB_CDC_SET_NTB_FORMAT:
+	case USB_CDC_SET_CRC_MODE:
+		if (ctrl->bRequestType != (USB_TYPE_CLASS|USB_RECIP_INTERFACE)
+				|| !ncm_active(dev)
+				|| wLength != 0
+				|| wValue != 0
+				|| wIndex != 0)
+			break;
+		value = 0;
+		break;
+#endif	/* NCM */
+
 #ifdef CONFIG_USB_ETH_RNDIS
 	/*
 	 * RNDIS uses the CDC command encapsulation mechanism to implement
@@ -1551,6 +1824,14 @@ static int rx_submit(struct eth_dev *dev, struct usb_request *req,
 
 	req->buf = (u8 *) NetRxPackets[0];
 	req->length = size;
+#ifdef	CONFIG_USB_ETH_NCM
+	/* NTBs are framed internally; let the host batch up to a full one */
+	if (ncm_active(dev)) {
+		req->buf = ncm_rx_buf;
+		req->length = NCM_NTB_OUT_SIZE;
+		dev->ntb_rx_len = 0;
+	}
+#endif
 	req->complete = rx_complete;
 
 	retval = usb_ep_queue(dev->out_ep, req, gfp_flags);
@@ -1569,6 +1850,13 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 	switch (req->status) {
 	/* normal completion */
 	case 0:
+#ifdef	CONFIG_USB_ETH_NCM
+		/* datagrams are checked and counted by ncm_rx_ntb() */
+		if (ncm_active(dev)) {
+			dev->ntb_rx_len = req->actual;
+			break;
+		}
+#endif
 		if (rndis_active(dev)) {
 			/* we know MaxPacketsPerTransfer == 1 here */
 			int length = rndis_rm_hdr(req->buf, req->actual);
@@ -1909,6 +2197,101 @@ static int rndis_control_ack(struct eth_device *net)
 
 #endif	/* RNDIS */
 
+/*-------------------------------------------------------------------------*/
+
+#ifdef	CONFIG_USB_ETH_CSUM
+/*
+ * Checksum offload, done in software where frames change hands: a
+ * received frame with a bad IPv4 header or UDP checksum is dropped
+ * before NetReceive(), and UDP datagrams the stack sends without a
+ * checksum get one.
+ */
+static int eth_rx_csum_ok(struct eth_dev *dev, volatile uchar *frame, int len)
+{
+	if (!eth_csum_rx_check((uint8_t *) frame, len))
+		return 1;
+
+	dev->stats.rx_errors++;
+	dev->stats.rx_crc_errors++;
+	debug("rx checksum error, %d bytes\n", len);
+	return 0;
+}
+#else
+#define eth_rx_csum_ok(dev, frame, len)	1
+#endif
+
+#ifdef	CONFIG_USB_ETH_NCM
+
+/*
+ * Wrap one frame into a single-datagram NTB16 in ncm_tx_buf, returning
+ * the NTB length.  Batching on IN would buy nothing: the network stack
+ * waits for every frame to be sent before producing the next one.  The
+ * NTB may be no longer than the host's dwNtbInMaxSize.
+ */
+static int ncm_tx_ntb(struct eth_dev *dev, volatile void *packet, int length)
+{
+	int	total;
+
+	total = ncm_ntb16_single(ncm_tx_buf,
+			min(dev->ntb_in_size, (u32) sizeof ncm_tx_buf),
+			dev->ntb_seq, (void *) packet, length);
+	if (total < 0)
+		return -EMSGSIZE;
+
+	dev->ntb_seq++;
+	return total;
+}
+
+/*
+ * Hand every datagram of a received NTB16 to the network stack.  The NTB
+ * stays intact until all of them are consumed, since rx_req is requeued
+ * only afterwards, and any replies NetReceive() sends go out via tx_req.
+ * The NTB itself is checked by the helpers in <usb/ncm.h>.
+ */
+static void ncm_rx_ntb(struct eth_dev *dev, u8 *ntb, unsigned len)
+{
+	struct ncm_ntb16	it;
+	uint32_t		index, dlen;
+	volatile uchar		*dgram;
+	int			ret;
+
+	/* nothing arrived; rx_complete() already counted the error */
+	if (!len)
+		return;
+
+	if (ncm_ntb16_begin(&it, ntb, len))
+		goto bad_ntb;
+
+	while ((ret = ncm_ntb16_next(&it, &index, &dlen)) > 0) {
+		if (dlen < ETH_HLEN || dlen > ETH_FRAME_LEN) {
+			dev->stats.rx_errors++;
+			dev->stats.rx_length_errors++;
+			debug("ntb datagram %u/%u\n", index, dlen);
+			continue;
+		}
+
+		dev->stats.rx_packets++;
+		dev->stats.rx_bytes += dlen;
+
+		/* keep the IP header as aligned as the stack expects */
+		dgram = ntb + index;
+		if (index % NCM_NDP_DIVISOR) {
+			memcpy((void *) NetRxPackets[0], (void *) dgram, dlen);
+			dgram = NetRxPackets[0];
+		}
+		if (eth_rx_csum_ok(dev, dgram, dlen))
+			NetReceive(dgram, dlen);
+	}
+	if (!ret)
+		return;
+
+bad_ntb:
+	dev->stats.rx_errors++;
+	debug("bad ntb, %u bytes\n", len);
+}
+
+#endif	/* NCM */
+
 static void eth_start(struct eth_dev *dev, gfp_t gfp_flags)
 {
 	if (rndis_active(dev)) {
@@ -2007,7 +2390,7 @@ static int get_ether_addr(const char *str, u8 *dev_addr)
 static int eth_bind(struct usb_gadget *gadget)
 {
 	struct eth_dev		*dev = &l_ethdev;
-	u8			cdc = 1, zlp = 1, rndis = 1;
+	u8			cdc = 1, zlp = 1, rndis = 1, ncm;
 	struct usb_ep		*in_ep, *out_ep, *status_ep = NULL;
 	int			status = -ENOMEM;
 	int			gcnum;
@@ -2019,6 +2402,11 @@ static int eth_bind(struct usb_gadget *gadget)
 #endif
 #ifndef	CONFIG_USB_ETH_RNDIS
 	rndis = 0;
+#endif
+#ifdef	CONFIG_USB_ETH_NCM
+	ncm = usbnet_ncm;
+#else
+	ncm = 0;
 #endif
 	/*
 	 * Because most host side USB stacks handle CDC Ethernet, that
@@ -2147,7 +2535,12 @@ autoconf_fail:
 	}
 #endif
 
-	/* one config:  cdc, else minimal subset */
+	/* NCM needs the status endpoint; without one, fall back to ECM */
+	if (!cdc || !status_ep)
+		ncm = 0;
+
+	/* one config:  cdc (maybe ncm), else minimal subset */
+	eth_config.iConfiguration = ncm ? STRING_NCM : STRING_CDC;
 	if (!cdc) {
 		eth_config.bNumInterfaces = 1;
 		eth_config.iConfiguration = STRING_SUBSET;
@@ -2203,7 +2596,11 @@ autoconf_fail:
 	dev->net = &l_netdev;
 
 	dev->cdc = cdc;
+	dev->ncm = ncm;
 	dev->zlp = zlp;
+#ifdef	CONFIG_USB_ETH_NCM
+	ncm_reset_ntb(dev);
+#endif
 
 	dev->in_ep = in_ep;
 	dev->out_ep = out_ep;
@@ -2365,6 +2762,12 @@ static int usb_eth_init(struct eth_device *netdev, bd_t *bd)
 		goto fail;
 	}
 
+#ifdef CONFIG_USB_ETH_NCM
+	/* NCM unless the user asks for plain CDC Ethernet */
+	usbnet_ncm = !(getenv("usbnet_mode")
+			&& !strcmp(getenv("usbnet_mode"), "ecm"));
+#endif
+
 	if (usb_gadget_register_driver(&eth_driver) < 0)
 		goto fail;
 
@@ -2408,6 +2811,10 @@ static int usb_eth_send(struct eth_device *netdev,
 
 	debug("%s:...\n", __func__);
 
+#ifdef	CONFIG_USB_ETH_CSUM
+	eth_csum_tx_fill((uint8_t *) packet, length);
+#endif
+
 	/* new buffer is needed to include RNDIS header */
 	if (rndis_active(dev)) {
 		rndis_pkt = malloc(length +
@@ -2422,6 +2829,16 @@ static int usb_eth_send(struct eth_device *netdev,
 		packet = rndis_pkt;
 		length += sizeof(struct rndis_packet_msg_type);
 	}
+#ifdef	CONFIG_USB_ETH_NCM
+	if (ncm_active(dev)) {
+		length = ncm_tx_ntb(dev, packet, length);
+		if (length < 0) {
+			error("frame too big for NTB");
+			goto drop;
+		}
+		packet = ncm_tx_buf;
+	}
+#endif
 	req->buf = (void *)packet;
 	req->context = NULL;
 	req->complete = tx_complete;
@@ -2475,7 +2892,15 @@ static int usb_eth_recv(struct eth_device *netdev)
 	if (packet_received) {
 		debug("%s: packet received\n", __func__);
 		if (dev->rx_req) {
-			NetReceive(NetRxPackets[0], dev->rx_req->length);
+#ifdef	CONFIG_USB_ETH_NCM
+			if (ncm_active(dev))
+				ncm_rx_ntb(dev, ncm_rx_buf, dev->ntb_rx_len);
+			else
+#endif
+			if (eth_rx_csum_ok(dev, NetRxPackets[0],
+					   dev->rx_req->length))
+				NetReceive(NetRxPackets[0],
+					   dev->rx_req->length);
 			packet_received = 0;
 
 			rx_submit(dev, dev->rx_req, 0);
@@ -98,6 +98,10 @@ extern int do_reset(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
 
 extern int do_bootm(cmd_tbl_t *, int, int, char * const []);
 
+#ifdef CONFIG_NAND_STATS
+extern int nand_stats_sync(void);
+#endif
+
 struct fastboot_dev {
 	struct usb_gadget	*gadget;
 	struct usb_request	*req;
@@ -317,6 +321,9 @@ static int fastboot_nand_erase(const char *name)
 		return -EINVAL;
 	printf("partition '%s' erased\n", part->name);
 	printf("from %x size: %x\n", part->offset, part->size);
+#ifdef CONFIG_NAND_STATS
+	nand_stats_sync();
+#endif
 
 	return 0;
 }
@@ -326,14 +333,29 @@ static int fastboot_nand_write(const char *name)
 	struct mtd_device	*dev;
 	struct part_info	*part;
 	u8			pnum;
+	size_t			len;
+	int			ret;
 
 	if (find_dev_and_part(name, &dev, &pnum, &part)) {
 		printf("Partition %s not found!\n", name);
 		return -ENODEV;
 	}
 
-	return nand_write_skip_bad(&nand_info[0], part->offset,
-					&part->size, (u8 *)kernel_addr);
+	/* just the downloaded image in whole pages, not the partition */
+	len = (kernel_size + nand_info[0].writesize - 1) &
+		~(nand_info[0].writesize - 1);
+	if (len > part->size) {
+		printf("image too large for partition %s\n", name);
+		return -ENOSPC;
+	}
+
+	ret = nand_write_skip_bad(&nand_info[0], part->offset,
+					&len, (u8 *)kernel_addr);
+#ifdef CONFIG_NAND_STATS
+	if (!ret)
+		nand_stats_sync();
+#endif
+	return ret;
 }
 
 static int fastboot_image_is_boot(void)
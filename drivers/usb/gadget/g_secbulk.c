@@ -29,11 +29,13 @@
 #include <malloc.h>
 #include <asm/errno.h>
 #include <asm/io.h>
+#include <asm/unaligned.h>
 #include <asm/arch/s3c24x0_cpu.h>
 
 #include <linux/usb/ch9.h>
 #include <linux/usb/gadget.h>
 #include <linux/usb/compat.h>
+#include <usb/secbulk.h>
 
 #ifdef DEBUG
 #undef debug
@@ -56,6 +58,9 @@
 /* big enough to hold our biggest descriptor */
 #define USB_BUFSIZ		256
 
+/* bulk OUT buffer, takes a whole chunk payload */
+#define SECBULK_BUFSIZ		SECBULK_CHUNK_MAX
+
 /* secbulk has only one configuration, it's 1 */
 #define SECBULK_CONFIG		1
 
@@ -67,15 +72,33 @@ struct secbulk_dev {
 	struct usb_ep		*out_ep;
 
 	struct usb_request	*rx_req;
+	u8			*rx_buf;	/* bounce buffer of rx_req */
+	u32			copied;		/* bytes bounced this download */
+
+	/* original protocol, a single stream */
+	u32			download_addr;
+	u32			count;
+	u32			downloaded_count;
+	u16			sum;		/* of the image so far */
+
+	/*
+	 * chunked protocol, see <usb/secbulk.h>; survives disconnects
+	 * and configuration changes so the host can resume
+	 */
+	struct secbulk_chunk	chunk;		/* header of chunk in flight */
+	int			chunk_ok;	/* header was accepted */
+	u32			state;
+	u32			addr;
+	u32			total;
+	u32			received;
+	u32			next_seq;
+	u32			errors;
 };
 
 static char		manufacturer[64] = DRIVER_MANUFACTURER;
 static char		product_desc[30] = DRIVER_DESC;
 static char		serial[20] = "Date: Jan 11, 2012";
 
-volatile u32 download_addr;
-volatile u32 count;
-
 /* Static strings, in UTF-8 (for simplicity we use only ASCII characters */
 static struct usb_string strings[] = {
 	{ STRING_MANUFACTURER,	manufacturer, },
@@ -151,17 +174,6 @@ static const struct usb_descriptor_header *fs_function[] = {
 	NULL,
 };
 
-static u_int16_t secbulk_checksum(const unsigned char *data, u_int32_t len)
-{
-	u_int16_t checksum = 0;
-	int i;
-
-	for (i = 0; i < len; i++)
-		checksum += data[i];
-
-	return checksum;
-}
-
 static int config_buf(struct usb_gadget *gadget,
 		u8 *buf, u8 type, unsigned index)
 {
@@ -179,68 +191,251 @@ static int config_buf(struct usb_gadget *gadget,
 	return len;
 }
 
-static void secbulk_handle_bulk_out(struct usb_ep *ep, struct usb_request *req)
+/*
+ * A download must lie in SDRAM below U-Boot: under _armboot_start are
+ * the malloc arena, global data and stacks, above it code, bss and the
+ * frame buffer.  Both protocols point the UDC straight at the host's
+ * address, so check before the first byte goes there.
+ */
+static int secbulk_range_ok(u32 addr, u32 len)
 {
-	static u32	downloaded_count = 0;
-	static int	first_pkt = 1;
+	u32	end = _armboot_start - CONFIG_SYS_MALLOC_LEN
+			- CONFIG_SYS_GBL_DATA_SIZE - CONFIG_STACKSIZE;
+
+#ifdef CONFIG_USE_IRQ
+	end -= CONFIG_STACKSIZE_IRQ + CONFIG_STACKSIZE_FIQ;
+#endif
+	return addr >= PHYS_SDRAM_1 && addr < end && len <= end - addr;
+}
+
+/*
+ * The original protocol: 8 byte header, image, 16-bit sum.  Only the
+ * first packet goes through the bounce buffer; after the header the
+ * request points at where the rest of the stream belongs, so the UDC
+ * unloads its FIFO straight into place.
+ */
+static void secbulk_v1_data(struct secbulk_dev *dev, struct usb_request *req)
+{
+	u8		*buf = req->buf;
+	unsigned	nbytes = req->actual;
 	u8		*tmp_addr;
-	u8		*buf;
 	u16		checksum1;	/* read from usb packet */
 	u16		checksum2;	/* calculated from memory */
-	unsigned	nbytes;
+	u32		image;
 
-	buf = req->buf;
+	tmp_addr = (u8 *)dev->download_addr + dev->downloaded_count;
 
-	if (first_pkt) {
-		first_pkt = 0;
-		download_addr = *((u8 *)(buf + 0)) +
-			(*((u8 *)(buf + 1)) << 8) +
-			(*((u8 *)(buf + 2)) << 16) +
-			(*((u8 *)(buf + 3)) << 24);
+	if (!dev->count) {
+		dev->download_addr = get_unaligned_le32(buf);
+		dev->count = get_unaligned_le32(buf + 4);
+		dev->sum = 0;
+		dev->copied = 0;
 
-		count = *((u8 *)(buf + 4)) +
-			(*((u8 *)(buf + 5)) << 8) +
-			(*((u8 *)(buf + 6)) << 16) +
-			(*((u8 *)(buf + 7)) << 24);
-
-		buf = req->buf + 8;
-		req->actual -= 8;
+		buf += 8;
+		nbytes -= 8;
 
 		debugX("load addr: %#x, total count: %d(%x)\n",
-				download_addr, count, count);
-	}
+				dev->download_addr, dev->count, dev->count);
+
+		/* count covers header and sum, and the first packet */
+		if (dev->count < 10 || nbytes > dev->count - 8
+				|| !secbulk_range_ok(dev->download_addr,
+					dev->count - 8)) {
+			printf("secbulk: %u bytes at %#x rejected\n",
+					dev->count, dev->download_addr);
+			dev->download_addr = 0;
+			dev->count = 0;
+			return;
+		}
 
-	tmp_addr = (u8 *)download_addr + downloaded_count;
+		tmp_addr = (u8 *)dev->download_addr;
+		memcpy(tmp_addr, buf, nbytes);
+		dev->copied += nbytes;
+	}
 
-	nbytes = req->actual;
+	/*
+	 * sum the packet while it is still in the cache; the last two
+	 * bytes of the stream are the checksum itself and are left out
+	 */
+	image = dev->count - 10;
+	if (dev->downloaded_count < image)
+		dev->sum = secbulk_sum(tmp_addr,
+				min(nbytes, image - dev->downloaded_count),
+				dev->sum);
+
+	dev->downloaded_count += nbytes;
+
+	if (dev->downloaded_count < dev->count - 8) {
+		req->buf = (u8 *)dev->download_addr + dev->downloaded_count;
+		req->length = dev->count - 8 - dev->downloaded_count;
+		return;
+	}
 
-	memcpy(tmp_addr, buf, nbytes);
-	downloaded_count += nbytes;
+	req->buf = dev->rx_buf;
+	req->length = USB_BUFSIZ;
 
-	if (downloaded_count == count - 8) {
-		tmp_addr = (u8 *)(download_addr + downloaded_count);
+	if (dev->downloaded_count == dev->count - 8) {
+		tmp_addr = (u8 *)(dev->download_addr + dev->downloaded_count);
 		checksum1 = *(tmp_addr - 2) + (*(tmp_addr - 1) << 8);
+		checksum2 = dev->sum;
 
-		/*
-		 * calculate checksum, last two bytes which
-		 * is checksum data is excluded
-		 */
-		checksum2 = secbulk_checksum((u8 *)download_addr,
-				downloaded_count - 2);
 		if (checksum1 == checksum2)
 			debugX("done, checksum: %04x\n", checksum1);
 		else
 			debugX("failed, checksum: %04x, %04x\n",
 					checksum1, checksum2);
-		first_pkt = 1;
+		debugX("%u of %u bytes copied\n",
+				dev->copied, dev->downloaded_count);
+
+		tmp_addr = (u8 *)dev->download_addr;
+		dev->download_addr = 0;
+		dev->count = 0;
+		dev->downloaded_count = 0;
+
+		printf("Starting at 0x%08x ...\n", (u32)tmp_addr);
+
+		do_go_exec((void *)tmp_addr);
+	}
+}
+
+static void secbulk_chunk_header(struct secbulk_dev *dev,
+		struct usb_request *req)
+{
+	struct secbulk_chunk	*c = &dev->chunk;
+
+	memcpy(c, req->buf, sizeof(*c));
+	c->seq = le32_to_cpu(c->seq);
+	c->addr = le32_to_cpu(c->addr);
+	c->total = le32_to_cpu(c->total);
+	c->offset = le32_to_cpu(c->offset);
+	c->len = le16_to_cpu(c->len);
+	c->csum = le16_to_cpu(c->csum);
+
+	/* an unusable length can't even be skipped; drop until resync */
+	if (!c->len || c->len > SECBULK_CHUNK_MAX) {
+		debugX("chunk %u: bad length %u\n", c->seq, c->len);
+		dev->errors++;
+		return;
+	}
+
+	if (c->offset == 0 && !secbulk_range_ok(c->addr, c->total)) {
+		printf("secbulk: %u bytes at %#x rejected\n",
+				c->total, c->addr);
+		dev->chunk_ok = 0;
+		dev->errors++;
+		goto payload;
+	}
 
-		printf("Starting at 0x%08x ...\n", download_addr);
+	if (c->offset == 0) {
+		dev->addr = c->addr;
+		dev->total = c->total;
+		dev->received = 0;
+		dev->next_seq = c->seq;
+		dev->errors = 0;
+		dev->copied = 0;
+
+		debugX("load addr: %#x, total count: %d(%x), chunked\n",
+				dev->addr, dev->total, dev->total);
+	}
 
-		do_go_exec((void *) download_addr);
-		download_addr = 0;
-		count = 0;
-		downloaded_count = 0;
+	/* the payload follows either way, swallow it if we don't want it */
+	dev->chunk_ok = c->addr == dev->addr && c->total == dev->total
+		&& c->seq == dev->next_seq && c->offset == dev->received
+		&& c->len <= dev->total - dev->received;
+	if (!dev->chunk_ok) {
+		debug("chunk %u: offset %u rejected, expected %u at %u\n",
+				c->seq, c->offset, dev->next_seq,
+				dev->received);
+		dev->errors++;
 	}
+
+payload:
+	/* wanted payload goes straight into place, the rest is dropped */
+	dev->state = SECBULK_STATE_PAYLOAD;
+	req->buf = dev->chunk_ok ? (u8 *)dev->addr + c->offset : dev->rx_buf;
+	req->length = c->len;
+}
+
+static void secbulk_chunk_payload(struct secbulk_dev *dev,
+		struct usb_request *req)
+{
+	struct secbulk_chunk	*c = &dev->chunk;
+
+	dev->state = SECBULK_STATE_IDLE;
+	req->buf = dev->rx_buf;
+	req->length = USB_BUFSIZ;
+
+	if (!dev->chunk_ok)
+		return;
+
+	/* a bad chunk lies beyond "received" and is simply sent again */
+	if (req->actual != c->len || secbulk_sum((u8 *)dev->addr + c->offset,
+				c->len, 0) != c->csum) {
+		debugX("chunk %u: bad payload, %u/%u bytes\n",
+				c->seq, req->actual, c->len);
+		dev->errors++;
+		return;
+	}
+
+	dev->received += c->len;
+	dev->next_seq++;
+
+	if (dev->received == dev->total) {
+		debugX("done, %u chunks, %u rejected, %u bytes copied\n",
+				dev->next_seq, dev->errors, dev->copied);
+		dev->state = SECBULK_STATE_DONE;
+
+		printf("Starting at 0x%08x ...\n", dev->addr);
+
+		do_go_exec((void *)dev->addr);
+	}
+}
+
+static int secbulk_chunked(struct secbulk_dev *dev)
+{
+	return dev->total && dev->received < dev->total;
+}
+
+static void secbulk_handle_bulk_out(struct secbulk_dev *dev,
+		struct usb_request *req)
+{
+	if (dev->state == SECBULK_STATE_PAYLOAD) {
+		secbulk_chunk_payload(dev, req);
+		return;
+	}
+
+	/* a v1 stream in progress has no headers to look for */
+	if (!dev->count && req->actual == sizeof(struct secbulk_chunk)
+			&& get_unaligned_le32(req->buf) == SECBULK_MAGIC) {
+		secbulk_chunk_header(dev, req);
+		return;
+	}
+
+	if (secbulk_chunked(dev)) {
+		/* stray data in the middle of a chunked download */
+		dev->errors++;
+		return;
+	}
+
+	if (dev->count || req->actual >= 8)
+		secbulk_v1_data(dev, req);
+}
+
+static int secbulk_get_status(struct secbulk_dev *dev, void *buf)
+{
+	struct secbulk_status	st;
+
+	st.magic = cpu_to_le32(SECBULK_MAGIC);
+	st.state = cpu_to_le32(dev->state);
+	st.addr = cpu_to_le32(dev->addr);
+	st.total = cpu_to_le32(dev->total);
+	st.received = cpu_to_le32(dev->received);
+	st.next_seq = cpu_to_le32(dev->next_seq);
+	st.errors = cpu_to_le32(dev->errors);
+	st.copied = cpu_to_le32(dev->copied);
+	memcpy(buf, &st, sizeof(st));
+
+	return sizeof(st);
 }
 
 static void secbulk_setup_complete(struct usb_ep *ep, struct usb_request *req)
@@ -252,6 +447,7 @@ static void secbulk_setup_complete(struct usb_ep *ep, struct usb_request *req)
 
 static void secbulk_rx_complete(struct usb_ep *ep, struct usb_request *req)
 {
+	struct secbulk_dev	*dev = ep->driver_data;
 	int			status = req->status;
 
 	debug("%s, status: %d\n", __func__, status);
@@ -261,15 +457,14 @@ static void secbulk_rx_complete(struct usb_ep *ep, struct usb_request *req)
 		/* bulk data received from host, deal with it and queue
 		 * later for next transfer, see below
 		 */
-		secbulk_handle_bulk_out(ep, req);
+		secbulk_handle_bulk_out(dev, req);
 		break;
 	case -ECONNABORTED:	/* hardware forced ep reset */
 	case -ECONNRESET:	/* request dequeued */
 	case -ESHUTDOWN:	/* disconnected from host */
+		/* secbulk_reset_config() frees the request */
 		debug("%s ep shutdown --> %d, %d/%d\n", ep->name,
 				status, req->actual, req->length);
-		kfree(req->buf);
-		usb_ep_free_request(ep, req);
 		return;
 
 	case -EOVERFLOW:	/* buffer overrun on read means that
@@ -301,8 +496,11 @@ static void secbulk_reset_config(struct secbulk_dev *dev)
 	/* disable endpoints, forcing completion of pending i/o */
 	usb_ep_disable(dev->out_ep);
 	if (dev->rx_req) {
+		/* rx_req->buf may point into a download */
+		kfree(dev->rx_buf);
 		usb_ep_free_request(dev->out_ep, dev->rx_req);
 		dev->rx_req = NULL;
+		dev->rx_buf = NULL;
 	}
 
 	dev->config = 0;
@@ -337,10 +535,23 @@ static int secbulk_set_cfg(struct secbulk_dev *dev)
 	dev->out_ep->driver_data = dev;
 
 	/* allocate buffer for bulk out endpoint */
-	dev->rx_req = secbulk_alloc_req(dev->out_ep, USB_BUFSIZ, GFP_KERNEL);
+	dev->rx_req = secbulk_alloc_req(dev->out_ep, SECBULK_BUFSIZ,
+			GFP_KERNEL);
 	if (!dev->rx_req)
 		return -ENOMEM;
 
+	/*
+	 * a half received chunk or v1 stream is lost, but what the chunked
+	 * protocol has verified so far stays for the host to resume from
+	 */
+	dev->rx_buf = dev->rx_req->buf;
+	dev->rx_req->length = USB_BUFSIZ;
+	if (dev->state == SECBULK_STATE_PAYLOAD)
+		dev->state = SECBULK_STATE_IDLE;
+	dev->download_addr = 0;
+	dev->count = 0;
+	dev->downloaded_count = 0;
+
 	dev->rx_req->complete = secbulk_rx_complete;
 	err = usb_ep_queue(dev->out_ep, dev->rx_req, GFP_ATOMIC);
 	if (err) {
@@ -359,6 +570,8 @@ static int secbulk_set_config(struct secbulk_dev *dev, unsigned number)
 	switch (number) {
 	case SECBULK_CONFIG:
 		result = secbulk_set_cfg(dev);
+		if (!result)
+			dev->config = number;
 		break;
 	default:
 		result = -EINVAL;
@@ -435,6 +648,14 @@ secbulk_setup(struct usb_gadget *gadget, const struct usb_ctrlrequest *ctrl)
 		value = min(wLength, (u16) 1);
 		break;
 
+	case SECBULK_REQ_STATUS:
+		if (ctrl->bRequestType
+				!= (USB_DIR_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE))
+			break;
+		value = secbulk_get_status(dev, req->buf);
+		value = min(wLength, (u16) value);
+		break;
+
 	default:
 		debugX("usb control req %02x.%02x v%04x i%04x l%02x\n",
 				ctrl->bRequestType, ctrl->bRequest,
@@ -501,8 +722,9 @@ static void secbulk_unbind(struct usb_gadget *gadget)
 
 	debug("%s\n", __func__);
 
-	if (dev->rx_req) {
-		usb_ep_free_request(dev->out_ep, dev->rx_req);
+	secbulk_reset_config(dev);
+	if (dev->req) {
+		usb_ep_free_request(gadget->ep0, dev->req);
 		dev->req = NULL;
 	}
 
@@ -517,10 +739,7 @@ static void secbulk_disconnect(struct usb_gadget *gadget)
 
 	debug("%s\n", __func__);
 
-	if (dev->config == 0)
-		return;
-
-	dev->config = 0;
+	secbulk_reset_config(dev);
 }
 
 static struct usb_gadget_driver secbulk_driver = {
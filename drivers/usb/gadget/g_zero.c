@@ -0,0 +1,625 @@
+/*
+ * g_zero.c -- Source/Sink and Loopback Gadget Driver
+ *
+ * Based on
+ * drivers/usb/gadget/g_secbulk.c
+ * Linux drivers/usb/gadget/zero.c, Copyright (C) 2003-2008 David Brownell
+ *
+ * Bulk throughput benchmark for the UDC: configuration 3 sources a
+ * fixed pattern on the IN endpoint and sinks whatever arrives on OUT,
+ * configuration 2 echoes every OUT transfer back on IN.  Neither looks
+ * at the data, so what tools/usbbench measures is the UDC driver and
+ * the bus, not protocol overhead.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307	 USA
+ *
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <asm/errno.h>
+
+#include <linux/usb/ch9.h>
+#include <linux/usb/gadget.h>
+#include <linux/usb/compat.h>
+
+#ifdef DEBUG
+#undef debug
+#define debug(fmt,args...)	serial_printf (fmt ,##args)
+#endif
+
+#undef debugX
+#define debugX(fmt,args...)	serial_printf (fmt ,##args)
+
+#define STRING_MANUFACTURER	1
+#define STRING_PRODUCT		2
+#define STRING_SERIAL		3
+#define STRING_SOURCE_SINK	4
+#define STRING_LOOPBACK		5
+
+/* same IDs as the Linux gadget, so usbtest/testusb work as well */
+#define ZERO_VENDOR_ID		0x0525	/* NetChip */
+#define ZERO_PRODUCT_ID		0xa4a0	/* Linux-USB "Gadget Zero" */
+
+#define DRIVER_DESC		"s3c24x0 zero gadget"
+#define DRIVER_MANUFACTURER	"U-Boot"
+
+/* big enough to hold our biggest descriptor */
+#define USB_BUFSIZ		256
+
+#define SOURCE_SINK_CONFIG	3
+#define LOOPBACK_CONFIG		2
+
+/* length of each bulk request, tools/usbbench defaults to the same */
+#define ZERO_BUFLEN		4096
+
+struct zero_dev {
+	struct usb_gadget	*gadget;
+	struct usb_request	*req;		/* for control responses */
+
+	u8			config;
+	struct usb_ep		*in_ep;
+	struct usb_ep		*out_ep;
+
+	struct usb_request	*in_req;
+	struct usb_request	*out_req;
+};
+
+static char		manufacturer[64] = DRIVER_MANUFACTURER;
+static char		product_desc[30] = DRIVER_DESC;
+static char		serial[20] = "0123456789";
+
+/* Static strings, in UTF-8 (for simplicity we use only ASCII characters */
+static struct usb_string strings[] = {
+	{ STRING_MANUFACTURER,	manufacturer, },
+	{ STRING_PRODUCT,	product_desc, },
+	{ STRING_SERIAL,	serial, },
+	{ STRING_SOURCE_SINK,	"source and sink data", },
+	{ STRING_LOOPBACK,	"loop input to output", },
+	{ }
+};
+
+static struct usb_gadget_strings stringtab = {
+	.language	= 0x0409,	/* en_US */
+	.strings	= strings,
+};
+
+static u8 ctrl_req[USB_BUFSIZ];
+
+/* source data is written once at bind; loopback only uses out_buf */
+static u8 in_buf[ZERO_BUFLEN] __attribute__ ((aligned(4)));
+static u8 out_buf[ZERO_BUFLEN] __attribute__ ((aligned(4)));
+
+
+static struct usb_device_descriptor device_desc = {
+	.bLength		= sizeof device_desc,
+	.bDescriptorType	= USB_DT_DEVICE,
+
+	.bcdUSB			= __constant_cpu_to_le16(0x0110),
+
+	.bDeviceClass		= USB_CLASS_VENDOR_SPEC,
+	.bDeviceSubClass	= 0x00,
+	.bDeviceProtocol	= 0x00,
+
+	.idVendor		= __constant_cpu_to_le16(ZERO_VENDOR_ID),
+	.idProduct		= __constant_cpu_to_le16(ZERO_PRODUCT_ID),
+
+	.iManufacturer		= STRING_MANUFACTURER,
+	.iProduct		= STRING_PRODUCT,
+	.iSerialNumber		= STRING_SERIAL,
+
+	.bNumConfigurations	= 2,
+};
+
+static struct usb_config_descriptor source_sink_config = {
+	.bLength		= sizeof source_sink_config,
+	.bDescriptorType	= USB_DT_CONFIG,
+
+	/* compute wTotalLength on the fly */
+	.bNumInterfaces		= 1,
+	.bConfigurationValue	= SOURCE_SINK_CONFIG,
+	.iConfiguration		= STRING_SOURCE_SINK,
+	.bmAttributes		= USB_CONFIG_ATT_ONE | USB_CONFIG_ATT_SELFPOWER,
+	.bMaxPower		= 1,
+};
+
+static struct usb_config_descriptor loopback_config = {
+	.bLength		= sizeof loopback_config,
+	.bDescriptorType	= USB_DT_CONFIG,
+
+	/* compute wTotalLength on the fly */
+	.bNumInterfaces		= 1,
+	.bConfigurationValue	= LOOPBACK_CONFIG,
+	.iConfiguration		= STRING_LOOPBACK,
+	.bmAttributes		= USB_CONFIG_ATT_ONE | USB_CONFIG_ATT_SELFPOWER,
+	.bMaxPower		= 1,
+};
+
+static struct usb_interface_descriptor intf_desc = {
+	.bLength		= sizeof intf_desc,
+	.bDescriptorType	= USB_DT_INTERFACE,
+	.bInterfaceNumber	= 0,
+	.bNumEndpoints		= 2,
+	.bInterfaceClass	= USB_CLASS_VENDOR_SPEC,
+	.bInterfaceSubClass	= 0,
+	.bInterfaceProtocol	= 0,
+	.iInterface		= 0,
+};
+
+static struct usb_endpoint_descriptor bulk_in_desc = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= USB_DIR_IN,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	/* wMaxPacketSize set by autoconfiguration */
+};
+
+static struct usb_endpoint_descriptor bulk_out_desc = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= USB_DIR_OUT,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	/* wMaxPacketSize set by autoconfiguration */
+};
+
+/* both configurations expose the same interface */
+static const struct usb_descriptor_header *fs_function[] = {
+	(struct usb_descriptor_header *) &intf_desc,
+	(struct usb_descriptor_header *) &bulk_in_desc,
+	(struct usb_descriptor_header *) &bulk_out_desc,
+	NULL,
+};
+
+static int config_buf(struct usb_gadget *gadget,
+		u8 *buf, u8 type, unsigned index)
+{
+	struct usb_config_descriptor	*config;
+	int				len;
+
+	if (index >= device_desc.bNumConfigurations)
+		return -EINVAL;
+
+	config = index ? &loopback_config : &source_sink_config;
+
+	len = usb_gadget_config_buf(config, buf, USB_BUFSIZ, fs_function);
+	if (len < 0)
+		return len;
+
+	((struct usb_config_descriptor *) buf)->bDescriptorType = type;
+
+	return len;
+}
+
+static void zero_setup_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	if (req->status || req->actual != req->length)
+		debug("setup complete --> %d, %d/%d\n",
+				req->status, req->actual, req->length);
+}
+
+static void zero_requeue(struct usb_ep *ep, struct usb_request *req)
+{
+	int status;
+
+	status = usb_ep_queue(ep, req, GFP_ATOMIC);
+	if (status) {
+		error("kill %s: resubmit %d bytes --> %d\n",
+				ep->name, req->length, status);
+		usb_ep_set_halt(ep);
+	}
+}
+
+/*
+ * Source/sink: the IN request always goes back out with the same
+ * pattern, the OUT request is simply resubmitted.
+ */
+static void source_sink_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	int status = req->status;
+
+	switch (status) {
+	case 0:
+		break;
+	case -ECONNABORTED:	/* hardware forced ep reset */
+	case -ECONNRESET:	/* request dequeued */
+	case -ESHUTDOWN:	/* disconnected from host */
+		debug("%s ep shutdown --> %d, %d/%d\n", ep->name,
+				status, req->actual, req->length);
+		return;
+	default:
+		debug("%s complete --> %d, %d/%d\n", ep->name,
+				status, req->actual, req->length);
+	}
+
+	zero_requeue(ep, req);
+}
+
+/*
+ * Loopback: a single request bounces between the endpoints, so every
+ * OUT transfer is answered by an IN transfer of the same length.
+ */
+static void loopback_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	struct zero_dev	*dev = ep->driver_data;
+	int		status = req->status;
+
+	switch (status) {
+	case 0:
+		if (ep == dev->out_ep) {
+			req->length = req->actual;
+			zero_requeue(dev->in_ep, req);
+		} else {
+			req->length = ZERO_BUFLEN;
+			zero_requeue(dev->out_ep, req);
+		}
+		return;
+	case -ECONNABORTED:	/* hardware forced ep reset */
+	case -ECONNRESET:	/* request dequeued */
+	case -ESHUTDOWN:	/* disconnected from host */
+		debug("%s ep shutdown --> %d, %d/%d\n", ep->name,
+				status, req->actual, req->length);
+		return;
+	default:
+		debug("%s complete --> %d, %d/%d\n", ep->name,
+				status, req->actual, req->length);
+	}
+
+	/* on error, start over with an OUT transfer */
+	req->length = ZERO_BUFLEN;
+	zero_requeue(dev->out_ep, req);
+}
+
+static void zero_reset_config(struct zero_dev *dev)
+{
+	if (dev->config == 0)
+		return;
+	debug("%s\n", __func__);
+
+	/* disable endpoints, forcing completion of pending i/o */
+	usb_ep_disable(dev->in_ep);
+	usb_ep_disable(dev->out_ep);
+
+	if (dev->in_req) {
+		usb_ep_free_request(dev->in_ep, dev->in_req);
+		dev->in_req = NULL;
+	}
+	if (dev->out_req) {
+		usb_ep_free_request(dev->out_ep, dev->out_req);
+		dev->out_req = NULL;
+	}
+
+	dev->config = 0;
+}
+
+static struct usb_request *
+zero_alloc_req(struct usb_ep *ep, void *buf,
+		void (*complete)(struct usb_ep *, struct usb_request *))
+{
+	struct usb_request	*req;
+
+	req = usb_ep_alloc_request(ep, GFP_ATOMIC);
+	if (req != NULL) {
+		req->buf = buf;
+		req->length = ZERO_BUFLEN;
+		req->complete = complete;
+	}
+
+	return req;
+}
+
+static int zero_enable_eps(struct zero_dev *dev)
+{
+	int err;
+
+	err = usb_ep_enable(dev->in_ep, &bulk_in_desc);
+	if (err) {
+		error("enable ep %s failed(%d)\n", dev->in_ep->name, err);
+		return err;
+	}
+	dev->in_ep->driver_data = dev;
+
+	err = usb_ep_enable(dev->out_ep, &bulk_out_desc);
+	if (err) {
+		error("enable ep %s failed(%d)\n", dev->out_ep->name, err);
+		usb_ep_disable(dev->in_ep);
+		return err;
+	}
+	dev->out_ep->driver_data = dev;
+
+	return 0;
+}
+
+static int set_source_sink_config(struct zero_dev *dev)
+{
+	int err;
+
+	err = zero_enable_eps(dev);
+	if (err)
+		return err;
+
+	dev->in_req = zero_alloc_req(dev->in_ep, in_buf,
+			source_sink_complete);
+	dev->out_req = zero_alloc_req(dev->out_ep, out_buf,
+			source_sink_complete);
+	if (!dev->in_req || !dev->out_req)
+		return -ENOMEM;
+
+	err = usb_ep_queue(dev->in_ep, dev->in_req, GFP_ATOMIC);
+	if (!err)
+		err = usb_ep_queue(dev->out_ep, dev->out_req, GFP_ATOMIC);
+	if (err)
+		error("source/sink queue req: %d\n", err);
+
+	return err;
+}
+
+static int set_loopback_config(struct zero_dev *dev)
+{
+	int err;
+
+	err = zero_enable_eps(dev);
+	if (err)
+		return err;
+
+	/* kept in out_req wherever it currently is queued */
+	dev->out_req = zero_alloc_req(dev->out_ep, out_buf,
+			loopback_complete);
+	if (!dev->out_req)
+		return -ENOMEM;
+
+	err = usb_ep_queue(dev->out_ep, dev->out_req, GFP_ATOMIC);
+	if (err)
+		error("%s queue req: %d\n", dev->out_ep->name, err);
+
+	return err;
+}
+
+static int zero_set_config(struct zero_dev *dev, unsigned number)
+{
+	int			result = 0;
+
+	zero_reset_config(dev);
+
+	switch (number) {
+	case SOURCE_SINK_CONFIG:
+		result = set_source_sink_config(dev);
+		break;
+	case LOOPBACK_CONFIG:
+		result = set_loopback_config(dev);
+		break;
+	default:
+		result = -EINVAL;
+	case 0:
+		return result;
+	}
+
+	/* tear down whatever half of the config got set up */
+	dev->config = number;
+	if (result)
+		zero_reset_config(dev);
+
+	if (result) {
+		usb_gadget_vbus_draw(dev->gadget,
+				dev->gadget->is_otg ? 8 : 100);
+	} else {
+		unsigned power;
+
+		power = 2 * source_sink_config.bMaxPower;
+		usb_gadget_vbus_draw(dev->gadget, power);
+		debug("zero: config #%d: %s\n", number,
+				number == LOOPBACK_CONFIG ?
+				"loopback" : "source/sink");
+	}
+
+	return result;
+}
+
+static int
+zero_setup(struct usb_gadget *gadget, const struct usb_ctrlrequest *ctrl)
+{
+	struct zero_dev		*dev = get_gadget_data(gadget);
+	struct usb_request	*req = dev->req;
+	int			value = -EOPNOTSUPP;
+	u16			wIndex = le16_to_cpu(ctrl->wIndex);
+	u16			wValue = le16_to_cpu(ctrl->wValue);
+	u16			wLength = le16_to_cpu(ctrl->wLength);
+
+	debug("usb control req %02x.%02x v%04x i%04x l%02x\n",
+			ctrl->bRequestType, ctrl->bRequest,
+			wValue, wIndex, wLength);
+
+	switch (ctrl->bRequest) {
+	case USB_REQ_GET_DESCRIPTOR:
+		if (ctrl->bRequestType != USB_DIR_IN)
+			break;
+
+		switch (wValue >> 8) {
+		case USB_DT_DEVICE:
+			value = min(wLength, (u16) sizeof(device_desc));
+			memcpy(req->buf, &device_desc, value);
+			break;
+
+		case USB_DT_CONFIG:
+			value = config_buf(gadget, req->buf,
+					wValue >> 8,
+					wValue & 0xff);
+			if (value >= 0)
+				value = min(wLength, (u16)value);
+			break;
+
+		case USB_DT_STRING:
+			value = usb_gadget_get_string(&stringtab,
+					wValue &0xff, req->buf);
+			if (value >= 0)
+				value = min(wLength, (u16)value);
+			break;
+		}
+		break;
+
+	case USB_REQ_SET_CONFIGURATION:
+		if (ctrl->bRequestType != 0)
+			break;
+		value = zero_set_config(dev, wValue);
+		break;
+
+	case USB_REQ_GET_CONFIGURATION:
+		if (ctrl->bRequestType != USB_DIR_IN)
+			break;
+		*(u8 *)req->buf = dev->config;
+		value = min(wLength, (u16) 1);
+		break;
+
+	/*
+	 * Control transfer tests, as in the Linux gadget: 0x5b writes
+	 * into the ep0 buffer and 0x5c reads it back, so the host can
+	 * time ep0 round trips as well.
+	 */
+	case 0x5b:	/* control WRITE test -- fill the buffer */
+		if (ctrl->bRequestType != (USB_DIR_OUT | USB_TYPE_VENDOR))
+			break;
+		if (wValue || wIndex || wLength > USB_BUFSIZ)
+			break;
+		value = wLength;
+		break;
+	case 0x5c:	/* control READ test -- return the buffer */
+		if (ctrl->bRequestType != (USB_DIR_IN | USB_TYPE_VENDOR))
+			break;
+		if (wValue || wIndex || wLength > USB_BUFSIZ)
+			break;
+		value = wLength;
+		break;
+
+	default:
+		debugX("usb control req %02x.%02x v%04x i%04x l%02x\n",
+				ctrl->bRequestType, ctrl->bRequest,
+				wValue, wIndex, wLength);
+	}
+
+	if (value >=0) {
+		req->length = value;
+		req->zero = value < wLength
+			&& (value % gadget->ep0->maxpacket) == 0;
+		value = usb_ep_queue(gadget->ep0, req, GFP_ATOMIC);
+		if (value < 0) {
+			debugX("ep_queue --> %d\n", value);
+			req->status = 0;
+			zero_setup_complete(gadget->ep0, req);
+		}
+	}
+
+	return value;
+}
+
+static int zero_bind(struct usb_gadget *gadget)
+{
+	struct zero_dev		*dev;
+	struct usb_ep		*ep;
+	int			i;
+
+	dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	if (!dev)
+		return -ENOMEM;
+
+	device_desc.bMaxPacketSize0 = gadget->ep0->maxpacket;
+	usb_gadget_set_selfpowered(gadget);
+
+	usb_ep_autoconfig_reset(gadget);
+	ep = usb_ep_autoconfig(gadget, &bulk_in_desc);
+	if (!ep)
+		goto autoconf_fail;
+	ep->driver_data = ep;	/* claim */
+	dev->in_ep = ep;
+
+	ep = usb_ep_autoconfig(gadget, &bulk_out_desc);
+	if (!ep)
+		goto autoconf_fail;
+	ep->driver_data = ep;	/* claim */
+	dev->out_ep = ep;
+
+	/* pre-allocate control message data and buffer */
+	dev->req = usb_ep_alloc_request(gadget->ep0, GFP_KERNEL);
+	if (!dev->req) {
+		kfree(dev);
+		return -ENOMEM;
+	}
+	dev->req->buf = ctrl_req;
+	dev->req->complete = zero_setup_complete;
+
+	/* the "mod63" pattern of the Linux gadget, written only once */
+	for (i = 0; i < ZERO_BUFLEN; i++)
+		in_buf[i] = i % 63;
+
+	dev->gadget = gadget;
+	set_gadget_data(gadget, dev);
+
+	return 0;
+
+autoconf_fail:
+	error("autoconfig on %s failed\n", gadget->name);
+	kfree(dev);
+	return -ENODEV;
+}
+
+static void zero_unbind(struct usb_gadget *gadget)
+{
+	struct zero_dev *dev = get_gadget_data(gadget);
+
+	debug("%s\n", __func__);
+
+	zero_reset_config(dev);
+	if (dev->req) {
+		usb_ep_free_request(gadget->ep0, dev->req);
+		dev->req = NULL;
+	}
+
+	dev->gadget = NULL;
+	kfree(dev);
+	set_gadget_data(gadget, NULL);
+}
+
+static void zero_disconnect(struct usb_gadget *gadget)
+{
+	struct zero_dev *dev = get_gadget_data(gadget);
+
+	debug("%s\n", __func__);
+
+	zero_reset_config(dev);
+}
+
+static struct usb_gadget_driver zero_driver = {
+#ifdef CONFIG_USB_GADGET_DUALSPEED
+	.speed		= USB_SPEED_HIGH,
+#else
+	.speed		= USB_SPEED_FULL,
+#endif
+	.bind		= zero_bind,
+	.unbind		= zero_unbind,
+
+	.disconnect	= zero_disconnect,
+	.setup		= zero_setup,
+};
+
+int zero_init(void)
+{
+	int ret;
+
+	ret = usb_gadget_register_driver(&zero_driver);
+	if (ret)
+		return ret;
+
+	return 0;
+}
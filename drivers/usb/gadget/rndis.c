@@ -23,7 +23,6 @@
 
 #include <common.h>
 #include <net.h>
-#include <malloc.h>
 #include <linux/types.h>
 #include <linux/list.h>
 #include <linux/netdevice.h>
@@ -66,585 +65,553 @@ static const __le32 rndis_driver_version = __constant_cpu_to_le32(1);
 static rndis_resp_t *rndis_add_response(int configNr, u32 length);
 
 
-/* supported OIDs */
-static const u32 oid_supported_list[] = {
-	/* the general stuff */
-	OID_GEN_SUPPORTED_LIST,
-	OID_GEN_HARDWARE_STATUS,
-	OID_GEN_MEDIA_SUPPORTED,
-	OID_GEN_MEDIA_IN_USE,
-	OID_GEN_MAXIMUM_FRAME_SIZE,
-	OID_GEN_LINK_SPEED,
-	OID_GEN_TRANSMIT_BLOCK_SIZE,
-	OID_GEN_RECEIVE_BLOCK_SIZE,
-	OID_GEN_VENDOR_ID,
-	OID_GEN_VENDOR_DESCRIPTION,
-	OID_GEN_VENDOR_DRIVER_VERSION,
-	OID_GEN_CURRENT_PACKET_FILTER,
-	OID_GEN_MAXIMUM_TOTAL_SIZE,
-	OID_GEN_MEDIA_CONNECT_STATUS,
-	OID_GEN_PHYSICAL_MEDIUM,
-#if 0
-	OID_GEN_RNDIS_CONFIG_PARAMETER,
-#endif
-
-	/* the statistical stuff */
-	OID_GEN_XMIT_OK,
-	OID_GEN_RCV_OK,
-	OID_GEN_XMIT_ERROR,
-	OID_GEN_RCV_ERROR,
-	OID_GEN_RCV_NO_BUFFER,
-#ifdef	RNDIS_OPTIONAL_STATS
-	OID_GEN_DIRECTED_BYTES_XMIT,
-	OID_GEN_DIRECTED_FRAMES_XMIT,
-	OID_GEN_MULTICAST_BYTES_XMIT,
-	OID_GEN_MULTICAST_FRAMES_XMIT,
-	OID_GEN_BROADCAST_BYTES_XMIT,
-	OID_GEN_BROADCAST_FRAMES_XMIT,
-	OID_GEN_DIRECTED_BYTES_RCV,
-	OID_GEN_DIRECTED_FRAMES_RCV,
-	OID_GEN_MULTICAST_BYTES_RCV,
-	OID_GEN_MULTICAST_FRAMES_RCV,
-	OID_GEN_BROADCAST_BYTES_RCV,
-	OID_GEN_BROADCAST_FRAMES_RCV,
-	OID_GEN_RCV_CRC_ERROR,
-	OID_GEN_TRANSMIT_QUEUE_LENGTH,
-#endif	/* RNDIS_OPTIONAL_STATS */
-
-	/* mandatory 802.3 */
-	/* the general stuff */
-	OID_802_3_PERMANENT_ADDRESS,
-	OID_802_3_CURRENT_ADDRESS,
-	OID_802_3_MULTICAST_LIST,
-	OID_802_3_MAC_OPTIONS,
-	OID_802_3_MAXIMUM_LIST_SIZE,
-
-	/* the statistical stuff */
-	OID_802_3_RCV_ERROR_ALIGNMENT,
-	OID_802_3_XMIT_ONE_COLLISION,
-	OID_802_3_XMIT_MORE_COLLISIONS,
-#ifdef	RNDIS_OPTIONAL_STATS
-	OID_802_3_XMIT_DEFERRED,
-	OID_802_3_XMIT_MAX_COLLISIONS,
-	OID_802_3_RCV_OVERRUN,
-	OID_802_3_XMIT_UNDERRUN,
-	OID_802_3_XMIT_HEARTBEAT_FAILURE,
-	OID_802_3_XMIT_TIMES_CRS_LOST,
-	OID_802_3_XMIT_LATE_COLLISIONS,
-#endif	/* RNDIS_OPTIONAL_STATS */
+/*
+ * OID handlers.  Queries write their value at outbuf and may change
+ * *length from the usual 4 bytes; both kinds return 0 or -ENOTSUPP.
+ */
+typedef int (*oid_query_t)(rndis_params *params, u8 *buf, unsigned buf_len,
+				__le32 *outbuf, u32 *length);
+typedef int (*oid_set_t)(rndis_params *params, u8 *buf, u32 buf_len);
+
+struct rndis_oid {
+	u32		oid;
+	u32		flags;
+#define OID_HIDDEN	(1 << 0)	/* not in OID_GEN_SUPPORTED_LIST */
+#define OID_NEED_DEV	(1 << 1)	/* needs rndis_set_param_dev() */
+#define OID_NEED_STATS	(1 << 2)	/* ... and its statistics */
+	oid_query_t	query;
+	oid_set_t	set;
+};
 
-#ifdef	RNDIS_PM
-	/* PM and wakeup are mandatory for USB: */
+/* general oids (table 4-1) */
 
-	/* power management */
-	OID_PNP_CAPABILITIES,
-	OID_PNP_QUERY_POWER,
-	OID_PNP_SET_POWER,
+static int oid_supported_list(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length);
 
-#ifdef	RNDIS_WAKEUP
-	/* wake up host */
-	OID_PNP_ENABLE_WAKE_UP,
-	OID_PNP_ADD_WAKE_UP_PATTERN,
-	OID_PNP_REMOVE_WAKE_UP_PATTERN,
-#endif	/* RNDIS_WAKEUP */
-#endif	/* RNDIS_PM */
-};
+static int oid_zero(rndis_params *params, u8 *buf, unsigned buf_len,
+			__le32 *outbuf, u32 *length)
+{
+	/*
+	 * Bogus questions, like OID_GEN_HARDWARE_STATUS:
+	 * hardware must be ready to receive high level protocols.
+	 */
+	*outbuf = __constant_cpu_to_le32(0);
+	return 0;
+}
 
+static int oid_medium(rndis_params *params, u8 *buf, unsigned buf_len,
+			__le32 *outbuf, u32 *length)
+{
+	/* one medium, one transport... (maybe you do it better) */
+	*outbuf = cpu_to_le32(params->medium);
+	return 0;
+}
 
-/* NDIS Functions */
-static int gen_ndis_query_resp(int configNr, u32 OID, u8 *buf,
-				unsigned buf_len, rndis_resp_t *r)
+static int oid_mtu(rndis_params *params, u8 *buf, unsigned buf_len,
+			__le32 *outbuf, u32 *length)
 {
-	int				retval = -ENOTSUPP;
-	u32				length = 4;	/* usually */
-	__le32				*outbuf;
-	int				i, count;
-	rndis_query_cmplt_type		*resp;
-	rndis_params			*params;
+	*outbuf = cpu_to_le32(params->mtu);
+	return 0;
+}
 
-	if (!r)
-		return -ENOMEM;
-	resp = (rndis_query_cmplt_type *) r->buf;
+static int oid_link_speed(rndis_params *params, u8 *buf, unsigned buf_len,
+				__le32 *outbuf, u32 *length)
+{
+	if (params->media_state == NDIS_MEDIA_STATE_DISCONNECTED)
+		*outbuf = __constant_cpu_to_le32(0);
+	else
+		*outbuf = cpu_to_le32(params->speed);
+	return 0;
+}
 
-	if (!resp)
-		return -ENOMEM;
+static int oid_vendor_id(rndis_params *params, u8 *buf, unsigned buf_len,
+				__le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->vendorID);
+	return 0;
+}
 
-#if defined(DEBUG) && defined(DEBUG_VERBOSE)
-	if (buf_len) {
-		debug("query OID %08x value, len %d:\n", OID, buf_len);
-		for (i = 0; i < buf_len; i += 16) {
-			debug("%03d: %08x %08x %08x %08x\n", i,
-				get_unaligned_le32(&buf[i]),
-				get_unaligned_le32(&buf[i + 4]),
-				get_unaligned_le32(&buf[i + 8]),
-				get_unaligned_le32(&buf[i + 12]));
-		}
-	}
-#endif
+static int oid_vendor_descr(rndis_params *params, u8 *buf, unsigned buf_len,
+				__le32 *outbuf, u32 *length)
+{
+	*length = strlen(params->vendorDescr);
+	memcpy(outbuf, params->vendorDescr, *length);
+	return 0;
+}
 
-	/* response goes here, right after the header */
-	outbuf = (__le32 *) &resp[1];
-	resp->InformationBufferOffset = __constant_cpu_to_le32(16);
+static int oid_driver_version(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	/* Created as LE */
+	*outbuf = rndis_driver_version;
+	return 0;
+}
 
-	params = &rndis_per_dev_params[configNr];
-	switch (OID) {
+static int oid_packet_filter(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(*params->filter);
+	return 0;
+}
 
-	/* general oids (table 4-1) */
+static int oid_max_total_size(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = __constant_cpu_to_le32(RNDIS_MAX_TOTAL_SIZE);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_SUPPORTED_LIST:
-		debug("%s: OID_GEN_SUPPORTED_LIST\n", __func__);
-		length = sizeof(oid_supported_list);
-		count  = length / sizeof(u32);
-		for (i = 0; i < count; i++)
-			outbuf[i] = cpu_to_le32(oid_supported_list[i]);
-		retval = 0;
-		break;
+static int oid_gen_mac_options(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = __constant_cpu_to_le32(
+			  NDIS_MAC_OPTION_RECEIVE_SERIALIZED
+			| NDIS_MAC_OPTION_FULL_DUPLEX);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_HARDWARE_STATUS:
-		debug("%s: OID_GEN_HARDWARE_STATUS\n", __func__);
-		/*
-		 * Bogus question!
-		 * Hardware must be ready to receive high level protocols.
-		 * BTW:
-		 * reddite ergo quae sunt Caesaris Caesari
-		 * et quae sunt Dei Deo!
-		 */
-		*outbuf = __constant_cpu_to_le32(0);
-		retval = 0;
-		break;
+static int oid_connect_status(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->media_state);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_MEDIA_SUPPORTED:
-		debug("%s: OID_GEN_MEDIA_SUPPORTED\n", __func__);
-		*outbuf = cpu_to_le32(params->medium);
-		retval = 0;
-		break;
+/* statistics OIDs (table 4-2) */
 
-	/* mandatory */
-	case OID_GEN_MEDIA_IN_USE:
-		debug("%s: OID_GEN_MEDIA_IN_USE\n", __func__);
-		/* one medium, one transport... (maybe you do it better) */
-		*outbuf = cpu_to_le32(params->medium);
-		retval = 0;
-		break;
+static int oid_xmit_ok(rndis_params *params, u8 *buf, unsigned buf_len,
+			__le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->tx_packets -
+				params->stats->tx_errors -
+				params->stats->tx_dropped);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_MAXIMUM_FRAME_SIZE:
-		debug("%s: OID_GEN_MAXIMUM_FRAME_SIZE\n", __func__);
-		if (params->dev) {
-			*outbuf = cpu_to_le32(params->mtu);
-			retval = 0;
-		}
-		break;
+static int oid_rcv_ok(rndis_params *params, u8 *buf, unsigned buf_len,
+			__le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->rx_packets -
+				params->stats->rx_errors -
+				params->stats->rx_dropped);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_LINK_SPEED:
-#if defined(DEBUG) && defined(DEBUG_VERBOSE)
-		debug("%s: OID_GEN_LINK_SPEED\n", __func__);
-#endif
-		if (params->media_state == NDIS_MEDIA_STATE_DISCONNECTED)
-			*outbuf = __constant_cpu_to_le32(0);
-		else
-			*outbuf = cpu_to_le32(params->speed);
-		retval = 0;
-		break;
+static int oid_xmit_error(rndis_params *params, u8 *buf, unsigned buf_len,
+				__le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->tx_errors);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_TRANSMIT_BLOCK_SIZE:
-		debug("%s: OID_GEN_TRANSMIT_BLOCK_SIZE\n", __func__);
-		if (params->dev) {
-			*outbuf = cpu_to_le32(params->mtu);
-			retval = 0;
-		}
-		break;
+static int oid_rcv_error(rndis_params *params, u8 *buf, unsigned buf_len,
+				__le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->rx_errors);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_RECEIVE_BLOCK_SIZE:
-		debug("%s: OID_GEN_RECEIVE_BLOCK_SIZE\n", __func__);
-		if (params->dev) {
-			*outbuf = cpu_to_le32(params->mtu);
-			retval = 0;
-		}
-		break;
+static int oid_rcv_no_buffer(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->rx_dropped);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_VENDOR_ID:
-		debug("%s: OID_GEN_VENDOR_ID\n", __func__);
-		*outbuf = cpu_to_le32(params->vendorID);
-		retval = 0;
-		break;
+#ifdef	RNDIS_OPTIONAL_STATS
+/*
+ * Aunt Tilly's size of shoes
+ * minus antarctica count of penguins
+ * divided by weight of Alpha Centauri
+ */
+static int oid_directed_bytes_xmit(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32((params->stats->tx_packets -
+				params->stats->tx_errors -
+				params->stats->tx_dropped) * 123);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_VENDOR_DESCRIPTION:
-		debug("%s: OID_GEN_VENDOR_DESCRIPTION\n", __func__);
-		length = strlen(params->vendorDescr);
-		memcpy(outbuf, params->vendorDescr, length);
-		retval = 0;
-		break;
+static int oid_directed_frames_xmit(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	/* dito */
+	*outbuf = cpu_to_le32((params->stats->tx_packets -
+				params->stats->tx_errors -
+				params->stats->tx_dropped) / 123);
+	return 0;
+}
 
-	case OID_GEN_VENDOR_DRIVER_VERSION:
-		debug("%s: OID_GEN_VENDOR_DRIVER_VERSION\n", __func__);
-		/* Created as LE */
-		*outbuf = rndis_driver_version;
-		retval = 0;
-		break;
+static int oid_multicast_bytes_xmit(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->multicast * 1234);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_CURRENT_PACKET_FILTER:
-		debug("%s: OID_GEN_CURRENT_PACKET_FILTER\n", __func__);
-		*outbuf = cpu_to_le32(*params->filter);
-		retval = 0;
-		break;
+static int oid_multicast_frames(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->multicast);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_MAXIMUM_TOTAL_SIZE:
-		debug("%s: OID_GEN_MAXIMUM_TOTAL_SIZE\n", __func__);
-		*outbuf = __constant_cpu_to_le32(RNDIS_MAX_TOTAL_SIZE);
-		retval = 0;
-		break;
+static int oid_broadcast_bytes_xmit(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->tx_packets / 42 * 255);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_MEDIA_CONNECT_STATUS:
-#if defined(DEBUG) && defined(DEBUG_VERBOSE)
-		debug("%s: OID_GEN_MEDIA_CONNECT_STATUS\n", __func__);
-#endif
-		*outbuf = cpu_to_le32(params->media_state);
-		retval = 0;
-		break;
+static int oid_broadcast_frames_xmit(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->tx_packets / 42);
+	return 0;
+}
 
-	case OID_GEN_PHYSICAL_MEDIUM:
-		debug("%s: OID_GEN_PHYSICAL_MEDIUM\n", __func__);
-		*outbuf = __constant_cpu_to_le32(0);
-		retval = 0;
-		break;
+static int oid_multicast_bytes_rcv(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->multicast * 1111);
+	return 0;
+}
 
-	/*
-	 * The RNDIS specification is incomplete/wrong.   Some versions
-	 * of MS-Windows expect OIDs that aren't specified there.  Other
-	 * versions emit undefined RNDIS messages. DOCUMENT ALL THESE!
-	 */
-	case OID_GEN_MAC_OPTIONS:		/* from WinME */
-		debug("%s: OID_GEN_MAC_OPTIONS\n", __func__);
-		*outbuf = __constant_cpu_to_le32(
-				  NDIS_MAC_OPTION_RECEIVE_SERIALIZED
-				| NDIS_MAC_OPTION_FULL_DUPLEX);
-		retval = 0;
-		break;
+static int oid_broadcast_bytes_rcv(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->rx_packets / 42 * 255);
+	return 0;
+}
 
-	/* statistics OIDs (table 4-2) */
+static int oid_broadcast_frames_rcv(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->rx_packets / 42);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_XMIT_OK:
-#if defined(DEBUG) && defined(DEBUG_VERBOSE)
-		debug("%s: OID_GEN_XMIT_OK\n", __func__);
-#endif
-		if (params->stats) {
-			*outbuf = cpu_to_le32(
-					params->stats->tx_packets -
-					params->stats->tx_errors -
-					params->stats->tx_dropped);
-			retval = 0;
-		}
-		break;
+static int oid_rcv_crc_error(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->rx_crc_errors);
+	return 0;
+}
+#endif	/* RNDIS_OPTIONAL_STATS */
 
-	/* mandatory */
-	case OID_GEN_RCV_OK:
-#if defined(DEBUG) && defined(DEBUG_VERBOSE)
-		debug("%s: OID_GEN_RCV_OK\n", __func__);
-#endif
-		if (params->stats) {
-			*outbuf = cpu_to_le32(
-					params->stats->rx_packets -
-					params->stats->rx_errors -
-					params->stats->rx_dropped);
-			retval = 0;
-		}
-		break;
+/* ieee802.3 OIDs (table 4-3) */
 
-	/* mandatory */
-	case OID_GEN_XMIT_ERROR:
-#if defined(DEBUG) && defined(DEBUG_VERBOSE)
-		debug("%s: OID_GEN_XMIT_ERROR\n", __func__);
-#endif
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->tx_errors);
-			retval = 0;
-		}
-		break;
+static int oid_mac_address(rndis_params *params, u8 *buf, unsigned buf_len,
+				__le32 *outbuf, u32 *length)
+{
+	*length = ETH_ALEN;
+	memcpy(outbuf, params->host_mac, *length);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_RCV_ERROR:
-#if defined(DEBUG) && defined(DEBUG_VERBOSE)
-		debug("%s: OID_GEN_RCV_ERROR\n", __func__);
-#endif
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->rx_errors);
-			retval = 0;
-		}
-		break;
+static int oid_multicast_list(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	/* Multicast base address only */
+	*outbuf = __constant_cpu_to_le32(0xE0000000);
+	return 0;
+}
 
-	/* mandatory */
-	case OID_GEN_RCV_NO_BUFFER:
-		debug("%s: OID_GEN_RCV_NO_BUFFER\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->rx_dropped);
-			retval = 0;
-		}
-		break;
+static int oid_max_list_size(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	/* Multicast base address only */
+	*outbuf = __constant_cpu_to_le32(1);
+	return 0;
+}
 
-#ifdef	RNDIS_OPTIONAL_STATS
-	case OID_GEN_DIRECTED_BYTES_XMIT:
-		debug("%s: OID_GEN_DIRECTED_BYTES_XMIT\n", __func__);
-		/*
-		 * Aunt Tilly's size of shoes
-		 * minus antarctica count of penguins
-		 * divided by weight of Alpha Centauri
-		 */
-		if (params->stats) {
-			*outbuf = cpu_to_le32(
-					(params->stats->tx_packets -
-					 params->stats->tx_errors -
-					 params->stats->tx_dropped)
-					* 123);
-			retval = 0;
-		}
-		break;
+/* ieee802.3 statistics OIDs (table 4-4) */
 
-	case OID_GEN_DIRECTED_FRAMES_XMIT:
-		debug("%s: OID_GEN_DIRECTED_FRAMES_XMIT\n", __func__);
-		/* dito */
-		if (params->stats) {
-			*outbuf = cpu_to_le32(
-					(params->stats->tx_packets -
-					 params->stats->tx_errors -
-					 params->stats->tx_dropped)
-					/ 123);
-			retval = 0;
-		}
-		break;
+static int oid_rcv_error_alignment(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	*outbuf = cpu_to_le32(params->stats->rx_frame_errors);
+	return 0;
+}
 
-	case OID_GEN_MULTICAST_BYTES_XMIT:
-		debug("%s: OID_GEN_MULTICAST_BYTES_XMIT\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->multicast * 1234);
-			retval = 0;
-		}
-		break;
+#ifdef	RNDIS_PM
+/* power management OIDs (table 4-5) */
 
-	case OID_GEN_MULTICAST_FRAMES_XMIT:
-		debug("%s: OID_GEN_MULTICAST_FRAMES_XMIT\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->multicast);
-			retval = 0;
-		}
-		break;
+static int oid_pnp_capabilities(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	/* for now, no wakeup capabilities */
+	*length = sizeof(struct NDIS_PNP_CAPABILITIES);
+	memset(outbuf, 0, *length);
+	return 0;
+}
 
-	case OID_GEN_BROADCAST_BYTES_XMIT:
-		debug("%s: OID_GEN_BROADCAST_BYTES_XMIT\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->tx_packets/42*255);
-			retval = 0;
-		}
-		break;
+static int oid_pnp_query_power(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	debug("%s: D%d\n", __func__, get_unaligned_le32(buf) - 1);
+	/*
+	 * only suspend is a real power state, and
+	 * it can't be entered by OID_PNP_SET_POWER...
+	 */
+	*length = 0;
+	return 0;
+}
+#endif	/* RNDIS_PM */
 
-	case OID_GEN_BROADCAST_FRAMES_XMIT:
-		debug("%s: OID_GEN_BROADCAST_FRAMES_XMIT\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->tx_packets / 42);
-			retval = 0;
-		}
-		break;
+/* set handlers */
 
-	case OID_GEN_DIRECTED_BYTES_RCV:
-		debug("%s: OID_GEN_DIRECTED_BYTES_RCV\n", __func__);
-		*outbuf = __constant_cpu_to_le32(0);
-		retval = 0;
-		break;
+/*
+ * this has a significant side effect:  it's what makes the packet
+ * flow start and stop, like activating the CDC Ethernet altsetting.
+ */
+static void rndis_update_linkstate(rndis_params *params)
+{
+	if (*params->filter)
+		params->state = RNDIS_DATA_INITIALIZED;
+	else
+		params->state = RNDIS_INITIALIZED;
+}
 
-	case OID_GEN_DIRECTED_FRAMES_RCV:
-		debug("%s: OID_GEN_DIRECTED_FRAMES_RCV\n", __func__);
-		*outbuf = __constant_cpu_to_le32(0);
-		retval = 0;
-		break;
+static int oid_set_packet_filter(rndis_params *params, u8 *buf, u32 buf_len)
+{
+	/*
+	 * these NDIS_PACKET_TYPE_* bitflags are shared with
+	 * cdc_filter; it's not RNDIS-specific
+	 * NDIS_PACKET_TYPE_x == USB_CDC_PACKET_TYPE_x for x in:
+	 *	PROMISCUOUS, DIRECTED,
+	 *	MULTICAST, ALL_MULTICAST, BROADCAST
+	 */
+	*params->filter = (u16) get_unaligned_le32(buf);
+	debug("%s: %08x\n", __func__, *params->filter);
 
-	case OID_GEN_MULTICAST_BYTES_RCV:
-		debug("%s: OID_GEN_MULTICAST_BYTES_RCV\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->multicast * 1111);
-			retval = 0;
-		}
-		break;
+	rndis_update_linkstate(params);
+	return 0;
+}
 
-	case OID_GEN_MULTICAST_FRAMES_RCV:
-		debug("%s: OID_GEN_MULTICAST_FRAMES_RCV\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->multicast);
-			retval = 0;
-		}
-		break;
+static int oid_set_multicast_list(rndis_params *params, u8 *buf,
+					u32 buf_len)
+{
+	/* I think we can ignore this */
+	return 0;
+}
 
-	case OID_GEN_BROADCAST_BYTES_RCV:
-		debug("%s: OID_GEN_BROADCAST_BYTES_RCV\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->rx_packets/42*255);
-			retval = 0;
-		}
-		break;
+#ifdef	RNDIS_PM
+static int oid_set_pnp_power(rndis_params *params, u8 *buf, u32 buf_len)
+{
+	u32	state = get_unaligned_le32(buf);
 
-	case OID_GEN_BROADCAST_FRAMES_RCV:
-		debug("%s: OID_GEN_BROADCAST_FRAMES_RCV\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->rx_packets / 42);
-			retval = 0;
-		}
-		break;
+	/*
+	 * The only real power state is USB suspend, and RNDIS requests
+	 * can't enter it; this one isn't really about power.  After
+	 * resuming, Windows forces a reset, and then SET_POWER D0.
+	 * FIXME ... then things go batty; Windows wedges itself.
+	 */
+	debug("%s: D%d\n", __func__, state - 1);
+	switch (state) {
+	case NdisDeviceStateD0:
+		*params->filter = params->saved_filter;
+		rndis_update_linkstate(params);
+		return 0;
+	case NdisDeviceStateD3:
+	case NdisDeviceStateD2:
+	case NdisDeviceStateD1:
+		params->saved_filter = *params->filter;
+		return 0;
+	}
+	return -ENOTSUPP;
+}
+#endif	/* RNDIS_PM */
 
-	case OID_GEN_RCV_CRC_ERROR:
-		debug("%s: OID_GEN_RCV_CRC_ERROR\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->rx_crc_errors);
-			retval = 0;
-		}
-		break;
+/*
+ * Every OID we know about, sorted by OID value for rndis_find_oid().
+ * OID_GEN_SUPPORTED_LIST is generated from it, so an entry without
+ * handlers is advertised (mandatory ones) but always fails.
+ */
+static const struct rndis_oid oid_table[] = {
+	/* general oids (table 4-1) */
+	{ OID_GEN_SUPPORTED_LIST,	0,		oid_supported_list },
+	{ OID_GEN_HARDWARE_STATUS,	0,		oid_zero },
+	{ OID_GEN_MEDIA_SUPPORTED,	0,		oid_medium },
+	{ OID_GEN_MEDIA_IN_USE,		0,		oid_medium },
+	{ OID_GEN_MAXIMUM_FRAME_SIZE,	OID_NEED_DEV,	oid_mtu },
+	{ OID_GEN_LINK_SPEED,		0,		oid_link_speed },
+	{ OID_GEN_TRANSMIT_BLOCK_SIZE,	OID_NEED_DEV,	oid_mtu },
+	{ OID_GEN_RECEIVE_BLOCK_SIZE,	OID_NEED_DEV,	oid_mtu },
+	{ OID_GEN_VENDOR_ID,		0,		oid_vendor_id },
+	{ OID_GEN_VENDOR_DESCRIPTION,	0,		oid_vendor_descr },
+	{ OID_GEN_CURRENT_PACKET_FILTER, 0,		oid_packet_filter,
+						oid_set_packet_filter },
+	{ OID_GEN_MAXIMUM_TOTAL_SIZE,	0,		oid_max_total_size },
+	/*
+	 * The RNDIS specification is incomplete/wrong.   Some versions
+	 * of MS-Windows expect OIDs that aren't specified there.  Other
+	 * versions emit undefined RNDIS messages. DOCUMENT ALL THESE!
+	 */
+	{ OID_GEN_MAC_OPTIONS,		OID_HIDDEN,	oid_gen_mac_options },
+							/* from WinME */
+	{ OID_GEN_MEDIA_CONNECT_STATUS,	0,		oid_connect_status },
+	{ OID_GEN_VENDOR_DRIVER_VERSION, 0,		oid_driver_version },
+	{ OID_GEN_PHYSICAL_MEDIUM,	0,		oid_zero },
 
-	case OID_GEN_TRANSMIT_QUEUE_LENGTH:
-		debug("%s: OID_GEN_TRANSMIT_QUEUE_LENGTH\n", __func__);
-		*outbuf = __constant_cpu_to_le32(0);
-		retval = 0;
-		break;
+	/* statistics OIDs (table 4-2) */
+	{ OID_GEN_XMIT_OK,		OID_NEED_STATS,	oid_xmit_ok },
+	{ OID_GEN_RCV_OK,		OID_NEED_STATS,	oid_rcv_ok },
+	{ OID_GEN_XMIT_ERROR,		OID_NEED_STATS,	oid_xmit_error },
+	{ OID_GEN_RCV_ERROR,		OID_NEED_STATS,	oid_rcv_error },
+	{ OID_GEN_RCV_NO_BUFFER,	OID_NEED_STATS,	oid_rcv_no_buffer },
+#ifdef	RNDIS_OPTIONAL_STATS
+	{ OID_GEN_DIRECTED_BYTES_XMIT,	OID_NEED_STATS,
+						oid_directed_bytes_xmit },
+	{ OID_GEN_DIRECTED_FRAMES_XMIT,	OID_NEED_STATS,
+						oid_directed_frames_xmit },
+	{ OID_GEN_MULTICAST_BYTES_XMIT,	OID_NEED_STATS,
+						oid_multicast_bytes_xmit },
+	{ OID_GEN_MULTICAST_FRAMES_XMIT, OID_NEED_STATS,
+						oid_multicast_frames },
+	{ OID_GEN_BROADCAST_BYTES_XMIT,	OID_NEED_STATS,
+						oid_broadcast_bytes_xmit },
+	{ OID_GEN_BROADCAST_FRAMES_XMIT, OID_NEED_STATS,
+						oid_broadcast_frames_xmit },
+	{ OID_GEN_DIRECTED_BYTES_RCV,	0,		oid_zero },
+	{ OID_GEN_DIRECTED_FRAMES_RCV,	0,		oid_zero },
+	{ OID_GEN_MULTICAST_BYTES_RCV,	OID_NEED_STATS,
+						oid_multicast_bytes_rcv },
+	{ OID_GEN_MULTICAST_FRAMES_RCV,	OID_NEED_STATS,
+						oid_multicast_frames },
+	{ OID_GEN_BROADCAST_BYTES_RCV,	OID_NEED_STATS,
+						oid_broadcast_bytes_rcv },
+	{ OID_GEN_BROADCAST_FRAMES_RCV,	OID_NEED_STATS,
+						oid_broadcast_frames_rcv },
+	{ OID_GEN_RCV_CRC_ERROR,	OID_NEED_STATS,	oid_rcv_crc_error },
+	{ OID_GEN_TRANSMIT_QUEUE_LENGTH, 0,		oid_zero },
 #endif	/* RNDIS_OPTIONAL_STATS */
 
 	/* ieee802.3 OIDs (table 4-3) */
-
-	/* mandatory */
-	case OID_802_3_PERMANENT_ADDRESS:
-		debug("%s: OID_802_3_PERMANENT_ADDRESS\n", __func__);
-		if (params->dev) {
-			length = ETH_ALEN;
-			memcpy(outbuf, params->host_mac, length);
-			retval = 0;
-		}
-		break;
-
-	/* mandatory */
-	case OID_802_3_CURRENT_ADDRESS:
-		debug("%s: OID_802_3_CURRENT_ADDRESS\n", __func__);
-		if (params->dev) {
-			length = ETH_ALEN;
-			memcpy(outbuf, params->host_mac, length);
-			retval = 0;
-		}
-		break;
-
-	/* mandatory */
-	case OID_802_3_MULTICAST_LIST:
-		debug("%s: OID_802_3_MULTICAST_LIST\n", __func__);
-		/* Multicast base address only */
-		*outbuf = __constant_cpu_to_le32(0xE0000000);
-		retval = 0;
-		break;
-
-	/* mandatory */
-	case OID_802_3_MAXIMUM_LIST_SIZE:
-		debug("%s: OID_802_3_MAXIMUM_LIST_SIZE\n", __func__);
-		/* Multicast base address only */
-		*outbuf = __constant_cpu_to_le32(1);
-		retval = 0;
-		break;
-
-	case OID_802_3_MAC_OPTIONS:
-		debug("%s: OID_802_3_MAC_OPTIONS\n", __func__);
-		break;
+	{ OID_802_3_PERMANENT_ADDRESS,	OID_NEED_DEV,	oid_mac_address },
+	{ OID_802_3_CURRENT_ADDRESS,	OID_NEED_DEV,	oid_mac_address },
+	{ OID_802_3_MULTICAST_LIST,	0,		oid_multicast_list,
+						oid_set_multicast_list },
+	{ OID_802_3_MAXIMUM_LIST_SIZE,	0,		oid_max_list_size },
+	{ OID_802_3_MAC_OPTIONS,	0 },
 
 	/* ieee802.3 statistics OIDs (table 4-4) */
+	{ OID_802_3_RCV_ERROR_ALIGNMENT, OID_NEED_STATS,
+						oid_rcv_error_alignment },
+	{ OID_802_3_XMIT_ONE_COLLISION,	0,		oid_zero },
+	{ OID_802_3_XMIT_MORE_COLLISIONS, 0,		oid_zero },
+#ifdef	RNDIS_OPTIONAL_STATS
+	/* TODO */
+	{ OID_802_3_XMIT_DEFERRED,	0 },
+	{ OID_802_3_XMIT_MAX_COLLISIONS, 0 },
+	{ OID_802_3_RCV_OVERRUN,	0 },
+	{ OID_802_3_XMIT_UNDERRUN,	0 },
+	{ OID_802_3_XMIT_HEARTBEAT_FAILURE, 0 },
+	{ OID_802_3_XMIT_TIMES_CRS_LOST, 0 },
+	{ OID_802_3_XMIT_LATE_COLLISIONS, 0 },
+#endif	/* RNDIS_OPTIONAL_STATS */
 
-	/* mandatory */
-	case OID_802_3_RCV_ERROR_ALIGNMENT:
-		debug("%s: OID_802_3_RCV_ERROR_ALIGNMENT\n", __func__);
-		if (params->stats) {
-			*outbuf = cpu_to_le32(params->stats->rx_frame_errors);
-			retval = 0;
-		}
-		break;
+#ifdef	RNDIS_PM
+	/* PM and wakeup are mandatory for USB: */
 
-	/* mandatory */
-	case OID_802_3_XMIT_ONE_COLLISION:
-		debug("%s: OID_802_3_XMIT_ONE_COLLISION\n", __func__);
-		*outbuf = __constant_cpu_to_le32(0);
-		retval = 0;
-		break;
+	/* power management OIDs (table 4-5) */
+	{ OID_PNP_CAPABILITIES,		0,		oid_pnp_capabilities },
+	{ OID_PNP_SET_POWER,		0,		NULL,
+						oid_set_pnp_power },
+	{ OID_PNP_QUERY_POWER,		0,		oid_pnp_query_power },
 
-	/* mandatory */
-	case OID_802_3_XMIT_MORE_COLLISIONS:
-		debug("%s: OID_802_3_XMIT_MORE_COLLISIONS\n", __func__);
-		*outbuf = __constant_cpu_to_le32(0);
-		retval = 0;
-		break;
+#ifdef	RNDIS_WAKEUP
+	/*
+	 * no wakeup support advertised, so wakeup OIDs always fail:
+	 */
+	{ OID_PNP_ADD_WAKE_UP_PATTERN,	0 },
+	{ OID_PNP_REMOVE_WAKE_UP_PATTERN, 0 },
+	{ OID_PNP_ENABLE_WAKE_UP,	0 },
+#endif	/* RNDIS_WAKEUP */
+#endif	/* RNDIS_PM */
+};
 
-#ifdef	RNDIS_OPTIONAL_STATS
-	case OID_802_3_XMIT_DEFERRED:
-		debug("%s: OID_802_3_XMIT_DEFERRED\n", __func__);
-		/* TODO */
-		break;
+static const unsigned oid_table_size = ARRAY_SIZE(oid_table);
 
-	case OID_802_3_XMIT_MAX_COLLISIONS:
-		debug("%s: OID_802_3_XMIT_MAX_COLLISIONS\n", __func__);
-		/* TODO */
-		break;
+static int oid_supported_list(rndis_params *params, u8 *buf,
+				unsigned buf_len, __le32 *outbuf, u32 *length)
+{
+	int	i, count = 0;
 
-	case OID_802_3_RCV_OVERRUN:
-		debug("%s: OID_802_3_RCV_OVERRUN\n", __func__);
-		/* TODO */
-		break;
+	for (i = 0; i < oid_table_size; i++)
+		if (!(oid_table[i].flags & OID_HIDDEN))
+			outbuf[count++] = cpu_to_le32(oid_table[i].oid);
+	*length = count * sizeof(u32);
+	return 0;
+}
 
-	case OID_802_3_XMIT_UNDERRUN:
-		debug("%s: OID_802_3_XMIT_UNDERRUN\n", __func__);
-		/* TODO */
-		break;
+static const struct rndis_oid *rndis_find_oid(u32 OID)
+{
+	unsigned	lo = 0, hi = oid_table_size, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (oid_table[mid].oid == OID)
+			return &oid_table[mid];
+		if (oid_table[mid].oid < OID)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
 
-	case OID_802_3_XMIT_HEARTBEAT_FAILURE:
-		debug("%s: OID_802_3_XMIT_HEARTBEAT_FAILURE\n", __func__);
-		/* TODO */
-		break;
+static int rndis_oid_usable(const struct rndis_oid *o, rndis_params *params)
+{
+	if ((o->flags & OID_NEED_DEV) && !params->dev)
+		return 0;
+	if ((o->flags & OID_NEED_STATS) && !params->stats)
+		return 0;
+	return 1;
+}
 
-	case OID_802_3_XMIT_TIMES_CRS_LOST:
-		debug("%s: OID_802_3_XMIT_TIMES_CRS_LOST\n", __func__);
-		/* TODO */
-		break;
 
-	case OID_802_3_XMIT_LATE_COLLISIONS:
-		debug("%s: OID_802_3_XMIT_LATE_COLLISIONS\n", __func__);
-		/* TODO */
-		break;
-#endif	/* RNDIS_OPTIONAL_STATS */
+/* NDIS Functions */
+static int gen_ndis_query_resp(int configNr, u32 OID, u8 *buf,
+				unsigned buf_len, rndis_resp_t *r)
+{
+	int				retval = -ENOTSUPP;
+	u32				length = 4;	/* usually */
+	const struct rndis_oid		*o;
+	rndis_query_cmplt_type		*resp;
+	rndis_params			*params;
+#if defined(DEBUG) && defined(DEBUG_VERBOSE)
+	int				i;
+#endif
 
-#ifdef	RNDIS_PM
-	/* power management OIDs (table 4-5) */
-	case OID_PNP_CAPABILITIES:
-		debug("%s: OID_PNP_CAPABILITIES\n", __func__);
+	if (!r)
+		return -ENOMEM;
+	resp = (rndis_query_cmplt_type *) r->buf;
 
-		/* for now, no wakeup capabilities */
-		length = sizeof(struct NDIS_PNP_CAPABILITIES);
-		memset(outbuf, 0, length);
-		retval = 0;
-		break;
-	case OID_PNP_QUERY_POWER:
-		debug("%s: OID_PNP_QUERY_POWER D%d\n", __func__,
-				get_unaligned_le32(buf) - 1);
-		/*
-		 * only suspend is a real power state, and
-		 * it can't be entered by OID_PNP_SET_POWER...
-		 */
-		length = 0;
-		retval = 0;
-		break;
+#if defined(DEBUG) && defined(DEBUG_VERBOSE)
+	if (buf_len) {
+		debug("query OID %08x value, len %d:\n", OID, buf_len);
+		for (i = 0; i < buf_len; i += 16) {
+			debug("%03d: %08x %08x %08x %08x\n", i,
+				get_unaligned_le32(&buf[i]),
+				get_unaligned_le32(&buf[i + 4]),
+				get_unaligned_le32(&buf[i + 8]),
+				get_unaligned_le32(&buf[i + 12]));
+		}
+	}
 #endif
 
-	default:
-		debug("%s: query unknown OID 0x%08X\n", __func__, OID);
-	}
+	/* response goes here, right after the header */
+	resp->InformationBufferOffset = __constant_cpu_to_le32(16);
+
+	params = &rndis_per_dev_params[configNr];
+	o = rndis_find_oid(OID);
+	if (o && o->query && rndis_oid_usable(o, params))
+		retval = o->query(params, buf, buf_len,
+				(__le32 *) &resp[1], &length);
+	else
+		debug("%s: query unsupported OID 0x%08X\n", __func__, OID);
 	if (retval < 0)
 		length = 0;
 
@@ -657,18 +624,15 @@ static int gen_ndis_query_resp(int configNr, u32 OID, u8 *buf,
 static int gen_ndis_set_resp(u8 configNr, u32 OID, u8 *buf, u32 buf_len,
 				rndis_resp_t *r)
 {
-	rndis_set_cmplt_type		*resp;
+	const struct rndis_oid		*o;
 	int				retval = -ENOTSUPP;
 	struct rndis_params		*params;
-#if (defined(DEBUG) && defined(DEBUG_VERBOSE)) || defined(RNDIS_PM)
+#if defined(DEBUG) && defined(DEBUG_VERBOSE)
 	int				i;
 #endif
 
 	if (!r)
 		return -ENOMEM;
-	resp = (rndis_set_cmplt_type *) r->buf;
-	if (!resp)
-		return -ENOMEM;
 
 #if defined(DEBUG) && defined(DEBUG_VERBOSE)
 	if (buf_len) {
@@ -684,91 +648,12 @@ static int gen_ndis_set_resp(u8 configNr, u32 OID, u8 *buf, u32 buf_len,
 #endif
 
 	params = &rndis_per_dev_params[configNr];
-	switch (OID) {
-	case OID_GEN_CURRENT_PACKET_FILTER:
-
-		/*
-		 * these NDIS_PACKET_TYPE_* bitflags are shared with
-		 * cdc_filter; it's not RNDIS-specific
-		 * NDIS_PACKET_TYPE_x == USB_CDC_PACKET_TYPE_x for x in:
-		 *	PROMISCUOUS, DIRECTED,
-		 *	MULTICAST, ALL_MULTICAST, BROADCAST
-		 */
-		*params->filter = (u16) get_unaligned_le32(buf);
-		debug("%s: OID_GEN_CURRENT_PACKET_FILTER %08x\n",
-			__func__, *params->filter);
-
-		/*
-		 * this call has a significant side effect:  it's
-		 * what makes the packet flow start and stop, like
-		 * activating the CDC Ethernet altsetting.
-		 */
-#ifdef	RNDIS_PM
-update_linkstate:
-#endif
-		retval = 0;
-		if (*params->filter)
-			params->state = RNDIS_DATA_INITIALIZED;
-		else
-			params->state = RNDIS_INITIALIZED;
-		break;
-
-	case OID_802_3_MULTICAST_LIST:
-		/* I think we can ignore this */
-		debug("%s: OID_802_3_MULTICAST_LIST\n", __func__);
-		retval = 0;
-		break;
-#if 0
-	case OID_GEN_RNDIS_CONFIG_PARAMETER:
-		{
-		struct rndis_config_parameter	*param;
-		param = (struct rndis_config_parameter *) buf;
-		debug("%s: OID_GEN_RNDIS_CONFIG_PARAMETER '%*s'\n",
-			__func__,
-			min(cpu_to_le32(param->ParameterNameLength), 80),
-			buf + param->ParameterNameOffset);
-		retval = 0;
-		}
-		break;
-#endif
-
-#ifdef	RNDIS_PM
-	case OID_PNP_SET_POWER:
-		/*
-		 * The only real power state is USB suspend, and RNDIS requests
-		 * can't enter it; this one isn't really about power.  After
-		 * resuming, Windows forces a reset, and then SET_POWER D0.
-		 * FIXME ... then things go batty; Windows wedges itself.
-		 */
-		i = get_unaligned_le32(buf);
-		debug("%s: OID_PNP_SET_POWER D%d\n", __func__, i - 1);
-		switch (i) {
-		case NdisDeviceStateD0:
-			*params->filter = params->saved_filter;
-			goto update_linkstate;
-		case NdisDeviceStateD3:
-		case NdisDeviceStateD2:
-		case NdisDeviceStateD1:
-			params->saved_filter = *params->filter;
-			retval = 0;
-			break;
-		}
-		break;
-
-#ifdef	RNDIS_WAKEUP
-	/*
-	 * no wakeup support advertised, so wakeup OIDs always fail:
-	 *  - OID_PNP_ENABLE_WAKE_UP
-	 *  - OID_PNP_{ADD,REMOVE}_WAKE_UP_PATTERN
-	 */
-#endif
-
-#endif	/* RNDIS_PM */
-
-	default:
-		debug("%s: set unknown OID 0x%08X, size %d\n",
+	o = rndis_find_oid(OID);
+	if (o && o->set && rndis_oid_usable(o, params))
+		retval = o->set(params, buf, buf_len);
+	else
+		debug("%s: set unsupported OID 0x%08X, size %d\n",
 			__func__, OID, buf_len);
-	}
 
 	return retval;
 }
@@ -829,10 +714,10 @@ static int rndis_query_response(int configNr, rndis_query_msg_type *buf)
 	 * we need more memory:
 	 * gen_ndis_query_resp expects enough space for
 	 * rndis_query_cmplt_type followed by data.
-	 * oid_supported_list is the largest data reply
+	 * OID_GEN_SUPPORTED_LIST is the largest data reply
 	 */
-	r = rndis_add_response(configNr,
-		sizeof(oid_supported_list) + sizeof(rndis_query_cmplt_type));
+	r = rndis_add_response(configNr, ARRAY_SIZE(oid_table) * sizeof(u32)
+					+ sizeof(rndis_query_cmplt_type));
 	if (!r)
 		return -ENOMEM;
 	resp = (rndis_query_cmplt_type *) r->buf;
@@ -1209,59 +1094,55 @@ void rndis_add_hdr(void *buf, int length)
 	header->DataLength = cpu_to_le32(length);
 }
 
+/*
+ * Responses are handed out and freed in the order they were added, so
+ * the ring only needs to check that buf is the oldest one outstanding.
+ */
 void rndis_free_response(int configNr, u8 *buf)
 {
+	rndis_params		*params = &rndis_per_dev_params[configNr];
 	rndis_resp_t		*r;
-	struct list_head	*act, *tmp;
-
-	list_for_each_safe(act, tmp,
-			&(rndis_per_dev_params[configNr].resp_queue))
-	{
-		r = list_entry(act, rndis_resp_t, list);
-		if (r && r->buf == buf) {
-			list_del(&r->list);
-			free(r);
-		}
-	}
+
+	if (params->resp_tail == params->resp_sent)
+		return;
+
+	r = &params->resp_ring[params->resp_tail % RNDIS_RESP_RING_SIZE];
+	if (r->buf == buf)
+		params->resp_tail++;
+	else
+		debug("%s: %p is not the oldest response\n", __func__, buf);
 }
 
 u8 *rndis_get_next_response(int configNr, u32 *length)
 {
+	rndis_params		*params = &rndis_per_dev_params[configNr];
 	rndis_resp_t		*r;
-	struct list_head	*act, *tmp;
 
-	if (!length)
+	if (!length || params->resp_sent == params->resp_head)
 		return NULL;
 
-	list_for_each_safe(act, tmp,
-			&(rndis_per_dev_params[configNr].resp_queue))
-	{
-		r = list_entry(act, rndis_resp_t, list);
-		if (!r->send) {
-			r->send = 1;
-			*length = r->length;
-			return r->buf;
-		}
-	}
-
-	return NULL;
+	r = &params->resp_ring[params->resp_sent++ % RNDIS_RESP_RING_SIZE];
+	*length = r->length;
+	return r->buf;
 }
 
 static rndis_resp_t *rndis_add_response(int configNr, u32 length)
 {
+	rndis_params	*params = &rndis_per_dev_params[configNr];
 	rndis_resp_t	*r;
 
 	/* NOTE:  this gets copied into ether.c USB_BUFSIZ bytes ... */
-	r = malloc(sizeof(rndis_resp_t) + length);
-	if (!r)
+	if (length > RNDIS_RESP_BUF_SIZE)
 		return NULL;
 
-	r->buf = (u8 *) (r + 1);
-	r->length = length;
-	r->send = 0;
+	/* host isn't reading them; fail rather than drop older replies */
+	if (params->resp_head - params->resp_tail >= RNDIS_RESP_RING_SIZE) {
+		debug("%s: response ring full\n", __func__);
+		return NULL;
+	}
 
-	list_add_tail(&r->list,
-		&(rndis_per_dev_params[configNr].resp_queue));
+	r = &params->resp_ring[params->resp_head++ % RNDIS_RESP_RING_SIZE];
+	r->length = length;
 	return r;
 }
 
@@ -1298,13 +1179,23 @@ int rndis_init(void)
 {
 	u8 i;
 
+#ifdef DEBUG
+	/* rndis_find_oid() bisects, so a misplaced entry goes missing */
+	for (i = 1; i < oid_table_size; i++)
+		if (oid_table[i - 1].oid >= oid_table[i].oid)
+			printf("%s: OID 0x%08X out of order\n",
+				__func__, oid_table[i].oid);
+#endif
+
 	for (i = 0; i < RNDIS_MAX_CONFIGS; i++) {
 		rndis_per_dev_params[i].confignr = i;
 		rndis_per_dev_params[i].used = 0;
 		rndis_per_dev_params[i].state = RNDIS_UNINITIALIZED;
 		rndis_per_dev_params[i].media_state
 				= NDIS_MEDIA_STATE_DISCONNECTED;
-		INIT_LIST_HEAD(&(rndis_per_dev_params[i].resp_queue));
+		rndis_per_dev_params[i].resp_head = 0;
+		rndis_per_dev_params[i].resp_sent = 0;
+		rndis_per_dev_params[i].resp_tail = 0;
 	}
 
 	return 0;
@@ -206,11 +206,18 @@ enum rndis_state {
 	RNDIS_DATA_INITIALIZED,
 };
 
+/*
+ * Control responses are kept in a fixed ring per config rather than in
+ * the malloc arena.  The largest one is the OID_GEN_SUPPORTED_LIST query
+ * reply, and ether.c copies each into its USB_BUFSIZ (256 byte) buffer.
+ */
+#define RNDIS_RESP_RING_SIZE	8	/* power of two */
+#define RNDIS_RESP_BUF_SIZE	256
+
 typedef struct rndis_resp_t {
-	struct list_head	list;
-	u8			*buf;
+	u8			buf[RNDIS_RESP_BUF_SIZE]
+					__attribute__ ((aligned(4)));
 	u32			length;
-	int			send;
 } rndis_resp_t;
 
 typedef struct rndis_params {
@@ -231,7 +238,12 @@ typedef struct rndis_params {
 	u32			vendorID;
 	const char		*vendorDescr;
 	int			(*ack)(struct eth_device *);
-	struct list_head	resp_queue;
+
+	/* free running; slot is index % RNDIS_RESP_RING_SIZE */
+	rndis_resp_t		resp_ring[RNDIS_RESP_RING_SIZE];
+	unsigned		resp_head;	/* next slot to fill */
+	unsigned		resp_sent;	/* next slot to hand out */
+	unsigned		resp_tail;	/* oldest slot not yet freed */
 } rndis_params;
 
 /* RNDIS Message parser and other useless functions */
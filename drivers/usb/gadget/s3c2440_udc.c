@@ -1704,7 +1704,8 @@ int s3c2410_udc_probe(struct s3c2410_plat_udc_data *pdata)
 	s3c2410_udc_disable(udc);
 	s3c2410_udc_reinit(udc);
 
-	writel(~BIT_USBD, &irq->INTMSK);
+	/* leave the other sources (NAND R/B) as they are */
+	writel(readl(&irq->INTMSK) & ~BIT_USBD, &irq->INTMSK);
 
 	/* don't put printf here */
 	/* usbinfo("%s\n", __func__); */
@@ -38,6 +38,7 @@
 #define CONFIG_S3C2440	1	/* specifically a SAMSUNG S3C2440 SoC	*/
 #define CONFIG_SMDK2440	1	/* on a SAMSUNG SMDK2440 Board  */
 #define	CONFIG_MINI2440_LED
+#define CONFIG_DISPLAY_BOARDINFO	/* also reports the NAND boot time */
 
 /* input clock of PLL */
 #define CONFIG_SYS_CLK_FREQ	12000000/* the SMDK2440 has 12MHz input clock */
@@ -54,7 +55,8 @@
 /*
  * Size of malloc() pool
  */
-#define CONFIG_SYS_MALLOC_LEN		(CONFIG_ENV_SIZE + 128*1024)
+/* room for a NAND block, for nandstats scrubbing */
+#define CONFIG_SYS_MALLOC_LEN		(CONFIG_ENV_SIZE + 256*1024)
 #define CONFIG_SYS_GBL_DATA_SIZE	128	/* size in bytes reserved for initial data */
 
 /*
@@ -113,7 +115,21 @@
 #define CONFIG_SYS_MAX_NAND_DEVICE	1
 #define CONFIG_SYS_NAND_BASE		0x4E000000
 #define CONFIG_NAND_S3C2410
+#define CONFIG_S3C2410_NAND_HWECC
+#define CONFIG_SYS_NAND_ECCSIZE		512
+#define CONFIG_SYS_NAND_ECCBYTES	3
+#define CONFIG_S3C2410_NAND_BBT		/* table + mirror in the last blocks */
+#define CONFIG_S3C2410_NAND_IRQ		/* R/B edge interrupt, needs USE_IRQ */
+#define CONFIG_S3C2410_NAND_CACHE	/* cache program on 2K pages */
+/* ns, for stage 1 and chips missing from the driver's timing table */
+#define CONFIG_SYS_NAND_TACLS		0
+#define CONFIG_SYS_NAND_TWRPH0		25
+#define CONFIG_SYS_NAND_TWRPH1		15
 #define CONFIG_MTD_NAND_VERIFY_WRITE
+#define CONFIG_NAND_STATS		/* wear and ECC counts, "nandstats" */
+#define CONFIG_NAND_SCRUB_THRESHOLD	1
+/* mtdparts names of the raw images, the only ones scrubbed */
+#define CONFIG_NAND_SCRUB_PARTS		"recovery,boot"
 
 #define CONFIG_MTD_DEVICE
 #define CONFIG_MTD_PARTITIONS
@@ -146,9 +162,12 @@
 #if 0
 #define CONFIG_USB_G_SECBULK
 #define CONFIG_USB_G_LED
+#define CONFIG_USB_G_ZERO	/* bulk benchmark, see tools/usbbench */
 
 #define CONFIG_USB_ETHER
 #define CONFIG_USB_ETH_RNDIS
+#define CONFIG_USB_ETH_NCM	/* "setenv usbnet_mode ecm" for CDC ECM */
+#define CONFIG_USB_ETH_CSUM	/* check RX, fill TX UDP checksums */
 #endif
 
 #ifdef CONFIG_USB_ETHER
@@ -201,7 +220,17 @@
 
 #define CONFIG_BOOTFILE		"uImage"
 #define CONFIG_BOOTCMD_TFTP	"tftp 31000000 u-boot.bin; go 31000000"
+
+/* read the kernel during the autoboot countdown, see nand_boot.c */
+#define CONFIG_NAND_READAHEAD
+#define CONFIG_NAND_BOOT_OFFSET	0x80000
+#define CONFIG_NAND_BOOT_SIZE	0x300000
+
+#ifdef CONFIG_NAND_READAHEAD
+#define CONFIG_BOOTCMD_NAND	"nandboot 33000000 80000 300000"
+#else
 #define CONFIG_BOOTCMD_NAND	"nand read 33000000 80000 300000;bootm 33000000"
+#endif
 
 #define CONFIG_HOSTNAME		mini2440
 #define CONFIG_ROOTPATH		/opt/nfsroot
@@ -278,17 +307,13 @@
  * FLASH and environment organization
  */
 
-#define CONFIG_AMD_LV800	1	/* uncomment this if you have a LV800 flash */
-
+/* size and sectors come from the chip's CFI query */
 #define CONFIG_SYS_MAX_FLASH_BANKS	1	/* max number of memory banks */
-#ifdef CONFIG_AMD_LV800
-# define PHYS_FLASH_SIZE		0x00100000 /* 1MB */
-# define CONFIG_SYS_MAX_FLASH_SECT	(19)	/* max number of sectors on one chip */
-# define CONFIG_ENV_ADDR		(CONFIG_SYS_FLASH_BASE + 0x0F0000) /* addr of environment */
-#endif
+#define CONFIG_SYS_MAX_FLASH_SECT	(512)	/* 2MB in 4KB sectors (SST39VF1601) */
+#define CONFIG_ENV_ADDR		(CONFIG_SYS_FLASH_BASE + 0x0F0000) /* addr of environment */
 
 
-/* timeout values are in ticks */
+/* timeout values are in ticks, for chips whose CFI query has none */
 #define CONFIG_SYS_FLASH_ERASE_TOUT	(5*CONFIG_SYS_HZ) /* Timeout for Flash Erase */
 #define CONFIG_SYS_FLASH_WRITE_TOUT	(5*CONFIG_SYS_HZ) /* Timeout for Flash Write */
 
@@ -312,5 +337,11 @@
 
 #define	CONFIG_LL_INIT_NAND_ONLY
 #define CONFIG_S3C2440_NAND_BOOT
+/*
+ * second U-Boot copy loaded when the first fails its checksum, e.g. in
+ * a spare 256K at the end of the U-Boot partition once it is enlarged.
+ * Without one, a copy that fails its sum still boots, with a warning.
+ */
+/* #define CONFIG_NAND_RECOVERY_OFFSET	0x40000 */
 
 #endif	/* __CONFIG_H */
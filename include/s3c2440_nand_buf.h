@@ -0,0 +1,63 @@
+/*
+ * S3C2440 NFDATA buffer loops, shared by drivers/mtd/nand/s3c2410_nand.c
+ * and the host side tools/nandbuf.c
+ *
+ * This include file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * The S3C2440 NFDATA register also takes word accesses, which the
+ * controller splits into four 8-bit bus cycles, lowest byte first.
+ * Moving the aligned middle of a buffer that way costs one bus access
+ * per four bytes instead of one per byte.  The includer provides
+ * readb(), readl(), writeb() and writel().
+ */
+
+#ifndef __S3C2440_NAND_BUF_H
+#define __S3C2440_NAND_BUF_H
+
+static inline void s3c2440_nand_read_buf(void *io, u_char *buf, int len)
+{
+	u_int32_t *p;
+
+	for (; len > 0 && ((ulong)buf & 3); len--)
+		*buf++ = readb(io);
+
+	p = (u_int32_t *)buf;
+	for (; len >= 16; len -= 16, p += 4) {
+		p[0] = readl(io);
+		p[1] = readl(io);
+		p[2] = readl(io);
+		p[3] = readl(io);
+	}
+	for (; len >= 4; len -= 4)
+		*p++ = readl(io);
+
+	for (buf = (u_char *)p; len > 0; len--)
+		*buf++ = readb(io);
+}
+
+static inline void s3c2440_nand_write_buf(void *io, const u_char *buf,
+		int len)
+{
+	const u_int32_t *p;
+
+	for (; len > 0 && ((ulong)buf & 3); len--)
+		writeb(*buf++, io);
+
+	p = (const u_int32_t *)buf;
+	for (; len >= 16; len -= 16, p += 4) {
+		writel(p[0], io);
+		writel(p[1], io);
+		writel(p[2], io);
+		writel(p[3], io);
+	}
+	for (; len >= 4; len -= 4)
+		writel(*p++, io);
+
+	for (buf = (const u_char *)p; len > 0; len--)
+		writeb(*buf++, io);
+}
+
+#endif	/* __S3C2440_NAND_BUF_H */
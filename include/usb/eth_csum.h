@@ -0,0 +1,174 @@
+/*
+ * Internet checksum for the USB ethernet gadget, shared by
+ * drivers/usb/gadget/ether.c and the host side tools/csumcheck.c
+ *
+ * This include file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * Sums are kept in the byte order of the CPU: the ones' complement sum
+ * of the 16-bit words in memory order comes out right either way, so a
+ * folded result can be stored into a header as it is.
+ */
+
+#ifndef __USB_ETH_CSUM_H
+#define __USB_ETH_CSUM_H
+
+#define ETH_CSUM_ETHERTYPE_IP	0x0800
+#define ETH_CSUM_PROTO_UDP	17
+
+/*
+ * Ones' complement sum of len bytes at buf, added to sum; fold it with
+ * eth_csum_fold().  The aligned middle is read four words at a time
+ * into a 64-bit accumulator, which on the ARM920T is an ldm and an
+ * adds/adc pair per word, instead of a load, shift and add per byte.
+ * The carries out of the low half are added back once, at the end.
+ */
+static inline uint32_t eth_csum_partial(const void *buf, uint32_t len,
+		uint32_t sum)
+{
+	const uint8_t	*p = buf;
+	uint64_t	acc = sum;
+	uint16_t	h;
+
+	if ((unsigned long)p & 1) {
+		/* odd start: halfwords, the slow way */
+		for (; len >= 2; len -= 2, p += 2) {
+			memcpy(&h, p, 2);
+			acc += h;
+		}
+	} else {
+		if (((unsigned long)p & 2) && len >= 2) {
+			acc += *(const uint16_t *)p;
+			p += 2;
+			len -= 2;
+		}
+		for (; len >= 16; len -= 16, p += 16) {
+			const uint32_t	*w = (const uint32_t *)p;
+
+			acc += (uint64_t)w[0] + w[1] + w[2] + w[3];
+		}
+		for (; len >= 4; len -= 4, p += 4)
+			acc += *(const uint32_t *)p;
+		if (len >= 2) {
+			acc += *(const uint16_t *)p;
+			p += 2;
+			len -= 2;
+		}
+	}
+	if (len) {
+		/* the odd byte is the first of a zero padded halfword */
+		h = 0;
+		memcpy(&h, p, 1);
+		acc += h;
+	}
+
+	acc = (acc & 0xffffffff) + (acc >> 32);
+	acc = (acc & 0xffffffff) + (acc >> 32);
+	return acc;
+}
+
+/* folds a sum to 16 bits and complements it: 0 when a checksum checks */
+static inline uint16_t eth_csum_fold(uint32_t sum)
+{
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+/*
+ * Finds the UDP header of an unfragmented IPv4 frame of len bytes.
+ * Returns 1 if there is one, 0 for other frames, and -1 if the UDP
+ * length doesn't fit the IP datagram.
+ */
+static inline int eth_csum_udp(uint8_t *frame, uint32_t len,
+		uint8_t **udp, uint32_t *udp_len)
+{
+	uint8_t		*ip = frame + 14;
+	uint32_t	ihl, tot;
+
+	if (len < 14 + 20 || frame[12] != (ETH_CSUM_ETHERTYPE_IP >> 8) ||
+	    frame[13] != (ETH_CSUM_ETHERTYPE_IP & 0xff))
+		return 0;
+	ihl = (ip[0] & 0x0f) * 4;
+	tot = (ip[2] << 8) | ip[3];
+	if ((ip[0] >> 4) != 4 || ihl < 20 || tot < ihl + 8 ||
+	    14 + tot > len || ip[9] != ETH_CSUM_PROTO_UDP ||
+	    ((ip[6] & 0x3f) | ip[7]))	/* MF or an offset */
+		return 0;
+
+	*udp = ip + ihl;
+	*udp_len = (ip[ihl + 4] << 8) | ip[ihl + 5];
+	if (*udp_len < 8 || *udp_len > tot - ihl)
+		return -1;
+	return 1;
+}
+
+/* sum of the UDP pseudo header */
+static inline uint32_t eth_csum_pseudo(const uint8_t *frame,
+		uint32_t udp_len)
+{
+	uint8_t		ph[12];
+
+	memcpy(ph, frame + 14 + 12, 8);		/* source, destination */
+	ph[8] = 0;
+	ph[9] = ETH_CSUM_PROTO_UDP;
+	ph[10] = udp_len >> 8;
+	ph[11] = udp_len;
+	return eth_csum_partial(ph, sizeof ph, 0);
+}
+
+/*
+ * Checks the IPv4 header checksum of a received frame, and its UDP
+ * checksum if it has one.  Returns 0 if both are right or the frame
+ * isn't IPv4, -1 otherwise, also for a UDP length that doesn't fit.
+ */
+static inline int eth_csum_rx_check(uint8_t *frame, uint32_t len)
+{
+	uint8_t		*udp;
+	uint32_t	udp_len;
+	int		ret;
+
+	if (len < 14 + 20 || frame[12] != (ETH_CSUM_ETHERTYPE_IP >> 8) ||
+	    frame[13] != (ETH_CSUM_ETHERTYPE_IP & 0xff) ||
+	    (frame[14] & 0xf0) != 0x40)
+		return 0;
+	if (14 + (frame[14] & 0x0f) * 4 > len ||
+	    eth_csum_fold(eth_csum_partial(frame + 14,
+				(frame[14] & 0x0f) * 4, 0)))
+		return -1;
+
+	ret = eth_csum_udp(frame, len, &udp, &udp_len);
+	if (ret <= 0)
+		return ret;
+	if (!udp[6] && !udp[7])		/* sent without one */
+		return 0;
+	if (eth_csum_fold(eth_csum_partial(udp, udp_len,
+				eth_csum_pseudo(frame, udp_len))))
+		return -1;
+	return 0;
+}
+
+/*
+ * Fills in the UDP checksum of a frame about to be sent without one,
+ * as the network stack does, so that the host can check its data.
+ */
+static inline void eth_csum_tx_fill(uint8_t *frame, uint32_t len)
+{
+	uint8_t		*udp;
+	uint32_t	udp_len;
+	uint16_t	csum;
+
+	if (eth_csum_udp(frame, len, &udp, &udp_len) <= 0 ||
+	    udp[6] || udp[7])
+		return;
+
+	csum = eth_csum_fold(eth_csum_partial(udp, udp_len,
+				eth_csum_pseudo(frame, udp_len)));
+	if (!csum)
+		csum = 0xffff;		/* 0 means "none" */
+	memcpy(udp + 6, &csum, 2);
+}
+
+#endif	/* __USB_ETH_CSUM_H */
@@ -0,0 +1,181 @@
+/*
+ * CDC NCM NTB16 framing, shared by the NCM mode of
+ * drivers/usb/gadget/ether.c and the host side tools/ncmcheck.c
+ *
+ * This include file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * An NTB16 is an NTH16 header whose wNdpIndex points at a chain of
+ * NDP16 tables, each listing datagrams by index and length up to a
+ * zero entry.  Everything must lie within wBlockLength, or within the
+ * transfer when wBlockLength is 0 (NTB ended by a short packet).
+ * Fields are read and written a byte at a time, little endian, so the
+ * same code runs on the target and the host, at any alignment.
+ */
+
+#ifndef __USB_NCM_H
+#define __USB_NCM_H
+
+#define NCM_NTH16_SIGN		0x484d434e	/* "NCMH" */
+#define NCM_NDP16_NOCRC_SIGN	0x304d434e	/* "NCM0" */
+
+#define NCM_NTH16_LEN		12
+#define NCM_NDP16_LEN		8	/* without its entries */
+#define NCM_DPE16_LEN		4
+#define NCM_NDP16_ALIGN		4
+
+/* where ncm_ntb16_single() puts the datagram */
+#define NCM_NTB16_DGRAM		32
+
+struct ncm_ntb16 {
+	const uint8_t	*ntb;
+	uint32_t	len;		/* wBlockLength, or the transfer */
+	uint32_t	ndp;		/* index of the current NDP16 */
+	uint32_t	ndp_len;
+	uint32_t	dpe;		/* next entry, from the NDP16 */
+};
+
+static inline uint32_t ncm_get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t ncm_get32(const uint8_t *p)
+{
+	return ncm_get16(p) | (ncm_get16(p + 2) << 16);
+}
+
+static inline void ncm_put16(uint8_t *p, uint32_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+}
+
+static inline void ncm_put32(uint8_t *p, uint32_t val)
+{
+	ncm_put16(p, val);
+	ncm_put16(p + 2, val >> 16);
+}
+
+/* checks the NDP16 at index and makes it the current one */
+static inline int ncm_ntb16_ndp(struct ncm_ntb16 *it, uint32_t index)
+{
+	const uint8_t	*ndp = it->ntb + index;
+	uint32_t	len;
+
+	if (index < NCM_NTH16_LEN || index % NCM_NDP16_ALIGN
+			|| index + NCM_NDP16_LEN > it->len)
+		return -1;
+
+	len = ncm_get16(ndp + 4);
+	if (ncm_get32(ndp) != NCM_NDP16_NOCRC_SIGN
+			|| len < NCM_NDP16_LEN + 2 * NCM_DPE16_LEN
+			|| index + len > it->len)
+		return -1;
+
+	it->ndp = index;
+	it->ndp_len = len;
+	it->dpe = NCM_NDP16_LEN;
+	return 0;
+}
+
+/*
+ * Checks the NTH16 and the first NDP16 of the len bytes received at
+ * ntb.  Returns 0 with it set up for ncm_ntb16_next(), or -1 if the
+ * NTB is malformed.
+ */
+static inline int ncm_ntb16_begin(struct ncm_ntb16 *it, const uint8_t *ntb,
+		uint32_t len)
+{
+	uint32_t	block;
+
+	if (len < NCM_NTH16_LEN
+			|| ncm_get32(ntb) != NCM_NTH16_SIGN
+			|| ncm_get16(ntb + 4) != NCM_NTH16_LEN)
+		return -1;
+
+	block = ncm_get16(ntb + 8);
+	if (block) {
+		if (block > len)
+			return -1;
+		len = block;
+	}
+
+	it->ntb = ntb;
+	it->len = len;
+	return ncm_ntb16_ndp(it, ncm_get16(ntb + 10));
+}
+
+/*
+ * The next datagram: returns 1 with its index and length, 0 after the
+ * last one, or -1 if the NTB is malformed.  A datagram that doesn't lie
+ * within the NTB makes the whole NTB malformed, and so does an NDP16
+ * chained to one at or before itself.
+ */
+static inline int ncm_ntb16_next(struct ncm_ntb16 *it, uint32_t *index,
+		uint32_t *len)
+{
+	const uint8_t	*ndp;
+	uint32_t	next;
+
+	for (;;) {
+		ndp = it->ntb + it->ndp;
+
+		if (it->dpe + NCM_DPE16_LEN <= it->ndp_len) {
+			*index = ncm_get16(ndp + it->dpe);
+			*len = ncm_get16(ndp + it->dpe + 2);
+			it->dpe += NCM_DPE16_LEN;
+			if (*index && *len) {
+				if (*index < NCM_NTH16_LEN
+						|| *index + *len > it->len)
+					return -1;
+				return 1;
+			}
+		}
+
+		/*
+		 * Zero entry, or the end of the table: on to the next.  Only
+		 * forward, so a chain can't go round in circles.
+		 */
+		next = ncm_get16(ndp + 6);
+		if (!next)
+			return 0;
+		if (next <= it->ndp || ncm_ntb16_ndp(it, next))
+			return -1;
+	}
+}
+
+/*
+ * Builds a single-datagram NTB16 in the size bytes at buf: NTH16, one
+ * NDP16 with its zero entry, and len bytes of dgram at NCM_NTB16_DGRAM.
+ * Returns the NTB length, or -1 if it doesn't fit.
+ */
+static inline int ncm_ntb16_single(uint8_t *buf, uint32_t size,
+		uint32_t seq, const void *dgram, uint32_t len)
+{
+	uint8_t		*ndp = buf + NCM_NTH16_LEN;
+	uint32_t	total = NCM_NTB16_DGRAM + len;
+
+	if (total > size || total > 0xffff)
+		return -1;
+
+	ncm_put32(buf, NCM_NTH16_SIGN);
+	ncm_put16(buf + 4, NCM_NTH16_LEN);
+	ncm_put16(buf + 6, seq);
+	ncm_put16(buf + 8, total);
+	ncm_put16(buf + 10, NCM_NTH16_LEN);
+
+	ncm_put32(ndp, NCM_NDP16_NOCRC_SIGN);
+	ncm_put16(ndp + 4, NCM_NDP16_LEN + 2 * NCM_DPE16_LEN);
+	ncm_put16(ndp + 6, 0);
+	ncm_put16(ndp + 8, NCM_NTB16_DGRAM);
+	ncm_put16(ndp + 10, len);
+	ncm_put32(ndp + 12, 0);		/* terminator */
+
+	memcpy(buf + NCM_NTB16_DGRAM, dgram, len);
+	return total;
+}
+
+#endif	/* __USB_NCM_H */
@@ -0,0 +1,116 @@
+/*
+ * secbulk download protocol, shared by drivers/usb/gadget/g_secbulk.c
+ * and the host side tools/boot_usb.c
+ *
+ * This include file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * The original protocol is one stream: 4 bytes load address, 4 bytes
+ * total length (header and checksum included), the image, and a 16-bit
+ * byte sum of the image.  It is still accepted.
+ *
+ * The chunked protocol sends the image as a series of chunks, each one
+ * a struct secbulk_chunk in its own bulk transfer, followed by len
+ * payload bytes in the next.  The gadget only takes a chunk whose
+ * offset is the end of what it already has, and whose payload matches
+ * csum.  The host reads struct secbulk_status on ep0 whenever it wants
+ * (SECBULK_REQ_STATUS) and continues from "received", so a transfer
+ * interrupted by a disconnect resumes where it stopped.  A chunk with
+ * offset 0 always starts a new download.
+ */
+
+#ifndef __USB_SECBULK_H
+#define __USB_SECBULK_H
+
+/* never a valid SDRAM address, so it can't be a v1 header */
+#define SECBULK_MAGIC		0x4b425353	/* "SSBK" */
+
+/* largest payload per chunk */
+#define SECBULK_CHUNK_MAX	4096
+
+struct secbulk_chunk {
+	uint32_t	magic;		/* SECBULK_MAGIC */
+	uint32_t	seq;		/* must be status.next_seq */
+	uint32_t	addr;		/* load address of the image */
+	uint32_t	total;		/* image length */
+	uint32_t	offset;		/* of this chunk within the image */
+	uint16_t	len;		/* payload bytes that follow */
+	uint16_t	csum;		/* byte sum of the payload */
+} __attribute__ ((packed));
+
+/* vendor, device recipient, IN: returns struct secbulk_status */
+#define SECBULK_REQ_STATUS	0x01
+
+#define SECBULK_STATE_IDLE	0	/* waiting for a chunk header */
+#define SECBULK_STATE_PAYLOAD	1	/* waiting for chunk payload */
+#define SECBULK_STATE_DONE	2	/* image complete */
+
+/* all fields little endian */
+struct secbulk_status {
+	uint32_t	magic;		/* SECBULK_MAGIC */
+	uint32_t	state;
+	uint32_t	addr;		/* of the current download */
+	uint32_t	total;
+	uint32_t	received;	/* verified bytes from offset 0 */
+	uint32_t	next_seq;
+	uint32_t	errors;		/* rejected chunks */
+	uint32_t	copied;		/* bytes not received in place */
+} __attribute__ ((packed));
+
+/*
+ * 16-bit byte sum of len bytes added to sum, the checksum used by both
+ * protocols.  The aligned middle is read a word at a time: even and odd
+ * bytes are masked into two accumulators with a 16-bit lane per byte
+ * pair, which are folded every 256 words, before a lane can overflow.
+ * The result is the same as adding the bytes one by one, so the gadget
+ * can sum each packet as it arrives instead of the whole image after
+ * the last one.
+ */
+static inline uint16_t secbulk_sum(const void *data, uint32_t len,
+		uint16_t sum)
+{
+	const uint8_t	*p = data;
+	uint32_t	acc = sum;
+
+	while (len && ((unsigned long)p & 3)) {
+		acc += *p++;
+		len--;
+	}
+
+	while (len >= 4) {
+		const uint32_t	*w = (const uint32_t *)p;
+		uint32_t	n = len / 4;
+		uint32_t	even = 0, odd = 0;
+
+		/* 256 words put at most 0xff00 into each lane */
+		if (n > 256)
+			n = 256;
+		p += n * 4;
+		len -= n * 4;
+
+		for (; n >= 4; n -= 4, w += 4) {
+			even += (w[0] & 0x00ff00ff) + (w[1] & 0x00ff00ff)
+				+ (w[2] & 0x00ff00ff) + (w[3] & 0x00ff00ff);
+			odd += ((w[0] >> 8) & 0x00ff00ff)
+				+ ((w[1] >> 8) & 0x00ff00ff)
+				+ ((w[2] >> 8) & 0x00ff00ff)
+				+ ((w[3] >> 8) & 0x00ff00ff);
+		}
+		for (; n; n--, w++) {
+			even += *w & 0x00ff00ff;
+			odd += (*w >> 8) & 0x00ff00ff;
+		}
+
+		acc += (even & 0xffff) + (even >> 16)
+			+ (odd & 0xffff) + (odd >> 16);
+	}
+
+	while (len--)
+		acc += *p++;
+
+	return acc;
+}
+
+#endif	/* __USB_SECBULK_H */
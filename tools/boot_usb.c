@@ -29,14 +29,17 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
 #include <errno.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 
 #include <usb.h>
+#include <usb/secbulk.h>
 
 const char *
 hexdump(const void *data, unsigned int len)
@@ -61,6 +64,7 @@ hexdump(const void *data, unsigned int len)
 #define QT2410_IN_EP	0x81
 
 static struct usb_dev_handle *hdl;
+static int maxpacket = 64;
 static struct usb_device *find_qt2410_device(void)
 {
 	struct usb_bus *bus;
@@ -81,6 +85,46 @@ static struct usb_device *find_qt2410_device(void)
 	return NULL;
 }
 
+static int qt2410_open(void)
+{
+	struct usb_device *dev;
+
+	usb_find_busses();
+	usb_find_devices();
+
+	dev = find_qt2410_device();
+	if (!dev)
+		return -ENODEV;
+
+	hdl = usb_open(dev);
+	if (!hdl) {
+		printf("Unable to open usb device: %s\n", usb_strerror());
+		return -EIO;
+	}
+
+	if (dev->config->interface->altsetting->bNumEndpoints)
+		maxpacket = dev->config->interface->altsetting
+			->endpoint->wMaxPacketSize;
+
+	if (usb_claim_interface(hdl, 0) < 0) {
+		printf("Unable to claim usb interface 1 of device: %s\n", usb_strerror());
+		usb_close(hdl);
+		hdl = NULL;
+		return -EBUSY;
+	}
+
+	return 0;
+}
+
+static void qt2410_close(void)
+{
+	if (!hdl)
+		return;
+
+	usb_release_interface(hdl, 0);
+	usb_close(hdl);
+	hdl = NULL;
+}
 
 static u_int16_t qt2410_csum(const unsigned char *data, u_int32_t len)
 {
@@ -94,118 +138,288 @@ static u_int16_t qt2410_csum(const unsigned char *data, u_int32_t len)
 	return csum;
 }
 
-#define CHUNK_SIZE 100
+static void put_le32(unsigned char *p, u_int32_t val)
+{
+	p[0] = val & 0xff;
+	p[1] = (val >> 8) & 0xff;
+	p[2] = (val >> 16) & 0xff;
+	p[3] = (val >> 24) & 0xff;
+}
+
+static u_int32_t get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+static void print_rate(u_int32_t len, const struct timeval *start)
+{
+	struct timeval end;
+	unsigned long ms;
+
+	gettimeofday(&end, NULL);
+	ms = (end.tv_sec - start->tv_sec) * 1000
+		+ (end.tv_usec - start->tv_usec) / 1000;
+	if (!ms)
+		ms = 1;
+
+	printf("%u bytes in %lu.%03lu s, %lu KiB/s\n", len,
+	       ms / 1000, ms % 1000, (unsigned long)len * 1000 / 1024 / ms);
+}
+
+/*
+ * Payload writes are this big, rounded down to the bulk maxpacket, so
+ * only the very last one can end in a short packet.  libusb splits them
+ * into URBs itself; at full speed a 64 KiB write keeps the bus busy for
+ * ~50 ms, which hides the per-call overhead without needing async
+ * submission.
+ */
+#define XFER_SIZE	(64 * 1024)
+
+static int qt2410_write(const void *data, int len)
+{
+	int ret;
+
+	ret = usb_bulk_write(hdl, QT2410_OUT_EP, (char *)data, len, 0);
+	if (ret != len)
+		return ret < 0 ? ret : -EIO;
+
+	return 0;
+}
+
 static int qt2410_send_file(u_int32_t addr, void *data, u_int32_t len)
 {
 	int ret = 0;
-	unsigned char *buf, *cur;
+	unsigned char hdr[8], tail[2];
+	unsigned char *cur = data;
 	u_int16_t csum = qt2410_csum(data, len);
 	u_int32_t len_total = len + 10;
+	u_int32_t xfer = XFER_SIZE - XFER_SIZE % maxpacket;
+	struct timeval start;
 
 	printf("csum = 0x%4x\n", csum);
 
-	/* 4 bytes address, 4 bytes length, data, 2 bytes csum */
+	/*
+	 * 4 bytes address, 4 bytes length, data, 2 bytes csum: written as
+	 * three pieces, the image straight from the mmap()ed file
+	 */
+	put_le32(hdr, addr);
+	put_le32(hdr + 4, len_total);
 
-	buf = malloc(len_total);
-	if (!buf)
-		return -ENOMEM;
+	tail[0] = csum & 0xff;
+	tail[1] = (csum >> 8) & 0xff;
 
-	/* FIXME: endian safeness !!! */
-	buf[0] = addr & 0xff;
-	buf[1] = (addr >> 8) & 0xff;
-	buf[2] = (addr >> 16) & 0xff;
-	buf[3] = (addr >> 24) & 0xff;
+	printf("send_file: addr = 0x%08x, len = 0x%08x\n", addr, len);
 
-	buf[4] = len_total & 0xff;
-	buf[5] = (len_total >> 8) & 0xff;
-	buf[6] = (len_total >> 16) & 0xff;
-	buf[7] = (len_total >> 24) & 0xff;
+	gettimeofday(&start, NULL);
 
-	memcpy(buf+8, data, len);
+	ret = qt2410_write(hdr, sizeof(hdr));
 
-	buf[len+8] = csum & 0xff;
-	buf[len+9] = (csum >> 8) & 0xff;
+	while (!ret && cur < (unsigned char *)data + len) {
+		u_int32_t remain = (unsigned char *)data + len - cur;
+		if (remain > xfer)
+			remain = xfer;
 
-	printf("send_file: addr = 0x%08x, len = 0x%08x\n", addr, len);
+		ret = qt2410_write(cur, remain);
+		cur += remain;
+	}
 
-	for (cur = buf; cur < buf+len_total; cur += CHUNK_SIZE) {
-		int remain = (buf + len_total) - cur;
-		if (remain > CHUNK_SIZE)
-			remain = CHUNK_SIZE;
+	if (!ret)
+		ret = qt2410_write(tail, sizeof(tail));
+	if (!ret)
+		print_rate(len, &start);
 
-#if 0
-		printf("sending urb(0x%08x): %s\n", 
-			addr + (cur - buf), hexdump(cur, remain));
-#endif
+	return ret;
+}
 
-		ret = usb_bulk_write(hdl, QT2410_OUT_EP, cur, remain, 0);
-		if (ret < 0)
-			break;
+/*
+ * Chunked protocol, see include/usb/secbulk.h.  The gadget's progress
+ * is read back every SYNC_BYTES and after any error; on a disconnect
+ * the device is reopened and the download resumes from the last chunk
+ * it verified.
+ */
+#define SYNC_BYTES	(64 * 1024)
+#define XFER_TIMEOUT	5000	/* ms */
+#define MAX_RETRIES	10
+
+static int qt2410_get_status(struct secbulk_status *st)
+{
+	unsigned char buf[sizeof(*st)];
+	int ret;
+
+	ret = usb_control_msg(hdl,
+		/* bmRequestType */	USB_ENDPOINT_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE,
+		/* bRequest	 */	SECBULK_REQ_STATUS,
+		/* wValue	 */	0,
+		/* wIndex	 */	0,
+		/* Data		 */	(char *)buf,
+		/* wLength	 */	sizeof(buf),
+					1000);
+	if (ret != sizeof(buf) || get_le32(buf) != SECBULK_MAGIC)
+		return -ENOTSUP;
+
+	st->magic = SECBULK_MAGIC;
+	st->state = get_le32(buf + 4);
+	st->addr = get_le32(buf + 8);
+	st->total = get_le32(buf + 12);
+	st->received = get_le32(buf + 16);
+	st->next_seq = get_le32(buf + 20);
+	st->errors = get_le32(buf + 24);
+	st->copied = get_le32(buf + 28);
+
+	return 0;
+}
+
+static int qt2410_send_chunk(u_int32_t addr, const unsigned char *data,
+			     u_int32_t total, u_int32_t offset,
+			     u_int32_t seq, u_int16_t len)
+{
+	unsigned char hdr[sizeof(struct secbulk_chunk)];
+	u_int16_t csum = qt2410_csum(data + offset, len);
+	int ret;
+
+	put_le32(hdr, SECBULK_MAGIC);
+	put_le32(hdr + 4, seq);
+	put_le32(hdr + 8, addr);
+	put_le32(hdr + 12, total);
+	put_le32(hdr + 16, offset);
+	hdr[20] = len & 0xff;
+	hdr[21] = (len >> 8) & 0xff;
+	hdr[22] = csum & 0xff;
+	hdr[23] = (csum >> 8) & 0xff;
+
+	ret = usb_bulk_write(hdl, QT2410_OUT_EP, (char *)hdr, sizeof(hdr),
+			     XFER_TIMEOUT);
+	if (ret != sizeof(hdr))
+		return ret < 0 ? ret : -EIO;
+
+	ret = usb_bulk_write(hdl, QT2410_OUT_EP, (char *)data + offset, len,
+			     XFER_TIMEOUT);
+	if (ret != len)
+		return ret < 0 ? ret : -EIO;
+
+	return 0;
+}
+
+/* ask the gadget how far it got, and continue from there */
+static int qt2410_resync(u_int32_t addr, u_int32_t len,
+			 u_int32_t *offset, u_int32_t *seq, int restart_done)
+{
+	struct secbulk_status st;
+
+	if (qt2410_get_status(&st) < 0)
+		return -EIO;
+
+	if (st.addr != addr || st.total != len
+	    || (restart_done && st.state == SECBULK_STATE_DONE)) {
+		/* not our download, start from scratch */
+		st.received = 0;
+		st.next_seq = 0;
 	}
 
-	free(buf);
+	if (st.received != *offset)
+		printf("\nresuming at %u of %u bytes\n", st.received, len);
+	*offset = st.received;
+	*seq = st.next_seq;
 
-	return ret;
+	printf("\r%u/%u bytes, %u rejected, %u copied", *offset, len,
+	       st.errors, st.copied);
+	fflush(stdout);
+
+	return 0;
 }
 
-#if 0
-static int qt2410_send_file(u_int32_t addr, void *data, u_int32_t len)
+static int qt2410_send_chunked(u_int32_t addr, const unsigned char *data,
+			       u_int32_t len)
 {
-	int i, ret;
-	u_int32_t cur_addr;
-	void *cur_data;
-
-	for (cur_addr = addr, cur_data = data; 
-	     cur_addr < addr + len;
-	     cur_addr += CHUNK_SIZE, cur_data += CHUNK_SIZE) {
-	     	int remain = (data + len) - cur_data;
-		if (remain > CHUNK_SIZE)
-			remain = CHUNK_SIZE;
-	
-		ret = qt2410_send_chunk(cur_addr, cur_data, remain);
-		if (ret < 0)
-			return ret;
+	u_int32_t offset = 0, seq = 0, synced, first;
+	struct timeval start;
+	int retries = 0;
+	int ret;
+
+	printf("send_file: addr = 0x%08x, len = 0x%08x, chunked\n", addr, len);
+
+	if (qt2410_resync(addr, len, &offset, &seq, 1) < 0)
+		return -EIO;
+	synced = first = offset;
+
+	gettimeofday(&start, NULL);
+
+	while (offset < len) {
+		u_int32_t n = len - offset;
+
+		if (!hdl) {
+			/* reopen after an error and ask where to resume */
+			if (++retries > MAX_RETRIES)
+				return -ENODEV;
+			sleep(1);
+			if (qt2410_open() < 0)
+				continue;
+			if (qt2410_resync(addr, len, &offset, &seq, 0) < 0) {
+				qt2410_close();
+				continue;
+			}
+			synced = offset;
+			continue;
+		}
+
+		if (n > SECBULK_CHUNK_MAX)
+			n = SECBULK_CHUNK_MAX;
+
+		ret = qt2410_send_chunk(addr, data, len, offset, seq, n);
+		if (ret) {
+			printf("\ntransfer error at %u: %s\n", offset,
+			       usb_strerror());
+			/* the device may be gone, or mid chunk: start over */
+			qt2410_close();
+			continue;
+		}
+		offset += n;
+		seq++;
+
+		if (offset == len) {
+			/*
+			 * Once the gadget has the whole image it starts it
+			 * and stops answering; if it still does, the last
+			 * chunk was rejected.
+			 */
+			usleep(100000);
+			qt2410_resync(addr, len, &offset, &seq, 0);
+		} else if (offset - synced >= SYNC_BYTES
+			   || offset + SECBULK_CHUNK_MAX >= len) {
+			/* always check in before the last chunk */
+			if (qt2410_resync(addr, len, &offset, &seq, 0) < 0) {
+				qt2410_close();
+				continue;
+			}
+			synced = offset;
+		}
 	}
 
+	printf("\n");
+	print_rate(len - first, &start);
+
 	return 0;
 }
-#endif
 
 #define KERNEL_RAM_BASE	0x30008000
 //#define KERNEL_RAM_BASE	0x33F80000
 
 int main(int argc, char **argv)
 {
-	struct usb_device *dev;
 	char *filename, *prog;
+	struct secbulk_status status;
 	struct stat st;
 	int fd;
 	int rc;
 	u_int32_t word = 0x7c7c7c7c;
 
 	usb_init();
-	if (!usb_find_busses())
-		exit(1);
-	if (!usb_find_devices())
-		exit(1);
 
-	dev = find_qt2410_device();
-	if (!dev) {
+	if (qt2410_open() < 0) {
 		printf("Cannot find QT2410 device in bootloader mode\n");
 		exit(1);
 	}
 
-	hdl = usb_open(dev);
-	if (!hdl) {
-		printf("Unable to open usb device: %s\n", usb_strerror());
-		exit(1);
-	}
-
-	if (usb_claim_interface(hdl, 0) < 0) {
-		printf("Unable to claim usb interface 1 of device: %s\n", usb_strerror());
-		exit(1);
-	}
-
 	filename = argv[1];
 	if (!filename) {
 		printf("You have to specify the file you want to flash\n");
@@ -223,10 +437,15 @@ int main(int argc, char **argv)
 
 	/* mmap kernel image passed as parameter */
 	prog = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
-	if (!prog)
+	if (prog == MAP_FAILED)
 		exit(1);
 
-	rc = qt2410_send_file(KERNEL_RAM_BASE, prog, st.st_size);
+	/* gadgets that answer the status request know the chunked protocol */
+	if (!qt2410_get_status(&status))
+		rc = qt2410_send_chunked(KERNEL_RAM_BASE,
+				(unsigned char *)prog, st.st_size);
+	else
+		rc = qt2410_send_file(KERNEL_RAM_BASE, prog, st.st_size);
 	if (rc < 0) {
 		printf("Error downloading program\n");
 		exit(1);
@@ -0,0 +1,280 @@
+/*
+ * csumcheck - checks the internet checksum of the USB ethernet gadget
+ * (include/usb/eth_csum.h) on the host against a byte loop
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ *
+ * Random buffers of random length, at all four alignments, are summed
+ * in one go and in pieces, and compared with the RFC 1071 byte loop.
+ * UDP frames are filled in the way ether.c sends them and checked the
+ * way it receives them, intact and with a flipped bit.  With -b it
+ * times both sums over full sized frames.  It exits non-zero if any
+ * check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <usb/eth_csum.h>
+
+#define BUF_SIZE	(64 << 10)
+#define FRAME_LEN	1514
+
+static uint8_t buf[BUF_SIZE + 4] __attribute__ ((aligned(4)));
+static int failed;
+
+/* RFC 1071, a byte pair at a time, folded and in network order */
+static uint16_t byte_csum(const uint8_t *p, uint32_t len)
+{
+	uint32_t	sum = 0, i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (p[i] << 8) | p[i + 1];
+	if (len & 1)
+		sum += p[len - 1] << 8;
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+/* eth_csum_fold() as it would be stored, read back in network order */
+static uint16_t stored(uint16_t csum)
+{
+	uint8_t		b[2];
+
+	memcpy(b, &csum, 2);
+	return (b[0] << 8) | b[1];
+}
+
+static void check_sum(const uint8_t *p, uint32_t len)
+{
+	uint16_t	want = byte_csum(p, len), got;
+	uint32_t	off, n, sum = 0;
+
+	got = stored(eth_csum_fold(eth_csum_partial(p, len, 0)));
+	if (got != want) {
+		printf("FAIL  %u bytes at offset %u: 0x%04x, expected 0x%04x\n",
+			len, (unsigned)((unsigned long)p & 3), got, want);
+		failed++;
+		return;
+	}
+
+	/* pieces of even length carry the sum on */
+	for (off = 0; off < len; off += n) {
+		n = (rand() % 1024 + 1) & ~1;
+		if (n > len - off)
+			n = len - off;
+		sum = eth_csum_partial(p + off, n, sum);
+	}
+	got = stored(eth_csum_fold(sum));
+	if (got != want) {
+		printf("FAIL  %u bytes in pieces: 0x%04x, expected 0x%04x\n",
+			len, got, want);
+		failed++;
+	}
+}
+
+static void check_random(void)
+{
+	uint32_t	i, len, align;
+	int		before = failed;
+
+	for (i = 0; i < BUF_SIZE; i++)
+		buf[i] = rand();
+
+	for (len = 0; len < 64; len++)
+		for (align = 0; align < 4; align++)
+			check_sum(buf + align, len);
+
+	for (i = 0; i < 5000; i++) {
+		len = rand() % (i < 4000 ? 2048 : BUF_SIZE);
+		check_sum(buf + rand() % 4, len);
+	}
+	if (failed == before)
+		printf("ok    random lengths and alignments\n");
+}
+
+static void check_carries(void)
+{
+	uint32_t	align;
+	int		before = failed;
+
+	memset(buf, 0xff, sizeof buf);
+	for (align = 0; align < 4; align++) {
+		check_sum(buf + align, BUF_SIZE);
+		check_sum(buf + align, FRAME_LEN);
+	}
+	if (failed == before)
+		printf("ok    all-0xff buffers\n");
+}
+
+/* an Ethernet/IPv4/UDP frame with len bytes of payload, at frame */
+static uint32_t udp_frame(uint8_t *frame, uint32_t len)
+{
+	uint8_t		*ip = frame + 14, *udp = ip + 20;
+	uint32_t	i;
+	uint16_t	csum;
+
+	memset(frame, 0, 14 + 20 + 8);
+	frame[12] = 0x08;
+	ip[0] = 0x45;
+	ip[2] = (20 + 8 + len) >> 8;
+	ip[3] = 20 + 8 + len;
+	ip[8] = 64;
+	ip[9] = ETH_CSUM_PROTO_UDP;
+	for (i = 12; i < 20; i++)
+		ip[i] = rand();
+	csum = eth_csum_fold(eth_csum_partial(ip, 20, 0));
+	memcpy(ip + 10, &csum, 2);
+
+	udp[0] = 0x04;			/* port 1069 to port 69 */
+	udp[1] = 0x2d;
+	udp[3] = 69;
+	udp[4] = (8 + len) >> 8;
+	udp[5] = 8 + len;
+	for (i = 0; i < len; i++)
+		udp[8 + i] = rand();
+	return 14 + 20 + 8 + len;
+}
+
+/* the UDP checksum, from the byte loop over pseudo header and datagram */
+static uint16_t udp_byte_csum(const uint8_t *frame)
+{
+	static uint8_t	ph[12 + 2048];
+	const uint8_t	*ip = frame + 14;
+	uint32_t	ulen = (ip[24] << 8) | ip[25];
+	uint16_t	csum;
+
+	memcpy(ph, ip + 12, 8);
+	ph[8] = 0;
+	ph[9] = ETH_CSUM_PROTO_UDP;
+	ph[10] = ulen >> 8;
+	ph[11] = ulen;
+	memcpy(ph + 12, ip + 20, ulen);
+	ph[12 + 6] = ph[12 + 7] = 0;
+	csum = byte_csum(ph, 12 + ulen);
+	return csum ? csum : 0xffff;
+}
+
+static void check_frames(void)
+{
+	uint8_t		*frame = buf + 4;	/* as NetTxPacket */
+	uint32_t	i, len, bit;
+	int		before = failed;
+
+	for (i = 0; i < 2000; i++) {
+		len = udp_frame(frame, rand() % (FRAME_LEN - 42 + 1));
+
+		if (eth_csum_rx_check(frame, len)) {
+			printf("FAIL  frame without a UDP checksum refused\n");
+			failed++;
+		}
+		eth_csum_tx_fill(frame, len);
+		if (((frame[40] << 8) | frame[41]) != udp_byte_csum(frame)) {
+			printf("FAIL  %u byte frame: UDP checksum 0x%02x%02x, "
+				"expected 0x%04x\n", len, frame[40], frame[41],
+				udp_byte_csum(frame));
+			failed++;
+		}
+		if (eth_csum_rx_check(frame, len)) {
+			printf("FAIL  %u byte frame refused\n", len);
+			failed++;
+		}
+
+		/*
+		 * Anywhere after the IP version and header length, which
+		 * make it another protocol, unless it leaves a UDP checksum
+		 * of 0, which means none.
+		 */
+		bit = 15 * 8 + rand() % ((len - 15) * 8);
+		frame[bit / 8] ^= 1 << (bit % 8);
+		if (!frame[40] && !frame[41])
+			continue;
+		if (!eth_csum_rx_check(frame, len)) {
+			printf("FAIL  %u byte frame with bit %u flipped "
+				"accepted\n", len, bit);
+			failed++;
+		}
+	}
+
+	/* other ethertypes go through untouched */
+	len = udp_frame(frame, 100);
+	frame[12] = 0x08;
+	frame[13] = 0x06;
+	frame[30] ^= 1;
+	if (eth_csum_rx_check(frame, len)) {
+		printf("FAIL  ARP frame refused\n");
+		failed++;
+	}
+	if (failed == before)
+		printf("ok    UDP frames filled and checked\n");
+}
+
+static double ns_per(const struct timespec *t0, long n)
+{
+	struct timespec	t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return ((t1.tv_sec - t0->tv_sec) * 1e9
+		+ (t1.tv_nsec - t0->tv_nsec)) / n;
+}
+
+static void bench(void)
+{
+	struct timespec	t0;
+	const long	n = 200000;
+	volatile uint32_t sink = 0;
+	double		ns;
+	long		i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++)
+		sink += byte_csum(buf + 14 + (i & 0x3c), FRAME_LEN - 14);
+	ns = ns_per(&t0, n);
+	printf("byte loop:        %7.1f ns per frame, %6.1f MB/s\n",
+		ns, (FRAME_LEN - 14) * 1e3 / ns);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++)
+		sink += eth_csum_fold(eth_csum_partial(buf + 14 + (i & 0x3c),
+					FRAME_LEN - 14, 0));
+	ns = ns_per(&t0, n);
+	printf("eth_csum_partial: %7.1f ns per frame, %6.1f MB/s\n",
+		ns, (FRAME_LEN - 14) * 1e3 / ns);
+}
+
+int main(int argc, char *argv[])
+{
+	int	b = argc > 1 && !strcmp(argv[1], "-b");
+
+	srand(argc > 1 + b ? strtoul(argv[1 + b], NULL, 0) : 1);
+
+	check_random();
+	check_carries();
+	check_frames();
+
+	if (b)
+		bench();
+
+	if (failed) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * nandbuf - checks and times the S3C2440 NFDATA buffer loops of the
+ * NAND driver (include/s3c2440_nand_buf.h) on the host
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ *
+ * NFDATA is modelled as a stream: every read or write access takes the
+ * next one or four bytes, lowest byte first, through a volatile pointer
+ * so that the compiler can neither merge nor drop accesses.  Reads and
+ * writes of all lengths up to a page and spare, at all four alignments,
+ * must move the same bytes, and touch nothing else, as the byte loops
+ * the driver used before.  With -b it times both read loops over a 2K
+ * page with its spare and over a 128K block, and prints MB/s.  It exits
+ * non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+struct nfdata {
+	u_char * volatile	p;
+};
+
+static inline u_char readb(void *io)
+{
+	struct nfdata *d = io;
+	u_char *p = d->p;
+
+	d->p = p + 1;
+	return *p;
+}
+
+static inline u_int32_t readl(void *io)
+{
+	struct nfdata *d = io;
+	u_char *p = d->p;
+
+	d->p = p + 4;
+	return p[0] | p[1] << 8 | p[2] << 16 | (u_int32_t)p[3] << 24;
+}
+
+static inline void writeb(u_char v, void *io)
+{
+	struct nfdata *d = io;
+	u_char *p = d->p;
+
+	d->p = p + 1;
+	*p = v;
+}
+
+static inline void writel(u_int32_t v, void *io)
+{
+	struct nfdata *d = io;
+	u_char *p = d->p;
+
+	d->p = p + 4;
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+#include <s3c2440_nand_buf.h>
+
+#define PAGE_LEN	(2048 + 64)
+#define BLOCK_LEN	(128 << 10)
+
+static u_char chip[BLOCK_LEN + 4] __attribute__ ((aligned(4)));
+static u_char buf[BLOCK_LEN + 4] __attribute__ ((aligned(4)));
+static u_char ref[BLOCK_LEN + 4] __attribute__ ((aligned(4)));
+static int failed;
+
+/* the generic nand_read_buf() and nand_write_buf() */
+static void byte_read_buf(void *io, u_char *b, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		b[i] = readb(io);
+}
+
+static void byte_write_buf(void *io, const u_char *b, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		writeb(b[i], io);
+}
+
+/* both loops from the same stream, the byte loop gives the reference */
+static void check_read(int align, int len)
+{
+	struct nfdata	w = { chip }, r = { chip };
+
+	memset(buf, 0, sizeof buf);
+	memset(ref, 0, sizeof ref);
+	s3c2440_nand_read_buf(&w, buf + align, len);
+	byte_read_buf(&r, ref + align, len);
+	if (w.p != r.p || memcmp(buf, ref, sizeof buf)) {
+		printf("FAIL  read of %d bytes at offset %d\n", len, align);
+		failed++;
+	}
+}
+
+static void check_write(int align, int len)
+{
+	struct nfdata	w = { buf }, r = { ref };
+
+	memset(buf, 0, sizeof buf);
+	memset(ref, 0, sizeof ref);
+	s3c2440_nand_write_buf(&w, chip + align, len);
+	byte_write_buf(&r, chip + align, len);
+	if (w.p - buf != r.p - ref || memcmp(buf, ref, sizeof buf)) {
+		printf("FAIL  write of %d bytes at offset %d\n", len, align);
+		failed++;
+	}
+}
+
+static void check(void)
+{
+	int	i, align, len;
+	int	before = failed;
+
+	for (i = 0; i < (int)sizeof chip; i++)
+		chip[i] = rand();
+
+	for (align = 0; align < 4; align++)
+		for (len = 0; len <= PAGE_LEN; len++) {
+			check_read(align, len);
+			check_write(align, len);
+		}
+	for (align = 0; align < 4; align++) {
+		check_read(align, BLOCK_LEN);
+		check_write(align, BLOCK_LEN);
+	}
+	if (failed == before)
+		printf("ok    reads and writes of all lengths and alignments\n");
+}
+
+static double ns_per(const struct timespec *t0, long n)
+{
+	struct timespec	t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return ((t1.tv_sec - t0->tv_sec) * 1e9
+		+ (t1.tv_nsec - t0->tv_nsec)) / n;
+}
+
+static void bench_one(const char *name,
+		void (*rd)(void *, u_char *, int), int len)
+{
+	struct timespec	t0;
+	struct nfdata	d;
+	long		i, n = (256L << 20) / len;
+	double		ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++) {
+		d.p = chip;
+		rd(&d, buf, len);
+	}
+	ns = ns_per(&t0, n);
+	printf("%-10s %6d bytes: %9.1f ns, %7.1f MB/s\n",
+		name, len, ns, len * 1e3 / ns);
+}
+
+static void word_read_buf(void *io, u_char *b, int len)
+{
+	s3c2440_nand_read_buf(io, b, len);
+}
+
+static void bench(void)
+{
+	bench_one("byte loop", byte_read_buf, PAGE_LEN);
+	bench_one("word loop", word_read_buf, PAGE_LEN);
+	bench_one("byte loop", byte_read_buf, BLOCK_LEN);
+	bench_one("word loop", word_read_buf, BLOCK_LEN);
+}
+
+int main(int argc, char *argv[])
+{
+	int	b = argc > 1 && !strcmp(argv[1], "-b");
+
+	srand(argc > 1 + b ? strtoul(argv[1 + b], NULL, 0) : 1);
+
+	check();
+
+	if (b)
+		bench();
+
+	if (failed) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
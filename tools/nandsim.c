@@ -0,0 +1,811 @@
+/*
+ * nandsim - runs the stage 1 NAND loader (board/samsung/mini2440/
+ * nand_read.c) on the host against a simulated S3C2440 NAND controller
+ * and chip
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ *
+ * nand_read.c is compiled as it is, with its register macros pointed at
+ * nandsim_reg().  Every register access goes through that call, which
+ * first completes the access before it: a command or address byte is
+ * handed to the chip, a data read moves the column on.  Then it fills
+ * in what the new access will read and returns the register's address
+ * in a plain array.  The GPIO and timer blocks nand_read_ll() touches
+ * are ordinary memory mapped at their physical addresses.
+ *
+ * Time is simulated, not measured: each bus cycle costs what NFCONF
+ * and the HCLK make it, each page load tR.  Strobes shorter than the
+ * chip's minimum are counted, and one read in 256 with such a strobe
+ * returns a flipped bit.
+ *
+ * With -B it also times the reads nand_init() does for the bad block
+ * table, issued the way nand_base and nand_bbt issue them: the spare
+ * area of every block without CONFIG_S3C2410_NAND_BBT, or the search
+ * for the table and mirror in the last blocks and the table itself
+ * with it.  The CPU time nand_base spends between the reads isn't
+ * counted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <config.h>
+
+typedef uint8_t		u8;
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+
+/* nand_read.c wants common.h only for the above */
+#define __COMMON_H_	1
+
+static volatile void *nandsim_reg(unsigned long addr, int width);
+unsigned long get_PCLK(void);
+
+#define __REGb(x)	(*(volatile unsigned char *)nandsim_reg(x, 1))
+#define __REGi(x)	(*(volatile unsigned int *)nandsim_reg(x, 4))
+
+/* crt1.o has a _start of its own */
+#define _start		nandsim_start
+#define _nand_image_len	nandsim_image_len
+
+/* an inline definition only, unless declared like this first */
+void wait_idle(void);
+
+#include "../board/samsung/mini2440/nand_read.c"
+
+/*
+ * Where start.S puts _nand_image_len: after the vectors, their
+ * addresses, four words of boot data and, with IRQs, two stack words.
+ */
+#ifdef CONFIG_USE_IRQ
+#define NANDSIM_LEN_OFFSET	0x5c
+#else
+#define NANDSIM_LEN_OFFSET	0x54
+#endif
+#define BSUM_MAGIC		0x4d555342	/* "BSUM", as in ubsum */
+
+#define __str(x)		#x
+#define str(x)			__str(x)
+
+__asm__(".data\n"
+	".balign 16\n"
+	".globl nandsim_start\n"
+	"nandsim_start:\n"
+	".space " str(NANDSIM_LEN_OFFSET) "\n"
+	".globl nandsim_image_len\n"
+	"nandsim_image_len:\n"
+	".long 0\n"
+	".previous\n");
+
+/* controller registers, offsets from NF_BASE */
+#define REG_NFCONF		0x00
+#define REG_NFCONT		0x04
+#define REG_NFCMD		0x08
+#define REG_NFADDR		0x0c
+#define REG_NFDATA		0x10
+#define REG_NFSTAT		0x20
+#define REG_SIZE		0x40
+
+#define MAX_FLIPS		64
+
+struct flip {
+	unsigned	page;
+	unsigned	byte;		/* page data, then spare */
+	unsigned	bit;
+};
+
+static struct nandsim {
+	/* geometry */
+	unsigned	page_size;
+	unsigned	oob_size;
+	unsigned	block_pages;
+	unsigned	blocks;
+	unsigned char	*array;		/* pages with their spare areas */
+
+	/* timing */
+	unsigned	hclk_mhz;
+	unsigned	t_r_us;		/* page load */
+	unsigned	t_rst_us;
+	unsigned	t_wp_ns;	/* minimum nWE/nRE pulse */
+	unsigned long long now;		/* ps */
+	unsigned long long busy_until;
+	int		busy;
+	int		trans;		/* NFSTAT RnB transition */
+
+	/* chip state */
+	int		cmd;
+	unsigned char	addr[5];
+	int		naddr;
+	unsigned char	reg[4096 + 128];	/* page register */
+	unsigned	reg_len;
+	unsigned	col;
+
+	/* the access nandsim_reg() returned last */
+	int		pending;
+	unsigned	pend_off;
+	int		pend_width;
+	union {
+		uint32_t	w[REG_SIZE / 4];
+		uint8_t		b[REG_SIZE];
+	} regs;
+
+	struct flip	flips[MAX_FLIPS];
+	int		nflips;
+
+	/* results */
+	unsigned long	page_loads;
+	unsigned long	bus_cycles;
+	unsigned long	violations;
+	unsigned long	busy_reads;
+	unsigned long	bad_cmds;
+} sim;
+
+static unsigned long long hclk_ps(unsigned cycles)
+{
+	return (unsigned long long)cycles * 1000000 / sim.hclk_mhz;
+}
+
+/* NFCONF in cycles: TACLS as is, TWRPH0/1 plus one */
+static unsigned nfconf_tacls(void)
+{
+	return (sim.regs.w[REG_NFCONF / 4] >> 12) & 3;
+}
+
+static unsigned nfconf_twrph0(void)
+{
+	return ((sim.regs.w[REG_NFCONF / 4] >> 8) & 7) + 1;
+}
+
+static unsigned nfconf_twrph1(void)
+{
+	return ((sim.regs.w[REG_NFCONF / 4] >> 4) & 7) + 1;
+}
+
+/* one bus cycle; returns 1 if the strobe was too short for the chip */
+static int bus_cycle(int latch)
+{
+	unsigned cycles = nfconf_twrph0() + nfconf_twrph1();
+
+	if (latch)
+		cycles += nfconf_tacls();
+	sim.now += hclk_ps(cycles);
+	sim.bus_cycles++;
+
+	if (hclk_ps(nfconf_twrph0()) < sim.t_wp_ns * 1000ULL) {
+		sim.violations++;
+		return 1;
+	}
+	return 0;
+}
+
+static void set_busy(unsigned us)
+{
+	sim.busy = 1;
+	sim.busy_until = sim.now + us * 1000000ULL;
+}
+
+static void update_busy(void)
+{
+	if (sim.busy && sim.now >= sim.busy_until) {
+		sim.busy = 0;
+		sim.trans = 1;
+	}
+}
+
+static int chip_enabled(void)
+{
+	return !(sim.regs.w[REG_NFCONT / 4] & (1 << 1)) &&
+		(sim.regs.w[REG_NFCONT / 4] & (1 << 0));
+}
+
+static void load_page(unsigned page, unsigned col)
+{
+	unsigned len = sim.page_size + sim.oob_size;
+	int i;
+
+	if (page >= sim.blocks * sim.block_pages) {
+		memset(sim.reg, 0xff, len);
+	} else {
+		memcpy(sim.reg, sim.array + (unsigned long)page * len, len);
+		for (i = 0; i < sim.nflips; i++)
+			if (sim.flips[i].page == page)
+				sim.reg[sim.flips[i].byte] ^=
+					1 << sim.flips[i].bit;
+	}
+
+	sim.reg_len = len;
+	sim.col = col;
+	sim.page_loads++;
+	set_busy(sim.t_r_us);
+}
+
+static void chip_cmd(unsigned char cmd)
+{
+	unsigned col, page;
+
+	if (!chip_enabled())
+		return;
+	bus_cycle(1);
+
+	switch (cmd) {
+	case 0xff:			/* reset */
+		sim.cmd = -1;
+		set_busy(sim.t_rst_us);
+		return;
+	case 0x30:			/* read start, large pages */
+		if (sim.cmd != 0x00 || sim.page_size <= 512 || sim.naddr != 5)
+			break;
+		col = sim.addr[0] | (sim.addr[1] << 8);
+		page = sim.addr[2] | (sim.addr[3] << 8) | (sim.addr[4] << 16);
+		load_page(page, col);
+		sim.cmd = -1;
+		return;
+	case 0x00:			/* read */
+	case 0x50:			/* read spare, small pages */
+	case 0x90:			/* read ID */
+		sim.cmd = cmd;
+		sim.naddr = 0;
+		return;
+	}
+
+	sim.bad_cmds++;
+	sim.cmd = -1;
+}
+
+static void chip_addr(unsigned char addr)
+{
+	unsigned id_dev, id4, page;
+
+	if (!chip_enabled())
+		return;
+	bus_cycle(1);
+
+	if (sim.cmd < 0 || sim.naddr >= 5) {
+		sim.bad_cmds++;
+		return;
+	}
+	sim.addr[sim.naddr++] = addr;
+
+	if (sim.cmd == 0x90) {
+		/* maker, device, cell type, page and block size */
+		id_dev = sim.page_size > 512 ? 0xf1 : 0x76;
+		id4 = (sim.page_size > 512 ? 1 : 0) |
+			((ffs(sim.block_pages * sim.page_size / 65536) - 1)
+			 << 4);
+		memset(sim.reg, 0xff, sizeof(sim.reg));
+		sim.reg[0] = 0xec;
+		sim.reg[1] = id_dev;
+		sim.reg[2] = 0x00;
+		sim.reg[3] = id4;
+		sim.reg_len = sizeof(sim.reg);
+		sim.col = 0;
+		sim.cmd = -1;
+		return;
+	}
+
+	/* small pages: 1 column and 3 row cycles, no read start */
+	if (sim.page_size <= 512 && sim.naddr == 4) {
+		page = sim.addr[1] | (sim.addr[2] << 8) | (sim.addr[3] << 16);
+		load_page(page, sim.addr[0] +
+			  (sim.cmd == 0x50 ? sim.page_size : 0));
+		sim.cmd = -1;
+	}
+}
+
+static void fill_data(int width)
+{
+	int i, bad;
+
+	for (i = 0; i < width; i++) {
+		bad = bus_cycle(0);
+		if (sim.busy) {
+			sim.busy_reads++;
+			sim.regs.b[REG_NFDATA + i] = 0x00;
+			continue;
+		}
+		sim.regs.b[REG_NFDATA + i] =
+			sim.col + i < sim.reg_len ? sim.reg[sim.col + i] : 0xff;
+		if (bad && !(sim.bus_cycles & 0xff))
+			sim.regs.b[REG_NFDATA + i] ^=
+				1 << ((sim.bus_cycles >> 8) & 7);
+	}
+}
+
+/* the previous access is over: act on what it wrote */
+static void nandsim_commit(void)
+{
+	if (!sim.pending)
+		return;
+	sim.pending = 0;
+
+	switch (sim.pend_off) {
+	case REG_NFCMD:
+		chip_cmd(sim.regs.b[REG_NFCMD]);
+		break;
+	case REG_NFADDR:
+		chip_addr(sim.regs.b[REG_NFADDR]);
+		break;
+	case REG_NFDATA:
+		if (chip_enabled())
+			sim.col += sim.pend_width;
+		break;
+	case REG_NFSTAT:
+		/*
+		 * Writing 1 clears the transition flag.  A read that saw
+		 * it can't be told from that write, so it clears it too;
+		 * nand_read.c clears it before each command anyway.
+		 */
+		if (sim.regs.b[REG_NFSTAT] & (1 << 2))
+			sim.trans = 0;
+		break;
+	}
+}
+
+static volatile void *nandsim_reg(unsigned long addr, int width)
+{
+	unsigned off = addr - NF_BASE;
+
+	nandsim_commit();
+
+	if (off >= REG_SIZE) {
+		fprintf(stderr, "nandsim: access to NF_BASE + 0x%x\n", off);
+		exit(EXIT_FAILURE);
+	}
+
+	sim.pending = 1;
+	sim.pend_off = off;
+	sim.pend_width = width;
+
+	switch (off) {
+	case REG_NFSTAT:
+		sim.now += hclk_ps(1);
+		update_busy();
+		sim.regs.b[REG_NFSTAT] = (sim.busy ? 0 : 1) |
+			(sim.trans ? 1 << 2 : 0);
+		break;
+	case REG_NFDATA:
+		update_busy();
+		if (chip_enabled())
+			fill_data(width);
+		break;
+	default:
+		sim.now += hclk_ps(1);
+		break;
+	}
+
+	return &sim.regs.b[off];
+}
+
+unsigned long get_PCLK(void)
+{
+	return sim.hclk_mhz * 1000000UL / 2;
+}
+
+/* fixed address memory for the GPIO and timer blocks */
+static int map_block(unsigned long base, size_t len)
+{
+	void *p;
+
+	len = (len + 4095) & ~4095UL;
+	p = mmap((void *)base, len, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED || p != (void *)base) {
+		fprintf(stderr, "nandsim: can't map 0x%08lx\n", base);
+		return -1;
+	}
+	return 0;
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/* random words, with the length and sum tools/ubsum would patch in */
+static unsigned char *make_image(long len)
+{
+	unsigned char *buf = malloc(len);
+	uint32_t sum = 0;
+	long i;
+
+	if (!buf)
+		return NULL;
+	for (i = 0; i < len; i++)
+		buf[i] = rand();
+
+	put_le32(buf + NANDSIM_LEN_OFFSET - 4, BSUM_MAGIC);
+	put_le32(buf + NANDSIM_LEN_OFFSET, len);
+	put_le32(buf + NANDSIM_LEN_OFFSET + 4, 0);
+	for (i = 0; i < len; i += 4)
+		sum += get_le32(buf + i);
+	put_le32(buf + NANDSIM_LEN_OFFSET + 4, -sum);
+
+	return buf;
+}
+
+static unsigned char *load_image(const char *name, long *len)
+{
+	unsigned char *buf;
+	long size;
+	FILE *fp;
+
+	fp = fopen(name, "rb");
+	if (!fp) {
+		perror(name);
+		return NULL;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	rewind(fp);
+
+	*len = (size + 3) & ~3;
+	buf = calloc(1, *len);
+	if (!buf || (long)fread(buf, 1, size, fp) != size) {
+		fprintf(stderr, "%s: can't read %ld bytes\n", name, size);
+		return NULL;
+	}
+	fclose(fp);
+
+	if (*len > NANDSIM_LEN_OFFSET + 4 &&
+	    get_le32(buf + NANDSIM_LEN_OFFSET - 4) != BSUM_MAGIC)
+		fprintf(stderr, "%s: no checksum marker at 0x%x, not built "
+			"with this configuration?\n", name,
+			NANDSIM_LEN_OFFSET - 4);
+
+	return buf;
+}
+
+static int block_is_bad(unsigned block)
+{
+	unsigned long page = (unsigned long)block * sim.block_pages;
+	unsigned pos = sim.page_size > 512 ? 0 : 5;
+
+	return sim.array[page * (sim.page_size + sim.oob_size) +
+			 sim.page_size + pos] != 0xff;
+}
+
+/* lays the image out from off on, skipping bad blocks like nand write */
+static int program_image(const unsigned char *img, long len, unsigned off)
+{
+	unsigned stride = sim.page_size + sim.oob_size;
+	unsigned page = off / sim.page_size;
+	long done;
+
+	for (done = 0; done < len; page++) {
+		unsigned n = len - done < sim.page_size ?
+			len - done : sim.page_size;
+
+		if (page >= sim.blocks * sim.block_pages)
+			return -1;
+		if (!(page % sim.block_pages) &&
+		    block_is_bad(page / sim.block_pages)) {
+			page += sim.block_pages - 1;
+			continue;
+		}
+		memcpy(sim.array + (unsigned long)page * stride, img + done, n);
+		done += n;
+	}
+
+	return 0;
+}
+
+/*
+ * One page load from col on and len bytes of it, through NFDATA32 as
+ * the driver's read_buf() does; on small pages the spare is READOOB.
+ */
+static void bbt_read(unsigned page, unsigned col, unsigned len)
+{
+	unsigned i;
+
+	NAND_CLEAR_RB;
+	if (sim.page_size > 512 || col < sim.page_size) {
+		NFCMD = NAND_CMD_READ0;
+		nand_write_addr(col, page, sim.page_size);
+		if (sim.page_size > 512)
+			NFCMD = NAND_CMD_READSTART;
+	} else {
+		NFCMD = NAND_CMD_READOOB;
+		nand_write_addr(col - sim.page_size, page, sim.page_size);
+	}
+	nand_wait_rb();
+
+	for (i = 0; i < len / 4; i++)
+		(void)NFDATA32;
+}
+
+/* simulated us of nand_init()'s bad block reads, and the page loads */
+static unsigned long long bbt_time(int flash_bbt, unsigned long *loads)
+{
+	unsigned long long start;
+	unsigned long first = sim.page_loads;
+	unsigned block, pages;
+
+	NAND_CHIP_ENA;
+	start = sim.now;
+
+	if (!flash_bbt) {
+		/*
+		 * create_bbt() with the memory based pattern: the spare of
+		 * the first page of each block, and of the second page too
+		 * on small page chips (NAND_BBT_SCAN2NDPAGE).
+		 */
+		pages = sim.page_size > 512 ? 1 : 2;
+		for (block = 0; block < sim.blocks; block++) {
+			bbt_read(block * sim.block_pages, sim.page_size,
+				 sim.oob_size);
+			if (pages == 2)
+				bbt_read(block * sim.block_pages + 1,
+					 sim.page_size, sim.oob_size);
+		}
+	} else {
+		/*
+		 * search_bbt() reads the first page of the last blocks, data
+		 * and spare, until it finds the pattern: the table in the
+		 * last block, the mirror one below.  read_bbt() then reads
+		 * the 2 bits per block of the newer copy with ECC.
+		 */
+		block = sim.blocks - 1;
+		bbt_read(block * sim.block_pages, 0,
+			 sim.page_size + sim.oob_size);		/* "Bbt0" */
+		bbt_read(block * sim.block_pages, 0,
+			 sim.page_size + sim.oob_size);		/* not "1tbB" */
+		bbt_read((block - 1) * sim.block_pages, 0,
+			 sim.page_size + sim.oob_size);		/* "1tbB" */
+		bbt_read(block * sim.block_pages, 0,
+			 sim.page_size + sim.oob_size);		/* table */
+	}
+
+	nandsim_commit();
+	NAND_CHIP_DIS;
+	*loads = sim.page_loads - first;
+	return (sim.now - start) / 1000000;
+}
+
+static void usage(void)
+{
+	printf("usage: nandsim [options] u-boot.bin\n"
+		"       nandsim [options] -g len\n"
+		"  -g len    generate a summed image of len bytes\n"
+		"  -p size   page size, 512 or 2048 (default 2048)\n"
+		"  -k pages  pages per block (default 64, 32 on small pages)\n"
+		"  -n blocks blocks in the chip (default 1024)\n"
+		"  -b block  mark a block bad, may be repeated\n"
+		"  -f p:b:n  flip bit n of byte b of page p on every read\n"
+		"  -o off    NAND offset of the image (default 0)\n"
+		"  -s size   bytes nand_read_ll() copies (default the image)\n"
+		"  -H mhz    HCLK (default 101)\n"
+		"  -r us     tR, page load time (default 25)\n"
+		"  -w ns     minimum nWE/nRE pulse, tWP/tRP (default 12)\n"
+		"  -e ret    expected nand_read_ll() result (default 0)\n"
+		"  -B        also time nand_init()'s bad block table reads\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct s3c24x0_gpio *gpio;
+	unsigned char *img, *buf;
+	long len = 0, gen = 0;
+	unsigned off = 0, size = 0;
+	unsigned long long start;
+	int expect = 0, opt, ret, bad = 0, bbt = 0, i;
+
+	sim.page_size = 2048;
+	sim.blocks = 1024;
+	sim.hclk_mhz = 101;
+	sim.t_r_us = 25;
+	sim.t_rst_us = 5;
+	sim.t_wp_ns = 12;
+	sim.cmd = -1;
+
+	while ((opt = getopt(argc, argv, "g:p:k:n:b:f:o:s:H:r:w:e:B")) != -1) {
+		switch (opt) {
+		case 'g':
+			gen = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			sim.page_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			sim.block_pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			sim.blocks = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			/* marked once the array exists */
+			break;
+		case 'f':
+			if (sim.nflips == MAX_FLIPS ||
+			    sscanf(optarg, "%u:%u:%u",
+				   &sim.flips[sim.nflips].page,
+				   &sim.flips[sim.nflips].byte,
+				   &sim.flips[sim.nflips].bit) != 3) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			sim.flips[sim.nflips++].bit &= 7;
+			break;
+		case 'o':
+			off = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			sim.hclk_mhz = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			sim.t_r_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			sim.t_wp_ns = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			expect = strtol(optarg, NULL, 0);
+			break;
+		case 'B':
+			bbt = 1;
+			break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ((sim.page_size != 512 && sim.page_size != 2048) ||
+	    !sim.hclk_mhz || (gen ? optind != argc : optind != argc - 1)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	sim.oob_size = sim.page_size / 32;
+	if (!sim.block_pages)
+		sim.block_pages = sim.page_size > 512 ? 64 : 32;
+	/* stage 1 assumes 32 pages per block on small page chips */
+	if (sim.page_size <= 512 && sim.block_pages != 32) {
+		fprintf(stderr, "nandsim: small page chips have 32 pages "
+			"per block\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sim.nflips; i++)
+		if (sim.flips[i].byte >= sim.page_size + sim.oob_size) {
+			usage();
+			return EXIT_FAILURE;
+		}
+
+	sim.array = malloc((unsigned long)sim.blocks * sim.block_pages *
+			   (sim.page_size + sim.oob_size));
+	if (!sim.array) {
+		fprintf(stderr, "nandsim: out of memory\n");
+		return EXIT_FAILURE;
+	}
+	memset(sim.array, 0xff, (unsigned long)sim.blocks * sim.block_pages *
+	       (sim.page_size + sim.oob_size));
+
+	optind = 1;
+	while ((opt = getopt(argc, argv, "g:p:k:n:b:f:o:s:H:r:w:e:B")) != -1) {
+		unsigned block, page;
+
+		if (opt != 'b')
+			continue;
+		block = strtoul(optarg, NULL, 0);
+		if (block >= sim.blocks) {
+			usage();
+			return EXIT_FAILURE;
+		}
+		page = block * sim.block_pages;
+		sim.array[(unsigned long)page * (sim.page_size + sim.oob_size)
+			  + sim.page_size + (sim.page_size > 512 ? 0 : 5)] = 0;
+		bad++;
+	}
+
+	if (gen) {
+		len = (gen + 3) & ~3;
+		img = make_image(len);
+	} else {
+		img = load_image(argv[argc - 1], &len);
+	}
+	if (!img)
+		return EXIT_FAILURE;
+
+	if (off % sim.page_size || program_image(img, len, off)) {
+		fprintf(stderr, "nandsim: image doesn't fit at 0x%x\n", off);
+		return EXIT_FAILURE;
+	}
+
+	if (!size)
+		size = (len + sim.page_size - 1) & ~(sim.page_size - 1);
+	buf = calloc(1, size + sim.page_size);
+	if (!buf) {
+		fprintf(stderr, "nandsim: out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	/* NCON and GPG13 strap the page size */
+	if (map_block(S3C24X0_GPIO_BASE, sizeof(struct s3c24x0_gpio)) ||
+	    map_block(S3C24X0_TIMER_BASE, sizeof(struct s3c24x0_timers)))
+		return EXIT_FAILURE;
+	gpio = s3c24x0_get_base_gpio();
+	gpio->GSTATUS0 = sim.page_size > 512 ? 0x4 : 0;
+	gpio->GPGDAT = 0x2000;
+
+	/* NFCONF and NFCONT as after reset */
+	sim.regs.w[REG_NFCONF / 4] = 0x1000;
+	sim.regs.w[REG_NFCONT / 4] = 0x0384;
+
+	nand_ll_init();
+	start = sim.now;
+	ret = nand_read_ll(buf, off, size);
+	nandsim_commit();
+	sim.now -= start;
+
+	printf("chip:  %u+%u byte pages, %u pages per block, %u blocks, "
+		"%d bad\n", sim.page_size, sim.oob_size, sim.block_pages,
+		sim.blocks, bad);
+	printf("bus:   NFCONF 0x%04x, %u/%u/%u cycles at %u MHz\n",
+		sim.regs.w[REG_NFCONF / 4] & 0x3770, nfconf_tacls(),
+		nfconf_twrph0(), nfconf_twrph1(), sim.hclk_mhz);
+	printf("read:  %u bytes from 0x%x in %llu us, %llu KiB/s, "
+		"%lu page loads\n", size, off, sim.now / 1000000,
+		sim.now ? (unsigned long long)size * 1000000000000ULL /
+		sim.now / 1024 : 0, sim.page_loads);
+	if (bbt) {
+		unsigned long long scan_us, flash_us;
+		unsigned long scan_loads, flash_loads;
+
+		scan_us = bbt_time(0, &scan_loads);
+		flash_us = bbt_time(1, &flash_loads);
+		printf("bbt:   scan %llu us, %lu page loads; flash table "
+			"%llu us, %lu page loads\n", scan_us, scan_loads,
+			flash_us, flash_loads);
+	}
+	if (sim.violations || sim.busy_reads || sim.bad_cmds)
+		printf("errors: %lu strobes too short, %lu reads while busy, "
+			"%lu bad commands\n", sim.violations, sim.busy_reads,
+			sim.bad_cmds);
+
+	printf("nand_read_ll() returned %d", ret);
+	if (ret != expect) {
+		printf(", expected %d\n", expect);
+		return EXIT_FAILURE;
+	}
+	if (ret == 0 && memcmp(buf, img, len)) {
+		printf(", but the data differs\n");
+		return EXIT_FAILURE;
+	}
+	printf("\n");
+
+	free(buf);
+	free(img);
+	free(sim.array);
+
+	return EXIT_SUCCESS;
+}
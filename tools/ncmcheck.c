@@ -0,0 +1,421 @@
+/*
+ * ncmcheck - runs the NTB16 code of the CDC NCM gadget (include/usb/
+ * ncm.h) on the host against well formed and malformed NTBs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ *
+ * Every case builds an NTB, walks it with ncm_ntb16_begin() and
+ * ncm_ntb16_next() the way ncm_rx_ntb() does, and compares the
+ * datagrams found, or the rejection, with what it should be.  It exits
+ * non-zero if any case fails.
+ *
+ * With -b it also times building and parsing, and compares TFTP over
+ * CDC ECM and CDC NCM across a stub transport: each USB transfer is a
+ * copy plus a modelled cost, a fixed part per transfer and the bus time
+ * of its bytes.  "-b us" sets the fixed part, one full speed frame
+ * (1000 us) by default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <usb/ncm.h>
+
+#define NTB_SIZE	8192		/* NCM_NTB_OUT_SIZE of the gadget */
+#define MAX_DGRAMS	16
+
+static uint8_t ntb[NTB_SIZE];
+static int failed;
+
+struct dgram {
+	uint32_t	index;
+	uint32_t	len;
+};
+
+/* walks the NTB, returns the datagram count or -1 if it was rejected */
+static int parse(uint32_t len, struct dgram *d)
+{
+	struct ncm_ntb16	it;
+	uint32_t		index, dlen;
+	int			n = 0, ret;
+
+	if (ncm_ntb16_begin(&it, ntb, len))
+		return -1;
+
+	while ((ret = ncm_ntb16_next(&it, &index, &dlen)) > 0) {
+		if (n == MAX_DGRAMS)
+			return -2;	/* never stopped */
+		d[n].index = index;
+		d[n].len = dlen;
+		n++;
+	}
+	return ret ? -1 : n;
+}
+
+static void nth(uint32_t block, uint32_t ndp)
+{
+	ncm_put32(ntb, NCM_NTH16_SIGN);
+	ncm_put16(ntb + 4, NCM_NTH16_LEN);
+	ncm_put16(ntb + 6, 0);
+	ncm_put16(ntb + 8, block);
+	ncm_put16(ntb + 10, ndp);
+}
+
+/* an NDP16 at off with n entries from d and a zero entry */
+static void ndp(uint32_t off, uint32_t next, const struct dgram *d, int n)
+{
+	int	i;
+
+	ncm_put32(ntb + off, NCM_NDP16_NOCRC_SIGN);
+	ncm_put16(ntb + off + 4, NCM_NDP16_LEN + (n + 1) * NCM_DPE16_LEN);
+	ncm_put16(ntb + off + 6, next);
+	for (i = 0; i < n; i++) {
+		ncm_put16(ntb + off + 8 + 4 * i, d[i].index);
+		ncm_put16(ntb + off + 10 + 4 * i, d[i].len);
+	}
+	ncm_put32(ntb + off + 8 + 4 * n, 0);
+}
+
+static void expect(const char *name, uint32_t len, int n,
+		const struct dgram *want)
+{
+	struct dgram	got[MAX_DGRAMS];
+	int		ret, i;
+
+	ret = parse(len, got);
+	if (ret == n) {
+		for (i = 0; i < n; i++)
+			if (got[i].index != want[i].index
+					|| got[i].len != want[i].len)
+				break;
+		if (n < 0 || i == n) {
+			printf("ok    %s\n", name);
+			return;
+		}
+	}
+	printf("FAIL  %s: %d datagrams, expected %d\n", name, ret, n);
+	failed++;
+}
+
+/* the usual layout: five datagrams, split over two chained NDP16s */
+static const struct dgram five[] = {
+	{ 64, 60 }, { 128, 1514 }, { 1644, 98 }, { 1744, 342 }, { 2088, 60 },
+};
+#define FIVE_END	2148
+
+static void build_five(void)
+{
+	memset(ntb, 0, sizeof ntb);
+	nth(FIVE_END, 12);
+	ndp(12, 2152, five, 3);
+	ndp(2152, 0, five + 3, 2);
+}
+
+static void check_wellformed(void)
+{
+	static const uint8_t frame[60] = { 0xff, 0xff, 0xff, 0xff };
+	struct dgram	one = { NCM_NTB16_DGRAM, sizeof frame };
+	int		len;
+
+	len = ncm_ntb16_single(ntb, sizeof ntb, 7, frame, sizeof frame);
+	expect("single datagram from ncm_ntb16_single()", len, 1, &one);
+	if (memcmp(ntb + NCM_NTB16_DGRAM, frame, sizeof frame)) {
+		printf("FAIL  single datagram payload\n");
+		failed++;
+	}
+	if (ncm_ntb16_single(ntb, 2048, 0, ntb, 2048 - 31) != -1) {
+		printf("FAIL  oversized datagram accepted by ncm_ntb16_single()\n");
+		failed++;
+	}
+
+	build_five();
+	ncm_put16(ntb + 8, 2180);
+	expect("five datagrams in two NDP16s", 2180, 5, five);
+
+	build_five();
+	ncm_put16(ntb + 8, 0);
+	expect("wBlockLength 0, short packet ends the NTB", 2180, 5, five);
+
+	/* the table may also end at wLength, without a zero entry */
+	build_five();
+	ncm_put16(ntb + 8, 2180);
+	ncm_put16(ntb + 12 + 4, NCM_NDP16_LEN + 3 * NCM_DPE16_LEN);
+	expect("NDP16 ended by wLength", 2180, 5, five);
+}
+
+static void check_malformed(void)
+{
+	build_five();
+	ntb[0] ^= 1;
+	expect("bad NTH16 signature", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 4, 16);
+	expect("bad wHeaderLength", 2180, -1, NULL);
+
+	expect("shorter than an NTH16", NCM_NTH16_LEN - 1, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 8, 2181);
+	expect("wBlockLength beyond the transfer", 2180, -1, NULL);
+
+	/* the last datagram ends 8 bytes past wBlockLength */
+	build_five();
+	ncm_put16(ntb + 8, 2180);
+	ncm_put16(ntb + 2152 + 8 + 4 + 2, 100);
+	expect("datagram beyond wBlockLength", 2188, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 8, 2160);
+	expect("second NDP16 beyond wBlockLength", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 10, 8);
+	expect("wNdpIndex inside the NTH16", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 10, 14);
+	expect("wNdpIndex unaligned", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 10, 2176);
+	expect("wNdpIndex at the end of the NTB", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 10, 0xfffc);
+	expect("wNdpIndex far beyond the NTB", 2180, -1, NULL);
+
+	build_five();
+	ntb[12] ^= 1;
+	expect("bad NDP16 signature", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 12 + 4, NCM_NDP16_LEN + NCM_DPE16_LEN);
+	expect("NDP16 wLength below the minimum", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 12 + 4, 0xfff0);
+	expect("NDP16 wLength beyond the NTB", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 12 + 8, 4);
+	expect("datagram inside the NTH16", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 12 + 8 + 4 * 2, 0xff00);
+	expect("datagram index beyond the NTB", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 2152 + 6, 2152);
+	expect("NDP16 chained to itself", 2180, -1, NULL);
+
+	build_five();
+	ncm_put16(ntb + 2152 + 6, 12);
+	expect("NDP16 chain loop", 2180, -1, NULL);
+}
+
+static double ns_since(const struct timespec *t0, long n)
+{
+	struct timespec	t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return ((t1.tv_sec - t0->tv_sec) * 1e9
+		+ (t1.tv_nsec - t0->tv_nsec)) / n;
+}
+
+/* full speed bulk: at most 19 packets of 64 bytes per 1 ms frame */
+#define BUS_PS_PER_BYTE		(1000000000ULL / (19 * 64))
+
+/* U-Boot's TFTP: 512 byte blocks, and an ACK for every one */
+#define TFTP_BLOCK		512
+#define TFTP_DATA_FRAME		(14 + 20 + 8 + 4 + TFTP_BLOCK)
+#define TFTP_ACK_FRAME		60	/* 14 + 20 + 8 + 4, padded */
+#define TFTP_FILE		(4 << 20)
+
+static uint8_t		rx[NTB_SIZE];	/* the gadget's side */
+static unsigned long long xfer_ns;	/* fixed cost per transfer */
+static unsigned long long model_ps;	/* modelled transport time */
+static unsigned long	xfers;
+
+static void xfer(const uint8_t *buf, uint32_t len)
+{
+	memcpy(rx, buf, len);
+	model_ps += xfer_ns * 1000 + len * BUS_PS_PER_BYTE;
+	xfers++;
+}
+
+/* what NetReceive() would look at first */
+static volatile uint32_t delivered;
+
+static void deliver(const uint8_t *frame, uint32_t len)
+{
+	delivered += len + frame[12];
+}
+
+/* the gadget's side of a received NTB16 */
+static int ncm_deliver(uint32_t len)
+{
+	struct ncm_ntb16	it;
+	uint32_t		index, dlen;
+	int			n = 0;
+
+	if (ncm_ntb16_begin(&it, rx, len))
+		return -1;
+	while (ncm_ntb16_next(&it, &index, &dlen) > 0) {
+		deliver(rx + index, dlen);
+		n++;
+	}
+	return n;
+}
+
+/* n TFTP data frames, 4 byte aligned after one NDP16, in ntb */
+static uint32_t ncm_batch(const uint8_t *frame, int n)
+{
+	struct dgram	d[MAX_DGRAMS];
+	uint32_t	off;
+	int		i;
+
+	off = NCM_NTH16_LEN + NCM_NDP16_LEN + (n + 1) * NCM_DPE16_LEN;
+	for (i = 0; i < n; i++) {
+		off = (off + 3) & ~3;
+		d[i].index = off;
+		d[i].len = TFTP_DATA_FRAME;
+		memcpy(ntb + off, frame, TFTP_DATA_FRAME);
+		off += TFTP_DATA_FRAME;
+	}
+	nth(off, NCM_NTH16_LEN);
+	ndp(NCM_NTH16_LEN, 0, d, n);
+	return off;
+}
+
+/* the most data frames that fit in one NTB of NCM_NTB_OUT_SIZE */
+static int ncm_batch_max(void)
+{
+	int	n;
+
+	for (n = 1; n < MAX_DGRAMS; n++)
+		if (NCM_NTH16_LEN + NCM_NDP16_LEN + (n + 2) * NCM_DPE16_LEN
+				+ (n + 1) * ((TFTP_DATA_FRAME + 3) & ~3)
+				> NTB_SIZE)
+			break;
+	return n;
+}
+
+/*
+ * Sends TFTP_FILE bytes of blocks and their ACKs: framed as ECM (batch
+ * 0, a transfer per frame) or as NCM with batch data frames per NTB
+ * and one ACK per NTB, the way a sender with a window would.
+ */
+static void tftp(const char *name, int batch)
+{
+	static uint8_t	frame[TFTP_DATA_FRAME], ack[TFTP_ACK_FRAME];
+	struct timespec	t0, t1;
+	unsigned long	blocks = 0, n;
+	double		ns;
+	int		len;
+
+	model_ps = 0;
+	xfers = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	while (blocks < TFTP_FILE / TFTP_BLOCK) {
+		frame[TFTP_DATA_FRAME - TFTP_BLOCK - 1] = blocks;
+		if (!batch) {
+			xfer(frame, sizeof frame);
+			deliver(rx, sizeof frame);
+			n = 1;
+		} else {
+			n = batch;
+			if (n > TFTP_FILE / TFTP_BLOCK - blocks)
+				n = TFTP_FILE / TFTP_BLOCK - blocks;
+			if (n == 1)
+				len = ncm_ntb16_single(ntb, sizeof ntb, blocks,
+						frame, sizeof frame);
+			else
+				len = ncm_batch(frame, n);
+			xfer(ntb, len);
+			if (ncm_deliver(len) != n) {
+				printf("FAIL  %s: NTB of %lu frames lost\n",
+					name, n);
+				failed++;
+				return;
+			}
+		}
+		blocks += n;
+
+		/* and the gadget's ACK of the last one */
+		if (!batch) {
+			xfer(ack, sizeof ack);
+		} else {
+			len = ncm_ntb16_single(ntb, sizeof ntb, blocks, ack,
+					sizeof ack);
+			xfer(ntb, len);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)
+		+ model_ps / 1000.0;
+	printf("%-28s %6lu transfers  %6.1f KiB/s\n", name, xfers,
+		TFTP_FILE / 1024.0 / (ns / 1e9));
+}
+
+static void bench(void)
+{
+	static uint8_t	frame[1514];
+	struct dgram	d[MAX_DGRAMS];
+	struct timespec	t0;
+	const long	n = 1000000;
+	volatile int	sink = 0;
+	long		i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++)
+		sink += ncm_ntb16_single(ntb, sizeof ntb, i, frame,
+				sizeof frame);
+	printf("build 1514 byte NTB: %6.1f ns\n", ns_since(&t0, n));
+
+	build_five();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++)
+		sink += parse(FIVE_END, d);
+	printf("parse 5 datagram NTB: %5.1f ns\n", ns_since(&t0, n));
+
+	printf("TFTP of %d KiB in %d byte blocks, %llu us per transfer:\n",
+		TFTP_FILE >> 10, TFTP_BLOCK, xfer_ns / 1000);
+	tftp("ECM", 0);
+	tftp("NCM, one block per NTB", 1);
+	tftp("NCM, blocks batched in NTBs", ncm_batch_max());
+}
+
+int main(int argc, char *argv[])
+{
+	check_wellformed();
+	check_malformed();
+
+	if (argc > 1 && !strcmp(argv[1], "-b")) {
+		xfer_ns = (argc > 2 ? strtoul(argv[2], NULL, 0) : 1000) * 1000;
+		bench();
+	}
+
+	if (failed) {
+		printf("%d case(s) failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
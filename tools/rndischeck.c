@@ -0,0 +1,470 @@
+/*
+ * rndischeck - runs the RNDIS message code of the USB ethernet gadget
+ * (drivers/usb/gadget/rndis.c) on the host
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ *
+ * rndis.c is compiled as it is, with the few U-Boot definitions it
+ * needs supplied here instead of its headers, and driven through
+ * rndis_msg_parser() the way ether.c does.  The response ring is
+ * checked with its free-running indices started just below their wrap
+ * around, and filled until it refuses more.  Every OID is queried, and
+ * set, against the answers of the switch statements the OID table
+ * replaced.  It exits non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <endian.h>
+#include <errno.h>
+
+/*
+ * The host's linux/types.h and asm/byteorder.h come first in the
+ * include path and are fine; netdevice.h must be U-Boot's.
+ */
+#include <linux/types.h>
+#include "../include/linux/netdevice.h"
+
+typedef uint8_t		u8;
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+typedef uint64_t	u64;
+
+/* all rndis.c wants from these headers is defined below */
+#define __COMMON_H_	1
+#define __NET_H__
+#define _LINUX_LIST_H
+#define _ASM_ARM_UNALIGNED_H
+
+#define ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+#define debug(fmt, args...)	do { if (0) printf(fmt, ##args); } while (0)
+
+#define cpu_to_le32(x)		htole32(x)
+#define __constant_cpu_to_le32(x) htole32(x)
+
+#define get_unaligned(p) ({				\
+	const struct { __typeof__(*(p)) v; }		\
+		__attribute__((packed)) *__p = (void *)(p); \
+	__p->v; })
+#define get_unaligned_le32(p)	le32toh(get_unaligned((const u32 *)(p)))
+
+#define PKTSIZE_ALIGN		1536
+#define ETHER_HDR_SIZE		14
+
+struct eth_device {
+	char	name[16];
+};
+
+/* the ring must never fall back on the heap */
+static int mallocs;
+#define malloc(n)		(mallocs++, malloc(n))
+
+#include "../drivers/usb/gadget/rndis.c"
+
+#undef malloc
+
+static struct eth_device	dev = { "usb_ether" };
+static struct net_device_stats	stats;
+static u16			filter;
+static int			acks, failed;
+
+static int ack(struct eth_device *d)
+{
+	acks++;
+	return 0;
+}
+
+static void check(int ok, const char *name)
+{
+	if (ok) {
+		printf("ok    %s\n", name);
+		return;
+	}
+	printf("FAIL  %s\n", name);
+	failed++;
+}
+
+static int keepalive(u32 id)
+{
+	rndis_keepalive_msg_type	msg;
+
+	msg.MessageType = htole32(REMOTE_NDIS_KEEPALIVE_MSG);
+	msg.MessageLength = htole32(sizeof msg);
+	msg.RequestID = htole32(id);
+	return rndis_msg_parser(0, (u8 *) &msg);
+}
+
+/* hands out the next response, which must be the keepalive reply to id */
+static u8 *reply(u32 id)
+{
+	rndis_keepalive_cmplt_type	*resp;
+	u8				*buf;
+	u32				length;
+
+	buf = rndis_get_next_response(0, &length);
+	if (!buf)
+		return NULL;
+
+	resp = (rndis_keepalive_cmplt_type *) buf;
+	if (length != sizeof *resp
+			|| le32toh(resp->MessageType)
+				!= REMOTE_NDIS_KEEPALIVE_CMPLT
+			|| le32toh(resp->RequestID) != id)
+		return NULL;
+	return buf;
+}
+
+static void setup(unsigned start)
+{
+	rndis_init();
+	rndis_register(ack);
+	rndis_set_param_dev(0, &dev, 1500, &stats, &filter);
+	rndis_set_param_vendor(0, 0x1234, "rndischeck");
+
+	rndis_per_dev_params[0].resp_head = start;
+	rndis_per_dev_params[0].resp_sent = start;
+	rndis_per_dev_params[0].resp_tail = start;
+	acks = 0;
+}
+
+/*
+ * Batches of one to a whole ring of keepalives, each batch answered in
+ * order, from just below the index wrap to well past it.
+ */
+static void check_ring_wrap(void)
+{
+	const unsigned	start = UINT_MAX - 3 * RNDIS_RESP_RING_SIZE;
+	u32		id = 0, first;
+	u8		*buf;
+	int		i, n, ok = 1;
+
+	setup(start);
+	for (n = 0; n < 1000; n++) {
+		first = id;
+		for (i = 0; i <= n % RNDIS_RESP_RING_SIZE; i++)
+			ok &= keepalive(id++) == 0;
+		for (; first != id; first++) {
+			buf = reply(first);
+			ok &= buf != NULL;
+			if (buf)
+				rndis_free_response(0, buf);
+		}
+		ok &= rndis_get_next_response(0, &first) == NULL;
+	}
+	check(ok, "responses in order across the index wrap");
+	check(rndis_per_dev_params[0].resp_head < start,
+		"indices wrapped around");
+	check(acks == id, "one ack per response");
+}
+
+/* a host that stops reading: the ring fills and new requests fail */
+static void check_ring_full(void)
+{
+	u8	*buf[RNDIS_RESP_RING_SIZE];
+	u32	id;
+	int	ok = 1;
+
+	setup(UINT_MAX - 2);
+	for (id = 0; id < RNDIS_RESP_RING_SIZE; id++)
+		ok &= keepalive(id) == 0;
+	check(ok, "ring takes RNDIS_RESP_RING_SIZE responses");
+	check(keepalive(100) == -ENOMEM, "full ring refuses a response");
+
+	/* handed out but not freed still holds its slot */
+	buf[0] = reply(0);
+	buf[1] = reply(1);
+	check(buf[0] && buf[1], "first two responses handed out");
+	check(keepalive(101) == -ENOMEM, "handed out slots stay in use");
+
+	/* freeing out of order is ignored */
+	rndis_free_response(0, buf[1]);
+	check(keepalive(102) == -ENOMEM, "out of order free ignored");
+
+	rndis_free_response(0, buf[0]);
+	check(keepalive(103) == 0, "freed slot is reused");
+	check(keepalive(104) == -ENOMEM, "ring full again");
+
+	/* what's left comes out in order, 103 last */
+	rndis_free_response(0, buf[1]);
+	for (id = 2, ok = 1; id < RNDIS_RESP_RING_SIZE; id++) {
+		buf[0] = reply(id);
+		ok &= buf[0] != NULL;
+		if (buf[0])
+			rndis_free_response(0, buf[0]);
+	}
+	buf[0] = reply(103);
+	check(ok && buf[0], "refused requests left no response");
+	if (buf[0])
+		rndis_free_response(0, buf[0]);
+
+	/* rndis_uninit() drains whatever is still queued */
+	keepalive(200);
+	keepalive(201);
+	rndis_uninit(0);
+	check(rndis_get_next_response(0, &id) == NULL, "uninit drains");
+	check(rndis_per_dev_params[0].resp_tail
+			== rndis_per_dev_params[0].resp_head,
+		"uninit frees");
+}
+
+/* rndis_find_oid() bisects, so the table must be strictly ascending */
+static void check_oid_table(void)
+{
+	int	i, ok = 1;
+
+	for (i = 1; i < oid_table_size; i++)
+		if (oid_table[i - 1].oid >= oid_table[i].oid) {
+			printf("      OID 0x%08X out of order\n",
+				oid_table[i].oid);
+			ok = 0;
+		}
+	check(ok, "OID table sorted");
+
+	for (i = 0, ok = 1; i < oid_table_size; i++)
+		ok &= rndis_find_oid(oid_table[i].oid) == &oid_table[i];
+	check(ok, "every table entry found");
+	check(!rndis_find_oid(0) && !rndis_find_oid(0xffffffff)
+			&& !rndis_find_oid(OID_GEN_SUPPORTED_LIST - 1),
+		"unknown OIDs not found");
+}
+
+/*
+ * What the query switch in gen_ndis_query_resp() answered before the
+ * OID table, for the fixture set up in oid_setup(): the value, or the
+ * bytes at data, and whether it needed the device or its statistics.
+ */
+#define HOST_MAC	"\x02\x00\x11\x22\x33\x44"
+#define MTU		1500
+#define SPEED		100000
+#define VENDOR_ID	0x1234
+#define VENDOR_DESCR	"rndischeck"
+#define FILTER		0x000f
+
+#define Q_DEV		1	/* fails without rndis_set_param_dev() */
+#define Q_STATS		2	/* ... without its statistics */
+#define Q_FAIL		4	/* always fails */
+#define Q_UNLISTED	8	/* not in OID_GEN_SUPPORTED_LIST */
+
+static const struct old_query {
+	u32		oid;
+	int		flags;
+	u32		value;
+	const char	*data;
+	u32		len;
+} old_query[] = {
+	{ OID_GEN_HARDWARE_STATUS,	0,	0 },
+	{ OID_GEN_MEDIA_SUPPORTED,	0,	NDIS_MEDIUM_802_3 },
+	{ OID_GEN_MEDIA_IN_USE,		0,	NDIS_MEDIUM_802_3 },
+	{ OID_GEN_MAXIMUM_FRAME_SIZE,	Q_DEV,	MTU },
+	{ OID_GEN_LINK_SPEED,		0,	SPEED },
+	{ OID_GEN_TRANSMIT_BLOCK_SIZE,	Q_DEV,	MTU },
+	{ OID_GEN_RECEIVE_BLOCK_SIZE,	Q_DEV,	MTU },
+	{ OID_GEN_VENDOR_ID,		0,	VENDOR_ID },
+	{ OID_GEN_VENDOR_DESCRIPTION,	0,	0, VENDOR_DESCR,
+						sizeof VENDOR_DESCR - 1 },
+	{ OID_GEN_VENDOR_DRIVER_VERSION, 0,	1 },
+	{ OID_GEN_CURRENT_PACKET_FILTER, 0,	FILTER },
+	{ OID_GEN_MAXIMUM_TOTAL_SIZE,	0,	RNDIS_MAX_TOTAL_SIZE },
+	{ OID_GEN_MEDIA_CONNECT_STATUS,	0,	NDIS_MEDIA_STATE_CONNECTED },
+	{ OID_GEN_PHYSICAL_MEDIUM,	0,	0 },
+	{ OID_GEN_MAC_OPTIONS,		Q_UNLISTED,
+				NDIS_MAC_OPTION_RECEIVE_SERIALIZED
+				| NDIS_MAC_OPTION_FULL_DUPLEX },
+	{ OID_GEN_XMIT_OK,		Q_STATS, 1000 - 7 - 3 },
+	{ OID_GEN_RCV_OK,		Q_STATS, 2000 - 11 - 5 },
+	{ OID_GEN_XMIT_ERROR,		Q_STATS, 7 },
+	{ OID_GEN_RCV_ERROR,		Q_STATS, 11 },
+	{ OID_GEN_RCV_NO_BUFFER,	Q_STATS, 5 },
+	{ OID_802_3_PERMANENT_ADDRESS,	Q_DEV,	0, HOST_MAC, 6 },
+	{ OID_802_3_CURRENT_ADDRESS,	Q_DEV,	0, HOST_MAC, 6 },
+	{ OID_802_3_MULTICAST_LIST,	0,	0xE0000000 },
+	{ OID_802_3_MAXIMUM_LIST_SIZE,	0,	1 },
+	{ OID_802_3_MAC_OPTIONS,	Q_FAIL },
+	{ OID_802_3_RCV_ERROR_ALIGNMENT, Q_STATS, 13 },
+	{ OID_802_3_XMIT_ONE_COLLISION,	0,	0 },
+	{ OID_802_3_XMIT_MORE_COLLISIONS, 0,	0 },
+};
+
+static void oid_setup(int flags)
+{
+	rndis_params	*params = &rndis_per_dev_params[0];
+
+	setup(0);
+	stats.tx_packets = 1000;
+	stats.tx_errors = 7;
+	stats.tx_dropped = 3;
+	stats.rx_packets = 2000;
+	stats.rx_errors = 11;
+	stats.rx_dropped = 5;
+	stats.rx_frame_errors = 13;
+	filter = FILTER;
+
+	rndis_set_param_medium(0, NDIS_MEDIUM_802_3, SPEED);
+	rndis_set_param_vendor(0, VENDOR_ID, VENDOR_DESCR);
+	rndis_set_host_mac(0, (const u8 *) HOST_MAC);
+	params->mtu = MTU;
+	params->media_state = NDIS_MEDIA_STATE_CONNECTED;
+	if (!(flags & Q_DEV))
+		params->dev = NULL;
+	if (!(flags & Q_STATS))
+		params->stats = NULL;
+}
+
+/* gen_ndis_query_resp() directly, to also cover a missing device */
+static int query(u32 oid, rndis_resp_t *r, u32 *len, u8 **value)
+{
+	rndis_query_cmplt_type	*resp = (rndis_query_cmplt_type *) r->buf;
+	int			ret;
+
+	memset(r, 0xa5, sizeof *r);
+	ret = gen_ndis_query_resp(0, oid, NULL, 0, r);
+	*len = le32toh(resp->InformationBufferLength);
+	*value = (u8 *) &resp[1];
+	if (r->length != *len + sizeof *resp
+			|| le32toh(resp->MessageLength) != r->length)
+		return -1;
+	return ret;
+}
+
+static void check_oid_query(void)
+{
+	static const int	setups[] = { Q_DEV | Q_STATS, Q_DEV, 0 };
+	const struct old_query	*q;
+	rndis_resp_t		r;
+	u8			*value;
+	u32			len, want;
+	int			i, s, ret, ok;
+
+	for (s = 0; s < ARRAY_SIZE(setups); s++) {
+		oid_setup(setups[s]);
+		ok = 1;
+		for (i = 0; i < ARRAY_SIZE(old_query); i++) {
+			q = &old_query[i];
+			ret = query(q->oid, &r, &len, &value);
+			if ((q->flags & Q_FAIL)
+					|| (q->flags & (Q_DEV | Q_STATS)
+						& ~setups[s]))
+				want = ret == -ENOTSUPP && len == 0;
+			else if (q->data)
+				want = !ret && len == q->len
+					&& !memcmp(value, q->data, len);
+			else
+				want = !ret && len == 4
+					&& get_unaligned_le32(value)
+						== q->value;
+			if (!want) {
+				printf("      OID 0x%08X answered wrongly\n",
+					q->oid);
+				ok = 0;
+			}
+		}
+		check(ok, setups[s] == (Q_DEV | Q_STATS)
+			? "queries answered as before"
+			: setups[s] ? "queries without statistics"
+			: "queries without a device");
+	}
+
+	check(query(0x00ffffff, &r, &len, &value) == -ENOTSUPP && !len,
+		"unknown OID query fails");
+	rndis_per_dev_params[0].media_state = NDIS_MEDIA_STATE_DISCONNECTED;
+	check(query(OID_GEN_LINK_SPEED, &r, &len, &value) == 0
+			&& get_unaligned_le32(value) == 0,
+		"no link speed while disconnected");
+}
+
+/* the same OIDs as before, in any order; only the mandatory list length */
+static void check_oid_list(void)
+{
+	rndis_resp_t	r;
+	u8		*value;
+	u32		len, oid;
+	int		i, j, n = 0, ok;
+
+	oid_setup(Q_DEV | Q_STATS);
+	ok = query(OID_GEN_SUPPORTED_LIST, &r, &len, &value) == 0;
+	for (i = 0; ok && i < len / 4; i++) {
+		oid = get_unaligned_le32(value + 4 * i);
+		if (oid == OID_GEN_SUPPORTED_LIST)
+			continue;
+		for (j = 0; j < ARRAY_SIZE(old_query); j++)
+			if (old_query[j].oid == oid)
+				break;
+		if (j == ARRAY_SIZE(old_query)
+				|| (old_query[j].flags & Q_UNLISTED)) {
+			printf("      OID 0x%08X newly listed\n", oid);
+			ok = 0;
+		}
+		n++;
+	}
+	for (j = 0; j < ARRAY_SIZE(old_query); j++)
+		if (!(old_query[j].flags & Q_UNLISTED))
+			n--;
+	check(ok && !n, "supported list as before");
+}
+
+static int set(u32 oid, u32 value)
+{
+	rndis_resp_t	r;
+	u8		buf[4];
+
+	memcpy(buf, &(u32) { htole32(value) }, 4);
+	return gen_ndis_set_resp(0, oid, buf, sizeof buf, &r);
+}
+
+/* the set switch only took the packet filter and the multicast list */
+static void check_oid_set(void)
+{
+	const struct old_query	*q;
+	int			i, ok = 1;
+
+	oid_setup(Q_DEV | Q_STATS);
+	rndis_per_dev_params[0].state = RNDIS_INITIALIZED;
+	check(set(OID_GEN_CURRENT_PACKET_FILTER, 0x0b) == 0 && filter == 0x0b
+			&& rndis_get_state(0) == RNDIS_DATA_INITIALIZED,
+		"packet filter set starts the data flow");
+	check(set(OID_GEN_CURRENT_PACKET_FILTER, 0) == 0 && filter == 0
+			&& rndis_get_state(0) == RNDIS_INITIALIZED,
+		"empty packet filter stops it");
+	check(set(OID_802_3_MULTICAST_LIST, 0) == 0, "multicast list set");
+
+	for (i = 0; i < ARRAY_SIZE(old_query); i++) {
+		q = &old_query[i];
+		if (q->oid != OID_GEN_CURRENT_PACKET_FILTER
+				&& q->oid != OID_802_3_MULTICAST_LIST)
+			ok &= set(q->oid, 0) == -ENOTSUPP;
+	}
+	check(ok && set(0x00ffffff, 0) == -ENOTSUPP, "other sets fail");
+}
+
+int main(int argc, char *argv[])
+{
+	check_ring_wrap();
+	check_ring_full();
+	check_oid_table();
+	check_oid_query();
+	check_oid_list();
+	check_oid_set();
+	check(mallocs == 0, "no heap allocations");
+
+	if (failed) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * secbulkcheck - checks secbulk_sum() (include/usb/secbulk.h) on the
+ * host against the byte sum tools/boot_usb.c sends
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ *
+ * Random buffers of random length, at all four alignments, are summed
+ * in one go and in random pieces carrying the running sum, the way the
+ * gadget sums each packet as it arrives.  All-0xff buffers check that
+ * no lane of the word loop overflows.  An argument seeds the random
+ * numbers (1 by default).  It exits non-zero if any sum differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <usb/secbulk.h>
+
+#define BUF_SIZE	(1 << 20)
+
+static uint8_t buf[BUF_SIZE + 4];
+static int failed;
+
+/* qt2410_csum() of tools/boot_usb.c, with a starting sum */
+static uint16_t byte_sum(const uint8_t *data, uint32_t len, uint16_t csum)
+{
+	uint32_t	j;
+
+	for (j = 0; j < len; j++)
+		csum += data[j];
+	return csum;
+}
+
+static void check(const uint8_t *p, uint32_t len, uint16_t start)
+{
+	uint16_t	want = byte_sum(p, len, start), sum = start;
+	uint32_t	off, n;
+
+	if (secbulk_sum(p, len, start) != want) {
+		printf("FAIL  %u bytes at offset %u: 0x%04x, expected 0x%04x\n",
+			len, (unsigned)((unsigned long)p & 3),
+			secbulk_sum(p, len, start), want);
+		failed++;
+		return;
+	}
+
+	for (off = 0; off < len; off += n) {
+		n = rand() % 2048 + 1;
+		if (n > len - off)
+			n = len - off;
+		sum = secbulk_sum(p + off, n, sum);
+	}
+	if (sum != want) {
+		printf("FAIL  %u bytes in pieces: 0x%04x, expected 0x%04x\n",
+			len, sum, want);
+		failed++;
+	}
+}
+
+static void check_random(void)
+{
+	uint32_t	i, len, align;
+	int		before = failed;
+
+	for (i = 0; i < BUF_SIZE; i++)
+		buf[i] = rand();
+
+	for (len = 0; len < 64; len++)
+		for (align = 0; align < 4; align++)
+			check(buf + align, len, rand());
+
+	for (i = 0; i < 2000; i++) {
+		len = rand() % (i < 1000 ? 8192 : BUF_SIZE);
+		check(buf + rand() % 4, len, rand());
+	}
+	if (failed == before)
+		printf("ok    random lengths and alignments\n");
+}
+
+static void check_lanes(void)
+{
+	uint32_t	align;
+	int		before = failed;
+
+	memset(buf, 0xff, sizeof buf);
+	for (align = 0; align < 4; align++) {
+		check(buf + align, BUF_SIZE, 0xffff);
+		check(buf + align, 256 * 4 + 3, 0);
+		check(buf + align, 257 * 4, 0);
+	}
+	if (failed == before)
+		printf("ok    all-0xff buffers\n");
+}
+
+int main(int argc, char *argv[])
+{
+	srand(argc > 1 ? strtoul(argv[1], NULL, 0) : 1);
+
+	check_random();
+	check_lanes();
+
+	if (failed) {
+		printf("%d sum(s) differ\n", failed);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * ubsum - embed the NAND boot checksum into u-boot.bin
+ *
+ * nand_read_ll() (board/samsung/mini2440/nand_read.c) sums the image
+ * while copying it out of NAND.  This fills in the words reserved after
+ * the "BSUM" marker in start.S: the image length and a word that makes
+ * the 32-bit sum of all little endian words of the image zero.  The
+ * image is padded to a multiple of 4 bytes if needed.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#define BSUM_MAGIC	0x4d555342	/* "BSUM" */
+#define BSUM_SEARCH	1024		/* the marker is in the vector page */
+
+static uint32_t get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char *buf;
+	uint32_t sum = 0;
+	long size, len, off, i;
+	FILE *fp;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: ubsum u-boot.bin\n");
+		return EXIT_FAILURE;
+	}
+
+	fp = fopen(argv[1], "r+b");
+	if (!fp) {
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	rewind(fp);
+
+	len = (size + 3) & ~3;
+	buf = calloc(1, len);
+	if (!buf || (long)fread(buf, 1, size, fp) != size) {
+		fprintf(stderr, "%s: can't read %ld bytes\n", argv[1], size);
+		return EXIT_FAILURE;
+	}
+
+	for (off = 0; off + 12 <= len && off < BSUM_SEARCH; off += 4)
+		if (get_le32(buf + off) == BSUM_MAGIC)
+			break;
+	if (off + 12 > len || off >= BSUM_SEARCH) {
+		fprintf(stderr, "%s: no checksum marker\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	put_le32(buf + off + 4, len);
+	put_le32(buf + off + 8, 0);
+	for (i = 0; i < len; i += 4)
+		sum += get_le32(buf + i);
+	put_le32(buf + off + 8, -sum);
+
+	rewind(fp);
+	if ((long)fwrite(buf, 1, len, fp) != len || fclose(fp)) {
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%s: %ld bytes, checksum 0x%08x\n", argv[1], len, -sum);
+	free(buf);
+
+	return EXIT_SUCCESS;
+}
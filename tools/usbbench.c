@@ -0,0 +1,352 @@
+/*
+ * usbbench - bulk throughput and latency benchmark for the zero gadget
+ * (drivers/usb/gadget/g_zero.c)
+ *
+ * Based on:
+ * tools/usbled.c
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <usb.h>
+
+#define USBD_VENDOR_ID		0x0525
+#define USBD_PRODUCT_ID		0xa4a0
+
+#define SOURCE_SINK_CONFIG	3
+#define LOOPBACK_CONFIG		2
+
+#define DEFAULT_SIZE		4096	/* ZERO_BUFLEN in g_zero.c */
+#define DEFAULT_COUNT		1000
+#define TIMEOUT			5000	/* ms */
+
+enum bench_mode {
+	MODE_IN,		/* device -> host, source/sink config */
+	MODE_OUT,		/* host -> device, source/sink config */
+	MODE_LOOP,		/* out then in, loopback config */
+	MODE_CTRL,		/* ep0 read test (0x5c) */
+};
+
+struct bench_stats {
+	unsigned long		xfers;
+	unsigned long long	bytes;
+	unsigned long long	total_us;
+	unsigned long		min_us;
+	unsigned long		max_us;
+	unsigned long long	jitter_us;	/* sum of |latency delta| */
+	unsigned long		last_us;
+	unsigned long		errors;
+};
+
+static struct usb_device *find_zero_device(void)
+{
+	struct usb_bus *bus;
+
+	for (bus = usb_busses; bus; bus = bus->next) {
+		struct usb_device *dev;
+		for (dev = bus->devices; dev; dev = dev->next) {
+			if (dev->descriptor.idVendor == USBD_VENDOR_ID
+				&&dev->descriptor.idProduct == USBD_PRODUCT_ID)
+			return dev;
+
+		}
+	}
+	return NULL;
+}
+
+/*
+ * look up the bulk endpoint addresses of the given configuration, and
+ * the larger of their wMaxPacketSize
+ */
+static int find_endpoints(struct usb_device *dev, int config,
+		int *ep_in, int *ep_out, int *maxpacket)
+{
+	int i, j;
+
+	*ep_in = *ep_out = -1;
+	*maxpacket = 0;
+
+	for (i = 0; i < dev->descriptor.bNumConfigurations; i++) {
+		struct usb_config_descriptor *cfg = &dev->config[i];
+		struct usb_interface_descriptor *intf;
+
+		if (cfg->bConfigurationValue != config)
+			continue;
+
+		intf = &cfg->interface[0].altsetting[0];
+		for (j = 0; j < intf->bNumEndpoints; j++) {
+			struct usb_endpoint_descriptor *ep = &intf->endpoint[j];
+
+			if ((ep->bmAttributes & USB_ENDPOINT_TYPE_MASK)
+					!= USB_ENDPOINT_TYPE_BULK)
+				continue;
+			if (ep->wMaxPacketSize > *maxpacket)
+				*maxpacket = ep->wMaxPacketSize;
+			if (ep->bEndpointAddress & USB_ENDPOINT_DIR_MASK)
+				*ep_in = ep->bEndpointAddress;
+			else
+				*ep_out = ep->bEndpointAddress;
+		}
+	}
+
+	return (*ep_in < 0 || *ep_out < 0 || !*maxpacket) ? -ENODEV : 0;
+}
+
+static unsigned long elapsed_us(const struct timeval *t0,
+		const struct timeval *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000UL
+		+ t1->tv_usec - t0->tv_usec;
+}
+
+static void account(struct bench_stats *st, unsigned long us, int bytes)
+{
+	if (st->xfers) {
+		st->jitter_us += us > st->last_us ?
+			us - st->last_us : st->last_us - us;
+		if (us < st->min_us)
+			st->min_us = us;
+		if (us > st->max_us)
+			st->max_us = us;
+	} else {
+		st->min_us = st->max_us = us;
+	}
+
+	st->last_us = us;
+	st->total_us += us;
+	st->bytes += bytes;
+	st->xfers++;
+}
+
+static void report(const char *name, const struct bench_stats *st,
+		unsigned long wall_us)
+{
+	if (!st->xfers) {
+		printf("%-5s no transfers completed\n", name);
+		return;
+	}
+
+	printf("%-5s %llu bytes in %lu.%03lu s, %lu.%03lu MB/s\n",
+			name, st->bytes,
+			wall_us / 1000000, (wall_us / 1000) % 1000,
+			(unsigned long)(st->bytes / wall_us),
+			(unsigned long)(st->bytes * 1000 / wall_us) % 1000);
+	printf("      latency us: avg %llu min %lu max %lu jitter %llu"
+			" (%lu xfers, %lu errors)\n",
+			st->total_us / st->xfers, st->min_us, st->max_us,
+			st->xfers > 1 ? st->jitter_us / (st->xfers - 1) : 0,
+			st->xfers, st->errors);
+}
+
+static void usage(void)
+{
+	printf("usage: usbbench [-s size] [-c count] in|out|loop|ctrl\n"
+		"  in    bulk IN from the source (device -> host)\n"
+		"  out   bulk OUT to the sink (host -> device)\n"
+		"  loop  bulk OUT then IN through the loopback config\n"
+		"  ctrl  ep0 read test, size is capped at 256\n"
+		"  -s    bytes per transfer (default %d)\n"
+		"  -c    number of transfers (default %d)\n",
+		DEFAULT_SIZE, DEFAULT_COUNT);
+}
+
+int main(int argc, char *argv[])
+{
+	struct usb_device *dev;
+	struct usb_dev_handle *hdl;
+	struct bench_stats stats;
+	struct timeval start, end, t0, t1;
+	enum bench_mode mode;
+	char *buf, *check = NULL;
+	int size = DEFAULT_SIZE, count = DEFAULT_COUNT;
+	int ep_in, ep_out, maxpacket, config;
+	int opt, i, ret;
+
+	while ((opt = getopt(argc, argv, "s:c:")) != -1) {
+		switch (opt) {
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+			return -EINVAL;
+		}
+	}
+
+	if (optind != argc - 1 || size <= 0 || count <= 0) {
+		usage();
+		return -EINVAL;
+	}
+
+	if (!strcmp(argv[optind], "in"))
+		mode = MODE_IN;
+	else if (!strcmp(argv[optind], "out"))
+		mode = MODE_OUT;
+	else if (!strcmp(argv[optind], "loop"))
+		mode = MODE_LOOP;
+	else if (!strcmp(argv[optind], "ctrl"))
+		mode = MODE_CTRL;
+	else {
+		usage();
+		return -EINVAL;
+	}
+
+	/* the gadget loops a single buffer, and ep0 has 256 bytes */
+	if (mode == MODE_LOOP && size > DEFAULT_SIZE)
+		size = DEFAULT_SIZE;
+	if (mode == MODE_CTRL && size > 256)
+		size = 256;
+
+	usb_init();
+
+	if (!usb_find_busses())
+		return -ENODEV;
+	if (!usb_find_devices())
+		return -ENODEV;
+
+	dev = find_zero_device();
+	if (!dev) {
+		printf("No zero gadget found\n");
+		return -ENODEV;
+	}
+
+	config = mode == MODE_LOOP ? LOOPBACK_CONFIG : SOURCE_SINK_CONFIG;
+	if (find_endpoints(dev, config, &ep_in, &ep_out, &maxpacket)) {
+		printf("No bulk endpoints in configuration %d\n", config);
+		return -ENODEV;
+	}
+
+	/*
+	 * The source sends whole 4096 byte requests, so a read that isn't
+	 * a multiple of maxpacket ends in the middle of a packet and
+	 * overflows.  The loopback OUT request only completes when it is
+	 * full or ends with a short packet, so below 4096 a multiple of
+	 * maxpacket would never come back.
+	 */
+	if (mode == MODE_IN && size % maxpacket) {
+		size += maxpacket - size % maxpacket;
+		printf("in: size rounded up to %d, a multiple of %d\n",
+				size, maxpacket);
+	}
+	if (mode == MODE_LOOP && size < DEFAULT_SIZE && !(size % maxpacket)) {
+		printf("loop: size must be %d or not a multiple of %d\n",
+				DEFAULT_SIZE, maxpacket);
+		return -EINVAL;
+	}
+
+	hdl = usb_open(dev);
+	if (!hdl) {
+		printf("Open usb device failed: %s\n", usb_strerror());
+		return errno;
+	}
+
+#ifdef LIBUSB_HAS_DETACH_KERNEL_DRIVER_NP
+	/* usbtest binds to the same IDs */
+	usb_detach_kernel_driver_np(hdl, 0);
+#endif
+
+	if (usb_set_configuration(hdl, config) < 0) {
+		printf("Unable to set configuration %d: %s\n", config,
+				usb_strerror());
+		return errno;
+	}
+
+	if (usb_claim_interface(hdl, 0) < 0) {
+		printf("Unable to claim usb interface 0 of device: %s\n",
+				usb_strerror());
+		return errno;
+	}
+
+	buf = malloc(size);
+	if (mode == MODE_LOOP)
+		check = malloc(size);
+	if (!buf || (mode == MODE_LOOP && !check)) {
+		printf("Unable to allocate %d bytes\n", size);
+		return -ENOMEM;
+	}
+	for (i = 0; i < size; i++)
+		buf[i] = i % 63;
+
+	memset(&stats, 0, sizeof(stats));
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < count; i++) {
+		gettimeofday(&t0, NULL);
+
+		switch (mode) {
+		case MODE_IN:
+			ret = usb_bulk_read(hdl, ep_in, buf, size, TIMEOUT);
+			break;
+		case MODE_OUT:
+			ret = usb_bulk_write(hdl, ep_out, buf, size, TIMEOUT);
+			break;
+		case MODE_LOOP:
+			buf[0] = i;	/* catch stale data */
+			ret = usb_bulk_write(hdl, ep_out, buf, size, TIMEOUT);
+			if (ret != size)
+				break;
+			ret = usb_bulk_read(hdl, ep_in, check, size, TIMEOUT);
+			if (ret == size && memcmp(buf, check, size))
+				ret = -EIO;
+			break;
+		case MODE_CTRL:
+		default:
+			ret = usb_control_msg(hdl,
+				/* bmRequestType */	USB_ENDPOINT_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE,
+				/* bRequest	 */	0x5c,
+				/* wValue	 */	0,
+				/* wIndex	 */	0,
+				/* Data		 */	buf,
+				/* wLength	 */	size,
+							TIMEOUT);
+			break;
+		}
+
+		gettimeofday(&t1, NULL);
+
+		if (ret != size) {
+			if (!stats.errors)
+				printf("transfer %d: %d (%s)\n", i, ret,
+						ret < 0 ? usb_strerror() :
+						"short");
+			stats.errors++;
+			continue;
+		}
+
+		/* loopback moves the data twice */
+		account(&stats, elapsed_us(&t0, &t1),
+				mode == MODE_LOOP ? 2 * size : size);
+	}
+
+	gettimeofday(&end, NULL);
+	report(argv[optind], &stats, elapsed_us(&start, &end) ? : 1);
+
+	free(check);
+	free(buf);
+	usb_release_interface(hdl, 0);
+	usb_close(hdl);
+
+	return stats.errors ? -EIO : 0;
+}